@@ -10,23 +10,66 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// convertreg
+std::string convertreg(std::string reg, std::string output, RObject bbox, RObject subject);
+RcppExport SEXP _cmtkr_convertreg(SEXP regSEXP, SEXP outputSEXP, SEXP bboxSEXP, SEXP subjectSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type reg(regSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    Rcpp::traits::input_parameter< RObject >::type bbox(bboxSEXP);
+    Rcpp::traits::input_parameter< RObject >::type subject(subjectSEXP);
+    rcpp_result_gen = Rcpp::wrap(convertreg(reg, output, bbox, subject));
+    return rcpp_result_gen;
+END_RCPP
+}
+// readniftivolume
+NumericVector readniftivolume(std::string path);
+RcppExport SEXP _cmtkr_readniftivolume(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(readniftivolume(path));
+    return rcpp_result_gen;
+END_RCPP
+}
 // streamxform
-NumericMatrix streamxform(NumericMatrix points, CharacterVector reglist, double inversionTolerance, bool affineonly);
-RcppExport SEXP _cmtkr_streamxform(SEXP pointsSEXP, SEXP reglistSEXP, SEXP inversionToleranceSEXP, SEXP affineonlySEXP) {
+NumericMatrix streamxform(NumericMatrix points, RObject reglist, double inversionTolerance, bool affineonly, bool compact);
+RcppExport SEXP _cmtkr_streamxform(SEXP pointsSEXP, SEXP reglistSEXP, SEXP inversionToleranceSEXP, SEXP affineonlySEXP, SEXP compactSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< NumericMatrix >::type points(pointsSEXP);
-    Rcpp::traits::input_parameter< CharacterVector >::type reglist(reglistSEXP);
+    Rcpp::traits::input_parameter< RObject >::type reglist(reglistSEXP);
     Rcpp::traits::input_parameter< double >::type inversionTolerance(inversionToleranceSEXP);
     Rcpp::traits::input_parameter< bool >::type affineonly(affineonlySEXP);
-    rcpp_result_gen = Rcpp::wrap(streamxform(points, reglist, inversionTolerance, affineonly));
+    Rcpp::traits::input_parameter< bool >::type compact(compactSEXP);
+    rcpp_result_gen = Rcpp::wrap(streamxform(points, reglist, inversionTolerance, affineonly, compact));
+    return rcpp_result_gen;
+END_RCPP
+}
+// streamxformconcurrent
+List streamxformconcurrent(NumericMatrix points, RObject reglist, int threads, double inversionTolerance);
+RcppExport SEXP _cmtkr_streamxformconcurrent(SEXP pointsSEXP, SEXP reglistSEXP, SEXP threadsSEXP, SEXP inversionToleranceSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type points(pointsSEXP);
+    Rcpp::traits::input_parameter< RObject >::type reglist(reglistSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< double >::type inversionTolerance(inversionToleranceSEXP);
+    rcpp_result_gen = Rcpp::wrap(streamxformconcurrent(points, reglist, threads, inversionTolerance));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_cmtkr_streamxform", (DL_FUNC) &_cmtkr_streamxform, 4},
+    {"_cmtkr_convertreg", (DL_FUNC) &_cmtkr_convertreg, 4},
+    {"_cmtkr_readniftivolume", (DL_FUNC) &_cmtkr_readniftivolume, 1},
+    {"_cmtkr_streamxform", (DL_FUNC) &_cmtkr_streamxform, 5},
+    {"_cmtkr_streamxformconcurrent", (DL_FUNC) &_cmtkr_streamxformconcurrent, 4},
     {NULL, NULL, 0}
 };
 
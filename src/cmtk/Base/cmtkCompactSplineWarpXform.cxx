@@ -0,0 +1,481 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkCompactSplineWarpXform.h"
+
+#include <Base/cmtkCubicSpline.h>
+#include <Base/cmtkMathUtil.h>
+
+#include <System/cmtkException.h>
+
+#include <limits>
+#include <math.h>
+#include <float.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+CompactSplineWarpXform::CompactSplineWarpXform( const SplineWarpXform& warp )
+  : m_Dims( warp.m_Dims ),
+    m_Domain( warp.m_Domain ),
+    m_Spacing( warp.m_Spacing ),
+    m_InverseSpacing( warp.m_InverseSpacing ),
+    m_Offset( warp.m_Offset ),
+    m_MaxQuantisationError( 0 ),
+    m_GlobalScaling( warp.GetGlobalScaling() ),
+    m_InverseAffineScaling( warp.m_InverseAffineScaling )
+{
+  if ( warp.m_InitialAffineXform )
+    this->m_InitialAffineXform = warp.m_InitialAffineXform->Clone();
+
+  this->CopyMetaInfo( warp );
+
+  // initial control point positions are a linear function of the grid index, so we store the first point and per-index increments
+  Self::SpaceVectorType corner[4];
+  corner[0] = this->m_Offset;
+  for ( int axis = 0; axis < 3; ++axis )
+    {
+    corner[1+axis] = this->m_Offset;
+    corner[1+axis][axis] += this->m_Spacing[axis];
+    }
+
+  if ( this->m_InitialAffineXform )
+    {
+    for ( int i = 0; i < 4; ++i )
+      corner[i] = this->m_InitialAffineXform->Apply( corner[i] );
+    }
+
+  this->m_InitialOrigin = corner[0];
+  for ( int axis = 0; axis < 3; ++axis )
+    this->m_InitialAxes[axis] = corner[1+axis] - corner[0];
+
+  // first pass: find largest displacement per dimension to determine quantisation scale
+  Self::SpaceVectorType maxDisplacement( 0.0 );
+  const Types::Coordinate* coeff = warp.m_Parameters;
+  for ( int z = 0; z < this->m_Dims[2]; ++z )
+    for ( int y = 0; y < this->m_Dims[1]; ++y )
+      for ( int x = 0; x < this->m_Dims[0]; ++x )
+	{
+	const Self::SpaceVectorType initial = this->GetInitialControlPointPosition( x, y, z );
+	for ( int dim = 0; dim < 3; ++dim, ++coeff )
+	  maxDisplacement[dim] = std::max<Types::Coordinate>( maxDisplacement[dim], fabs( *coeff - initial[dim] ) );
+	}
+
+  const Types::Coordinate maxQuantised = std::numeric_limits<short>::max();
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    // avoid zero scale for dimensions without deformation
+    this->m_Scale[dim] = (maxDisplacement[dim] > 0) ? maxDisplacement[dim] / maxQuantised : 1.0;
+    }
+
+  // second pass: quantise displacements
+  this->m_Coefficients.resize( 3 * this->m_Dims[0] * this->m_Dims[1] * this->m_Dims[2] );
+  coeff = warp.m_Parameters;
+  std::vector<short>::iterator quantised = this->m_Coefficients.begin();
+  for ( int z = 0; z < this->m_Dims[2]; ++z )
+    for ( int y = 0; y < this->m_Dims[1]; ++y )
+      for ( int x = 0; x < this->m_Dims[0]; ++x )
+	{
+	const Self::SpaceVectorType initial = this->GetInitialControlPointPosition( x, y, z );
+	for ( int dim = 0; dim < 3; ++dim, ++coeff, ++quantised )
+	  {
+	  const Types::Coordinate q = std::max( -maxQuantised, std::min( maxQuantised, static_cast<Types::Coordinate>( MathUtil::Round( (*coeff - initial[dim]) / this->m_Scale[dim] ) ) ) );
+	  *quantised = static_cast<short>( q );
+	  this->m_MaxQuantisationError = std::max<Types::Coordinate>( this->m_MaxQuantisationError, fabs( *coeff - (initial[dim] + q * this->m_Scale[dim]) ) );
+	  }
+	}
+}
+
+CompactSplineWarpXform::CompactSplineWarpXform( const Self& other )
+  : Superclass(),
+    m_Dims( other.m_Dims ),
+    m_Domain( other.m_Domain ),
+    m_Spacing( other.m_Spacing ),
+    m_InverseSpacing( other.m_InverseSpacing ),
+    m_Offset( other.m_Offset ),
+    m_InitialAffineXform( other.m_InitialAffineXform ),
+    m_Coefficients( other.m_Coefficients ),
+    m_Scale( other.m_Scale ),
+    m_InitialOrigin( other.m_InitialOrigin ),
+    m_InitialAxes( other.m_InitialAxes ),
+    m_MaxQuantisationError( other.m_MaxQuantisationError ),
+    m_GlobalScaling( other.m_GlobalScaling ),
+    m_InverseAffineScaling( other.m_InverseAffineScaling )
+{
+  // the base class copy constructor would dereference the parameter vector, which this class does not have
+  this->CopyMetaInfo( other );
+}
+
+SplineWarpXform::SmartPtr
+CompactSplineWarpXform::GetExpanded() const
+{
+  CoordinateVector::SmartPtr parameters( new CoordinateVector( this->m_Coefficients.size() ) );
+  this->GetParamVector( *parameters );
+
+  SplineWarpXform::SmartPtr expanded( new SplineWarpXform( this->m_Domain, this->m_Dims, parameters, this->m_InitialAffineXform ) );
+
+  // keep the exact grid geometry rather than the one re-computed from the domain
+  expanded->m_Spacing = this->m_Spacing;
+  expanded->m_InverseSpacing = this->m_InverseSpacing;
+  expanded->m_Offset = this->m_Offset;
+  expanded->m_GlobalScaling = this->m_GlobalScaling;
+  expanded->m_InverseAffineScaling = this->m_InverseAffineScaling;
+  expanded->CopyMetaInfo( *this );
+
+  return expanded;
+}
+
+void
+CompactSplineWarpXform::GetCell( const Self::SpaceVectorType& v, int *const grid, Types::Coordinate *const f ) const
+{
+  for ( int dim = 0; dim<3; ++dim )
+    {
+    // same cell arithmetic as SplineWarpXform, but never outside the grid, since we cannot decode control points that do not exist
+    const Types::Coordinate r = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
+    grid[dim] = std::max( 0, std::min<int>( static_cast<int>( r ), this->m_Dims[dim]-4 ) );
+    f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r - grid[dim] ) );
+    }
+}
+
+void
+CompactSplineWarpXform::DecodeCellCoefficients( const int* grid, Types::Coordinate *const cell ) const
+{
+  const int nextJ = 3 * this->m_Dims[0];
+  const int nextK = nextJ * this->m_Dims[1];
+
+  const short* quantised = &this->m_Coefficients[0] + 3 * grid[0] + nextJ * grid[1] + nextK * grid[2];
+  Types::Coordinate* cellCoeff = cell;
+  for ( int m = 0; m < 4; ++m )
+    {
+    for ( int l = 0; l < 4; ++l )
+      {
+      Self::SpaceVectorType initial = this->GetInitialControlPointPosition( grid[0], grid[1]+l, grid[2]+m );
+      const short* quantised_ll = quantised + m * nextK + l * nextJ;
+      for ( int k = 0; k < 4; ++k, initial += this->m_InitialAxes[0] )
+	{
+	for ( int dim = 0; dim < 3; ++dim, ++cellCoeff, ++quantised_ll )
+	  *cellCoeff = initial[dim] + *quantised_ll * this->m_Scale[dim];
+	}
+      }
+    }
+}
+
+CompactSplineWarpXform::SpaceVectorType
+CompactSplineWarpXform::Apply( const Self::SpaceVectorType& v ) const
+{
+  int grid[3];
+  Types::Coordinate f[3];
+  this->GetCell( v, grid, f );
+
+  Types::Coordinate cell[Self::CellCoefficients];
+  this->DecodeCellCoefficients( grid, cell );
+
+  // row and plane strides in the dense 4 x 4 x 4 cell buffer
+  const int nextJ = 3 * 4;
+  const int nextK = 3 * 4 * 4;
+
+  Self::SpaceVectorType vTransformed;
+  const Types::Coordinate* coeff = cell;
+  for ( int dim = 0; dim<3; ++dim, ++coeff )
+    {
+    Types::Coordinate mm = 0;
+    const Types::Coordinate *coeff_mm = coeff;
+    for ( int m = 0; m < 4; ++m, coeff_mm += nextK )
+      {
+      Types::Coordinate ll = 0;
+      const Types::Coordinate *coeff_ll = coeff_mm;
+      for ( int l = 0; l < 4; ++l, coeff_ll += nextJ )
+	{
+	Types::Coordinate kk = 0;
+	const Types::Coordinate *coeff_kk = coeff_ll;
+	for ( int k = 0; k < 4; ++k, coeff_kk+=3 )
+	  {
+	  kk += CubicSpline::ApproxSpline( k, f[0] ) * (*coeff_kk);
+	  }
+	ll += CubicSpline::ApproxSpline( l, f[1] ) * kk;
+	}
+      mm += CubicSpline::ApproxSpline( m, f[2] ) * ll;
+      }
+    vTransformed[dim] = mm;
+    }
+
+  return vTransformed;
+}
+
+const CoordinateMatrix3x3
+CompactSplineWarpXform::GetJacobian( const Self::SpaceVectorType& v ) const
+{
+  int grid[3];
+  Types::Coordinate f[3];
+  this->GetCell( v, grid, f );
+
+  Types::Coordinate cell[Self::CellCoefficients];
+  this->DecodeCellCoefficients( grid, cell );
+
+  const int nextJ = 3 * 4;
+  const int nextK = 3 * 4 * 4;
+
+  CoordinateMatrix3x3 J = CoordinateMatrix3x3::Zero();
+  const Types::Coordinate* coeff = cell;
+  for ( int dim = 0; dim<3; ++dim, ++coeff )
+    {
+    const Types::Coordinate *coeff_mm = coeff;
+    for ( int m = 0; m < 4; ++m, coeff_mm += nextK )
+      {
+      Types::Coordinate ll[3] = { 0, 0, 0 };
+      const Types::Coordinate *coeff_ll = coeff_mm;
+      for ( int l = 0; l < 4; ++l, coeff_ll += nextJ )
+	{
+	Types::Coordinate kk[3] = { 0, 0, 0 };
+	const Types::Coordinate *coeff_kk = coeff_ll;
+	for ( int k = 0; k < 4; ++k, coeff_kk+=3 )
+	  {
+	  kk[0] += CubicSpline::DerivApproxSpline( k, f[0] ) * (*coeff_kk);
+	  const Types::Coordinate tmp = CubicSpline::ApproxSpline( k, f[0] ) * (*coeff_kk);
+	  kk[1] += tmp;
+	  kk[2] += tmp;
+	  }
+
+	const Types::Coordinate tmp = CubicSpline::ApproxSpline( l, f[1] );
+	ll[0] += tmp * kk[0];
+	ll[1] += CubicSpline::DerivApproxSpline( l, f[1] ) * kk[1];
+	ll[2] += tmp * kk[2];
+	}
+
+      const Types::Coordinate tmp = CubicSpline::ApproxSpline( m, f[2] );
+      J[dim][0] += tmp * ll[0];
+      J[dim][1] += tmp * ll[1];
+      J[dim][2] += CubicSpline::DerivApproxSpline( m, f[2] ) * ll[2];
+      }
+    }
+
+  // scale with grid spacing exactly as SplineWarpXform::GetJacobian() does
+  for ( int i = 0; i<3; ++i )
+    {
+    for ( int j = 0; j<3; ++j )
+      J[i][j] *= this->m_InverseSpacing[i];
+    }
+
+  return J;
+}
+
+bool
+CompactSplineWarpXform::ApplyInverse
+( const Self::SpaceVectorType& v, Self::SpaceVectorType& u, const Types::Coordinate accuracy ) const
+{
+  return this->ApplyInverseWithInitial( v, u, this->FindClosestControlPoint( v ), accuracy );
+}
+
+CompactSplineWarpXform::SpaceVectorType
+CompactSplineWarpXform::FindClosestControlPoint
+( const Self::SpaceVectorType& v ) const
+{
+  // same search as SplineWarpXform::FindClosestControlPoint()
+  Types::Coordinate closestDistance = FLT_MAX;
+  Types::Coordinate idx[3];
+  for ( int dim = 0; dim < 3; ++dim )
+    idx[dim] = 0.5 * this->m_Dims[dim];
+
+  for ( Types::Coordinate step = 0.25 * MathUtil::Min( 3, idx ); step > 0.01; step *= 0.5 )
+    {
+    bool improved = true;
+    while ( improved )
+      {
+      improved = false;
+      int closestDim = 0, closestDir = 0;
+
+      for ( int dim = 0; dim < 3; ++dim )
+	{
+	for ( int dir = -1; dir < 2; dir +=2 )
+	  {
+	  const Types::Coordinate oldIdx = idx[dim];
+	  idx[dim] += dir * step;
+	  if ( (idx[dim] > 0) && (idx[dim] <= this->m_Dims[dim]-2) )
+	    {
+	    Self::SpaceVectorType cp = this->m_Offset;
+	    for ( int d = 0; d < 3; ++d )
+	      cp[d] += idx[d] * this->m_Spacing[d];
+
+	    cp = this->Apply( cp );
+	    cp -= v;
+	    const Types::Coordinate distance = cp.RootSumOfSquares();
+	    if ( distance < closestDistance )
+	      {
+	      closestDistance = distance;
+	      closestDim = dim;
+	      closestDir = dir;
+	      improved = true;
+	      }
+	    }
+	  idx[dim] = oldIdx;
+	  }
+	}
+
+      if ( improved )
+	{
+	idx[closestDim] += closestDir * step;
+	}
+      }
+    }
+
+  Self::SpaceVectorType closest = this->m_Offset;
+  for ( int dim = 0; dim < 3; ++dim )
+    closest[dim] += idx[dim] * this->m_Spacing[dim];
+  return closest;
+}
+
+CompactSplineWarpXform::SpaceVectorType
+CompactSplineWarpXform::GetShiftedControlPointPosition( const int x, const int y, const int z ) const
+{
+  const short* quantised = &this->m_Coefficients[0] + 3 * ( x + this->m_Dims[0] * ( y + this->m_Dims[1] * z ) );
+
+  Self::SpaceVectorType cp = this->GetInitialControlPointPosition( x, y, z );
+  for ( int dim = 0; dim < 3; ++dim )
+    cp[dim] += quantised[dim] * this->m_Scale[dim];
+  return cp;
+}
+
+CompactSplineWarpXform::ControlPointRegionType
+CompactSplineWarpXform::GetSupportingControlPointsRegion( const UniformVolume::CoordinateRegionType& roi ) const
+{
+  const Self::SpaceVectorType origin = this->GetDomainOrigin();
+
+  Self::ControlPointRegionType region( (Self::ControlPointIndexType( 0 )), (Self::ControlPointIndexType( 0 )) );
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    const Types::Coordinate from = std::max( roi.From()[dim], origin[dim] );
+    const Types::Coordinate to = std::min( roi.To()[dim], origin[dim] + this->m_Domain[dim] );
+
+    // region does not intersect the domain - return empty region
+    if ( from > to )
+      return Self::ControlPointRegionType( (Self::ControlPointIndexType( 0 )), (Self::ControlPointIndexType( 0 )) );
+
+    const int cellFrom = std::min<int>( static_cast<int>( this->m_InverseSpacing[dim] * (from - origin[dim]) ), this->m_Dims[dim]-4 );
+    const int cellTo = std::min<int>( static_cast<int>( this->m_InverseSpacing[dim] * (to - origin[dim]) ), this->m_Dims[dim]-4 );
+
+    region.From()[dim] = cellFrom;
+    region.To()[dim] = cellTo + 4;
+    }
+
+  return region;
+}
+
+UniformVolume::CoordinateRegionType
+CompactSplineWarpXform::GetTransformedBoundingBox( const UniformVolume::CoordinateRegionType& roi ) const
+{
+  const Self::ControlPointRegionType region = this->GetSupportingControlPointsRegion( roi );
+  if ( ! region.Size() )
+    return UniformVolume::CoordinateRegionType( (Self::SpaceVectorType( 0.0 )), (Self::SpaceVectorType( 0.0 )) );
+
+  Self::SpaceVectorType from( FLT_MAX ), to( -FLT_MAX );
+  for ( int z = region.From()[2]; z < region.To()[2]; ++z )
+    {
+    for ( int y = region.From()[1]; y < region.To()[1]; ++y )
+      {
+      for ( int x = region.From()[0]; x < region.To()[0]; ++x )
+	{
+	const Self::SpaceVectorType cp = this->GetShiftedControlPointPosition( x, y, z );
+	for ( int dim = 0; dim < 3; ++dim )
+	  {
+	  from[dim] = std::min( from[dim], cp[dim] );
+	  to[dim] = std::max( to[dim], cp[dim] );
+	  }
+	}
+      }
+    }
+
+  return UniformVolume::CoordinateRegionType( from, to );
+}
+
+Types::Coordinate
+CompactSplineWarpXform::GetParameter( const size_t idx ) const
+{
+  const size_t cp = idx / 3;
+  const int x = cp % this->m_Dims[0];
+  const int y = (cp / this->m_Dims[0]) % this->m_Dims[1];
+  const int z = cp / (this->m_Dims[0] * this->m_Dims[1]);
+  return this->GetShiftedControlPointPosition( x, y, z )[idx % 3];
+}
+
+CoordinateVector&
+CompactSplineWarpXform::GetParamVector( CoordinateVector& v, const size_t targetOffset ) const
+{
+  v.AdjustDimension( std::max<int>( v.Dim, targetOffset + this->ParamVectorDim() ) );
+
+  Types::Coordinate* coeff = v.Elements + targetOffset;
+  for ( int z = 0; z < this->m_Dims[2]; ++z )
+    for ( int y = 0; y < this->m_Dims[1]; ++y )
+      for ( int x = 0; x < this->m_Dims[0]; ++x )
+	{
+	const Self::SpaceVectorType cp = this->GetShiftedControlPointPosition( x, y, z );
+	for ( int dim = 0; dim < 3; ++dim, ++coeff )
+	  *coeff = cp[dim];
+	}
+
+  return v;
+}
+
+void
+CompactSplineWarpXform::ReadOnly() const
+{
+  throw Exception( "The coefficients of a compact spline warp cannot be changed; use GetExpanded() to obtain a modifiable copy.", this );
+}
+
+void
+CompactSplineWarpXform::SetParameter( const size_t, const Types::Coordinate )
+{
+  this->ReadOnly();
+}
+
+void
+CompactSplineWarpXform::SetParamVector( CoordinateVector& )
+{
+  this->ReadOnly();
+}
+
+void
+CompactSplineWarpXform::SetParamVector( const CoordinateVector& )
+{
+  this->ReadOnly();
+}
+
+void
+CompactSplineWarpXform::CopyParamVector( const Xform* )
+{
+  this->ReadOnly();
+}
+
+} // namespace cmtk
@@ -0,0 +1,274 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#ifndef __cmtkCompactSplineWarpXform_h_included_
+#define __cmtkCompactSplineWarpXform_h_included_
+
+#include <cmtkconfig.h>
+
+#include <Base/cmtkXform.h>
+#include <Base/cmtkSplineWarpXform.h>
+#include <Base/cmtkAffineXform.h>
+#include <Base/cmtkUniformVolume.h>
+
+#include <System/cmtkSmartPtr.h>
+
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+/** B-spline warp with compact, quantised coefficient storage for evaluation only.
+ * Each control point is stored as a 16 bit integer displacement from its initial position under the
+ * initial affine transformation of the original warp, with one scale factor per spatial dimension. This
+ * takes a quarter of the memory of the double-precision coefficients of a SplineWarpXform, at the cost of
+ * a uniform absolute error of at most half a quantisation step per coefficient.
+ *
+ * Since this class is not derived from WarpXform, it cannot be passed to registration, fitting, or other
+ * code that modifies or directly accesses spline coefficients. The transformation is evaluated by decoding
+ * the 4x4x4 control points that support the current grid cell on the fly. Parameters can be read through
+ * the generic Xform interface, but not set. Use GetExpanded() to obtain a full SplineWarpXform.
+ */
+class CompactSplineWarpXform :
+  /// Inherit generic transformation interface.
+  public Xform
+{
+public:
+  /// This class.
+  typedef CompactSplineWarpXform Self;
+
+  /// Parent class.
+  typedef Xform Superclass;
+
+  /// Smart pointer to this class.
+  typedef SmartPointer<Self> SmartPtr;
+
+  /// Smart pointer to const this class.
+  typedef SmartConstPointer<Self> SmartConstPtr;
+
+  /// Control point region type.
+  typedef SplineWarpXform::ControlPointRegionType ControlPointRegionType;
+
+  /// Control point index type.
+  typedef SplineWarpXform::ControlPointIndexType ControlPointIndexType;
+
+  /// Construct compact copy of a spline warp.
+  CompactSplineWarpXform( const SplineWarpXform& warp );
+
+  /// Copy constructor.
+  CompactSplineWarpXform( const Self& other );
+
+  /// Dimensions of control point grid.
+  Self::ControlPointIndexType m_Dims;
+
+  /// Domain of control point grid in world coordinates.
+  Self::SpaceVectorType m_Domain;
+
+  /// Spacing between the control points.
+  Self::SpaceVectorType m_Spacing;
+
+  /// Inverse of the spacing between the control points.
+  Self::SpaceVectorType m_InverseSpacing;
+
+  /// Position of the first control point.
+  Self::SpaceVectorType m_Offset;
+
+  /// Initial affine transformation of the original warp.
+  AffineXform::SmartPtr m_InitialAffineXform;
+
+  /// Clone and return smart pointer.
+  Self::SmartPtr Clone () const
+  {
+    return Self::SmartPtr( this->CloneVirtual() );
+  }
+
+  /** Create a full spline warp with the quantised coefficients of this transformation.
+   * The returned warp evaluates to the same values as this object and can be written, modified, or refined.
+   */
+  SplineWarpXform::SmartPtr GetExpanded() const;
+
+  /// Get the largest absolute difference between the coefficients of the original warp and their quantised values.
+  Types::Coordinate GetMaxQuantisationError() const
+  {
+    return this->m_MaxQuantisationError;
+  }
+
+  /// Get global scaling factor of the original warp.
+  virtual Types::Coordinate GetGlobalScaling() const
+  {
+    return this->m_GlobalScaling;
+  }
+
+  /// Get the lower corner of the transformation domain in world coordinates.
+  Self::SpaceVectorType GetDomainOrigin() const
+  {
+    return this->m_Offset + this->m_Spacing;
+  }
+
+  /// Check whether coordinate is in domain of transformation.
+  virtual bool InDomain( const Self::SpaceVectorType& v ) const
+  {
+    const Self::SpaceVectorType origin = this->GetDomainOrigin();
+    return
+      ( v[0] >= origin[0] ) && ( v[0] <= origin[0] + this->m_Domain[0] ) &&
+      ( v[1] >= origin[1] ) && ( v[1] <= origin[1] + this->m_Domain[1] ) &&
+      ( v[2] >= origin[2] ) && ( v[2] <= origin[2] + this->m_Domain[2] );
+  }
+
+  /// Project coordinate to domain of transformation.
+  virtual void ProjectToDomain( Self::SpaceVectorType& v ) const
+  {
+    const Self::SpaceVectorType origin = this->GetDomainOrigin();
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      v[dim] = std::max<Types::Coordinate>( origin[dim], std::min<Types::Coordinate>( v[dim], origin[dim] + this->m_Domain[dim] ) );
+      }
+  }
+
+  /// Apply transformation to vector.
+  virtual Self::SpaceVectorType Apply( const Self::SpaceVectorType& v ) const;
+
+  /** Return origin of warped vector.
+   * As for SplineWarpXform, this is a numerical approximation started from the closest deformed control point.
+   */
+  virtual bool ApplyInverse( const Self::SpaceVectorType& v, Self::SpaceVectorType& u, const Types::Coordinate accuracy = 0.01 ) const;
+
+  /// Get local Jacobian.
+  virtual const CoordinateMatrix3x3 GetJacobian( const Self::SpaceVectorType& v ) const;
+
+  /// Compute Jacobian determinant at a certain location.
+  virtual Types::Coordinate GetJacobianDeterminant( const Self::SpaceVectorType& v ) const
+  {
+    return this->GetJacobian( v ).Determinant();
+  }
+
+  /// Get the decoded position of a control point.
+  Self::SpaceVectorType GetShiftedControlPointPosition( const int x, const int y, const int z ) const;
+
+  /// Get region of control points that support a region of interest; see SplineWarpXform::GetSupportingControlPointsRegion.
+  Self::ControlPointRegionType GetSupportingControlPointsRegion( const UniformVolume::CoordinateRegionType& roi /*!< Region of interest in world coordinates. */ ) const;
+
+  /// Get bounding box of the transformed image of a region of interest; see SplineWarpXform::GetTransformedBoundingBox.
+  UniformVolume::CoordinateRegionType GetTransformedBoundingBox( const UniformVolume::CoordinateRegionType& roi /*!< Region of interest in world coordinates. */ ) const;
+
+  /// Return number of coefficients in parameter vector.
+  virtual size_t ParamVectorDim() const
+  {
+    return this->m_Coefficients.size();
+  }
+
+  /// Return number of variable parameters, which is zero as the coefficients of this transformation cannot be changed.
+  virtual size_t VariableParamVectorDim() const
+  {
+    return 0;
+  }
+
+  /// Get decoded value of one coefficient.
+  virtual Types::Coordinate GetParameter( const size_t idx ) const;
+
+  /// Copy decoded coefficients into a vector.
+  virtual CoordinateVector& GetParamVector( CoordinateVector& v, const size_t targetOffset = 0 ) const;
+
+  /// Setting coefficients is not supported; this throws an exception.
+  virtual void SetParameter( const size_t, const Types::Coordinate );
+
+  /// Setting coefficients is not supported; this throws an exception.
+  virtual void SetParamVector( CoordinateVector& v );
+
+  /// Setting coefficients is not supported; this throws an exception.
+  virtual void SetParamVector( const CoordinateVector& v );
+
+  /// Setting coefficients is not supported; this throws an exception.
+  virtual void CopyParamVector( const Xform* );
+
+protected:
+  /// Clone transformation.
+  virtual Self* CloneVirtual() const
+  {
+    return new Self( *this );
+  }
+
+private:
+  /// Number of coefficients of the 4 x 4 x 4 control points that support one grid cell.
+  static const int CellCoefficients = 3 * 4 * 4 * 4;
+
+  /// Quantised control point displacements, three per control point.
+  std::vector<short> m_Coefficients;
+
+  /// Per-dimension factors that convert quantised displacements into world coordinates.
+  Self::SpaceVectorType m_Scale;
+
+  /// Initial position of the first control point under the initial affine transformation.
+  Self::SpaceVectorType m_InitialOrigin;
+
+  /// Change of initial control point position per grid index step along each axis.
+  FixedArray< 3,Self::SpaceVectorType > m_InitialAxes;
+
+  /// Largest quantisation error of any coefficient.
+  Types::Coordinate m_MaxQuantisationError;
+
+  /// Global scaling factor of the original warp.
+  Types::Coordinate m_GlobalScaling;
+
+  /// Inverse affine scaling of the original warp.
+  Self::SpaceVectorType m_InverseAffineScaling;
+
+  /// Initial position of a control point.
+  Self::SpaceVectorType GetInitialControlPointPosition( const int x, const int y, const int z ) const
+  {
+    return this->m_InitialOrigin + x * this->m_InitialAxes[0] + y * this->m_InitialAxes[1] + z * this->m_InitialAxes[2];
+  }
+
+  /** Find the grid cell of a location and the relative position within it.
+   * The relative position is clamped to the unit cube, which for points inside the domain makes no difference.
+   */
+  void GetCell( const Self::SpaceVectorType& v, int *const grid, Types::Coordinate *const f ) const;
+
+  /// Decode the coefficients of the 4 x 4 x 4 control points supporting one grid cell into a dense buffer.
+  void DecodeCellCoefficients( const int* grid, Types::Coordinate *const cell ) const;
+
+  /// Find nearest (after deformation) control point.
+  Self::SpaceVectorType FindClosestControlPoint( const Self::SpaceVectorType& v ) const;
+
+  /// Throw exception when attempting to change coefficients.
+  void ReadOnly() const;
+};
+
+//@}
+
+} // namespace cmtk
+
+#endif // #ifndef __cmtkCompactSplineWarpXform_h_included_
@@ -0,0 +1,248 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkDeformationField.h"
+
+#include <System/cmtkThreadPool.h>
+
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+DeformationField::DeformationField
+( const FixedVector<3,Types::Coordinate>& domain, const DataGrid::IndexType& dims, const Types::Coordinate* offset, 
+  const CompressedStream::SmartPtr& mappedFile, const size_t dataOffset )
+  : m_MappedFile( mappedFile )
+{
+  // set up the grid as InitGrid() does, but use the displacements in the file mapping as the parameter vector
+  this->InitGridGeometry( domain, dims );
+  this->SetExternalParameterVector( reinterpret_cast<Types::Coordinate*>( const_cast<char*>( mappedFile->GetData() + dataOffset ) ), 3 * this->m_NumberOfControlPoints );
+  this->Update();
+  this->InitSpacing();
+
+  if ( offset )
+    {
+    for ( int dim = 0; dim < 3; ++dim )
+      this->m_Offset[dim] = offset[dim];
+    }
+}
+
+void
+DeformationField::InitControlPoints( const AffineXform* affineXform )
+{
+  this->m_ParameterVector->Clear();
+  
+  if ( affineXform ) 
+    {
+    Types::Coordinate *ofs = this->m_Parameters;
+    
+    Self::SpaceVectorType p;
+    p[2] = this->m_Offset[2];
+    for ( int z = 0; z < this->m_Dims[2]; ++z, p[2] += this->m_Spacing[2] ) 
+      {
+      p[1] = this->m_Offset[1];
+      for ( int y = 0; y < this->m_Dims[1]; ++y, p[1] += this->m_Spacing[1] ) 
+	{
+	p[0] = this->m_Offset[0];
+	for ( int x = 0; x < this->m_Dims[0]; ++x, p[0] += this->m_Spacing[0], ofs += 3 ) 
+	  {
+	  const Self::SpaceVectorType q = affineXform->Apply( p ) - p;
+	  ofs[0] = q[0]; 
+	  ofs[1] = q[1]; 
+	  ofs[2] = q[2];
+	  }
+	}
+      }
+    
+    this->m_InverseAffineScaling = affineXform->GetScales();
+    this->m_GlobalScaling = affineXform->GetGlobalScaling();
+    } 
+  else
+    {
+    this->m_InverseAffineScaling[0] = this->m_InverseAffineScaling[1] = this->m_InverseAffineScaling[2] = this->m_GlobalScaling = 1.0;
+    }
+}
+
+void
+DeformationField::SampleXform( const Xform& xform )
+{
+  ThreadPool& threadPool = ThreadPool::GetGlobalThreadPool();
+  const size_t numberOfTasks = std::min<size_t>( 4 * threadPool.GetNumberOfThreads() - 3, this->m_Dims[2] );
+  
+  std::vector<Self::SampleXformThreadInfo> taskInfo( numberOfTasks );
+  for ( size_t taskIdx = 0; taskIdx < numberOfTasks; ++taskIdx ) 
+    {
+    taskInfo[taskIdx].thisObject = this;
+    taskInfo[taskIdx].xform = &xform;
+    }
+  
+  threadPool.Run( Self::SampleXformThread, taskInfo );
+}
+
+void
+DeformationField::SampleXformThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t )
+{
+  Self::SampleXformThreadInfo *info = static_cast<Self::SampleXformThreadInfo*>( args );
+
+  Self *me = info->thisObject;
+  for ( int z = taskIdx; z < me->m_Dims[2]; z += taskCnt )
+    {
+    Types::Coordinate* coeffZ = me->m_Parameters + z * me->nextK;
+    for ( int y = 0; y < me->m_Dims[1]; ++y )
+      {
+      Types::Coordinate* coeffY = coeffZ + y * me->nextJ;
+      for ( int x = 0; x < me->m_Dims[0]; ++x, coeffY += 3 )
+	{
+	const Self::SpaceVectorType v = me->GetOriginalControlPointPosition( x, y, z );
+	const Self::SpaceVectorType u = info->xform->Apply( v ) - v;
+	coeffY[0] = u[0];
+	coeffY[1] = u[1];
+	coeffY[2] = u[2];
+	}
+      }
+    }
+}
+
+DeformationField::SpaceVectorType
+DeformationField::Apply( const Self::SpaceVectorType& v ) const
+{
+  Self::SpaceVectorType vTransformed( v );
+  Types::Coordinate f[3];
+  int grid[3];
+  
+  for ( int dim = 0; dim<3; ++dim ) 
+    {
+    // This is the (real-valued) index of the grid cell the given location is in.
+    const Types::Coordinate r = this->m_InverseSpacing[dim] * (v[dim] - this->m_Offset[dim]);
+    // This is the actual cell index, clamped to the grid.
+    grid[dim] = std::max( 0, std::min( static_cast<int>( r ), this->m_Dims[dim]-2 ) );
+    // And here's the relative position within the cell.
+    f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r - grid[dim] ) );
+    }
+  
+  // Create a pointer to the front-lower-left corner of the grid cell.
+  const Types::Coordinate* coeff = this->m_Parameters + 3 * ( grid[0] + this->m_Dims[0] * (grid[1] + this->m_Dims[1] * grid[2]) );
+  
+  for ( int dim = 0; dim<3; ++dim, ++coeff ) 
+    {
+    Types::Coordinate mm = 0;
+    const Types::Coordinate *coeff_mm = coeff;
+    for ( int m = 0; m < 2; ++m, coeff_mm += nextK ) 
+      {
+      Types::Coordinate ll = 0;
+      const Types::Coordinate *coeff_ll = coeff_mm;
+      for ( int l = 0; l < 2; ++l, coeff_ll += nextJ ) 
+	{
+	const Types::Coordinate kk = (1-f[0]) * coeff_ll[0] + f[0] * coeff_ll[nextI];
+	ll += ( l ? f[1] : 1-f[1] ) * kk;
+	}
+      mm += ( m ? f[2] : 1-f[2] ) * ll;
+      }
+    vTransformed[dim] += mm;
+    }
+
+  return vTransformed;
+}
+
+DeformationField::SpaceVectorType
+DeformationField::GetTransformedGrid( const int idxX, const int idxY, const int idxZ ) const
+{
+  const Types::Coordinate* coeff = this->m_Parameters + nextI * idxX + nextJ * idxY + nextK * idxZ;
+
+  Self::SpaceVectorType v = this->GetOriginalControlPointPosition( idxX, idxY, idxZ );
+  v[0] += coeff[0];
+  v[1] += coeff[1];
+  v[2] += coeff[2];
+
+  return v;
+}
+
+void
+DeformationField::GetTransformedGridRow
+( Self::SpaceVectorType *const v, const int numPoints, const int idxX, const int idxY, const int idxZ ) const
+{
+  for ( int n = 0; n < numPoints; ++n )
+    {
+    v[n] = this->GetTransformedGrid( idxX+n, idxY, idxZ );
+    }
+}
+
+const CoordinateMatrix3x3
+DeformationField::GetJacobian( const Self::SpaceVectorType& v ) const
+{
+  Types::Coordinate f[3];
+  int grid[3];
+  
+  for ( int dim = 0; dim<3; ++dim ) 
+    {
+    const Types::Coordinate r = this->m_InverseSpacing[dim] * (v[dim] - this->m_Offset[dim]);
+    grid[dim] = std::max( 0, std::min( static_cast<int>( r ), this->m_Dims[dim]-2 ) );
+    f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r - grid[dim] ) );
+    }
+
+  // start with identity, which is the derivative of the undeformed location, then add displacement derivatives.
+  CoordinateMatrix3x3 J = CoordinateMatrix3x3::Identity();
+
+  const Types::Coordinate* coeff = this->m_Parameters + 3 * ( grid[0] + this->m_Dims[0] * (grid[1] + this->m_Dims[1] * grid[2]) );
+  for ( int dim = 0; dim<3; ++dim, ++coeff ) 
+    {
+    const Types::Coordinate *coeff_mm = coeff;
+    for ( int m = 0; m < 2; ++m, coeff_mm += nextK ) 
+      {
+      const Types::Coordinate wz = m ? f[2] : 1-f[2];
+      const Types::Coordinate dwz = m ? 1 : -1;
+
+      const Types::Coordinate *coeff_ll = coeff_mm;
+      for ( int l = 0; l < 2; ++l, coeff_ll += nextJ ) 
+	{
+	const Types::Coordinate wy = l ? f[1] : 1-f[1];
+	const Types::Coordinate dwy = l ? 1 : -1;
+
+	const Types::Coordinate kk = (1-f[0]) * coeff_ll[0] + f[0] * coeff_ll[nextI];
+	const Types::Coordinate dkk = coeff_ll[nextI] - coeff_ll[0];
+
+	J[0][dim] += this->m_InverseSpacing[0] * wz * wy * dkk;
+	J[1][dim] += this->m_InverseSpacing[1] * wz * dwy * kk;
+	J[2][dim] += this->m_InverseSpacing[2] * dwz * wy * kk;
+	}
+      }
+    }
+
+  return J;
+}
+
+} // namespace cmtk
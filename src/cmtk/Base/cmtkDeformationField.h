@@ -44,6 +44,7 @@
 #include <Base/cmtkAffineXform.h>
 
 #include <System/cmtkSmartPtr.h>
+#include <System/cmtkCompressedStream.h>
 
 namespace
 cmtk
@@ -92,6 +93,16 @@ public:
       }
   }
   
+  /** Constructor for a field with displacements held in a memory-mapped file.
+   * The displacements are used in place rather than copied. They must be stored as (x,y,z) triples of Types::Coordinate
+   * in native byte order and suitably aligned, with the grid index along x varying fastest. The file mapping is kept
+   * open as long as this field or a copy of it exists. Its pages are private to this process, so changing the
+   * displacements does not modify the file.
+   */
+  DeformationField( const FixedVector<3,Types::Coordinate>& domain, const DataGrid::IndexType& dims, const Types::Coordinate* offset, 
+		    const CompressedStream::SmartPtr& mappedFile /*!< Stream holding the file mapping (see CompressedStream::GetData()). */, 
+		    const size_t dataOffset /*!< Offset of the displacements from the start of the file. */ );
+  
   /// Destructor.
   virtual ~DeformationField () {}
 
@@ -99,29 +110,68 @@ public:
   virtual void InitGrid( const FixedVector<3,Types::Coordinate>& domain, const Self::ControlPointIndexType& dims )
   {
     this->Superclass::InitGrid( domain, dims );
-    for ( int dim = 0; dim < 3; ++dim )
-      {
-      if ( dims[dim] > 1 )
-	this->m_Spacing[dim] = domain[dim] / (dims[dim]-1);
-      else
-	this->m_Spacing[dim] = 1.0;
-      this->m_InverseSpacing[dim] = 1.0 / this->m_Spacing[dim];
-      }
-    this->m_InverseAffineScaling[0] = this->m_InverseAffineScaling[1] = this->m_InverseAffineScaling[2] = this->m_GlobalScaling = 1.0;
+    this->InitSpacing();
   }
   
   /// Initialize control point positions, potentially with affine displacement.
   void InitControlPoints( const AffineXform* affineXform = NULL );
 
+  /** Set displacements by sampling another transformation at the grid points of this field.
+   * This turns, for example, a spline warp into a dense deformation field. Grid slices are sampled in parallel.
+   */
+  void SampleXform( const Xform& xform /*!< Transformation to sample. */ );
+
   /// Apply transformation to vector in-place.
   virtual Self::SpaceVectorType Apply ( const Self::SpaceVectorType& ) const;
 
   /** Return origin of warped vector.
+   * The initial estimate is obtained from the precomputed inverse field, if one exists, or otherwise by
+   * fixed-point iteration on the displacement field. If this estimate is not within the given accuracy,
+   * it is refined by the Jacobian-based iterative search inherited from Xform.
+   */
+  virtual bool ApplyInverse ( const Self::SpaceVectorType& v, Self::SpaceVectorType& u, const Types::Coordinate accuracy = 0.01  ) const;
+
+  /** Precompute inverse displacement field on the grid of this field.
+   * The inverse at each grid location is computed in parallel, and the resulting field is subsequently used
+   * to initialize ApplyInverse(). The precomputed field is not updated when the coefficients of this transformation
+   * change; call this function again or ClearInverse() after modifying the transformation.
+   * Grid locations for which no inverse within the given accuracy is found are initialized with the best
+   * fixed-point estimate instead.
+   *\param accuracy Accuracy of the inverse computed at each grid location.
+   *\return Number of grid locations for which the inverse did not converge.
    */
-  virtual bool ApplyInverse ( const Self::SpaceVectorType&, Self::SpaceVectorType&, const Types::Coordinate = 0.01  ) const 
+  size_t PrecomputeInverse( const Types::Coordinate accuracy = 0.01 ) const;
+
+  /// Discard precomputed inverse displacement field.
+  void ClearInverse() const
+  {
+    this->m_InverseField = Self::SmartPtr::Null();
+  }
+
+  /// Test whether a precomputed inverse displacement field exists.
+  bool HasPrecomputedInverse() const
+  {
+    return this->m_InverseField.GetPtr() != NULL;
+  }
+
+  /// Check whether coordinate is in domain of transformation.
+  virtual bool InDomain( const Self::SpaceVectorType& v ) const 
   {
-    // not implemented
-    return false;
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      if ( ( v[dim] < this->m_Offset[dim] ) || ( v[dim] > this->m_Offset[dim] + this->m_Domain[dim] ) )
+	return false;
+      }
+    return true;
+  }
+
+  /// Project coordinate to domain of transformation.
+  virtual void ProjectToDomain( Self::SpaceVectorType& v ) const
+  {
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      v[dim] = std::max<Types::Coordinate>( this->m_Offset[dim], std::min<Types::Coordinate>( v[dim], this->m_Offset[dim] + this->m_Domain[dim] ) );
+      }
   }
 
   /** Get the deformed position of a transformation control point.
@@ -160,6 +210,60 @@ protected:
    *\todo This still needs to be implemented.
    */
   virtual Self* CloneVirtual () const { return NULL; }
+
+private:
+  /** Precomputed inverse displacement field, sampled on the same grid as this field.
+   * This is mutable because it only caches initial estimates for ApplyInverse() and does not change the transformation.
+   */
+  mutable Self::SmartPtr m_InverseField;
+
+  /// Memory-mapped file holding the displacements, if they are not held in memory allocated by this object.
+  CompressedStream::SmartPtr m_MappedFile;
+
+  /// Compute grid spacing from domain and dimensions, and reset global scaling.
+  void InitSpacing()
+  {
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      if ( this->m_Dims[dim] > 1 )
+	this->m_Spacing[dim] = this->m_Domain[dim] / (this->m_Dims[dim]-1);
+      else
+	this->m_Spacing[dim] = 1.0;
+      this->m_InverseSpacing[dim] = 1.0 / this->m_Spacing[dim];
+      }
+    this->m_InverseAffineScaling[0] = this->m_InverseAffineScaling[1] = this->m_InverseAffineScaling[2] = this->m_GlobalScaling = 1.0;
+  }
+
+  /// Compute initial estimate of the inverse by fixed-point iteration on the displacement field.
+  Self::SpaceVectorType GetInverseFixedPoint( const Self::SpaceVectorType& v, const Types::Coordinate accuracy ) const;
+
+  /// Thread parameter block for parallel inverse field computation.
+  typedef struct
+  {
+    /// This transformation.
+    const Self* thisObject;
+    /// The inverse field being computed.
+    Self* inverseField;
+    /// Accuracy of the inverse.
+    Types::Coordinate accuracy;
+    /// Number of grid locations processed by this task for which the inverse did not converge.
+    size_t numberOfFailures;
+  } PrecomputeInverseThreadInfo;
+
+  /// Thread function for parallel inverse field computation.
+  static void PrecomputeInverseThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t );
+
+  /// Thread parameter block for parallel sampling of a transformation.
+  typedef struct
+  {
+    /// This transformation.
+    Self* thisObject;
+    /// The transformation being sampled.
+    const Xform* xform;
+  } SampleXformThreadInfo;
+
+  /// Thread function for parallel sampling of a transformation.
+  static void SampleXformThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t );
 };
 
 //@}
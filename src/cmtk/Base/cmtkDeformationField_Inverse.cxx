@@ -0,0 +1,155 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkDeformationField.h"
+
+#include <System/cmtkThreadPool.h>
+
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+bool
+DeformationField::ApplyInverse
+( const Self::SpaceVectorType& v, Self::SpaceVectorType& u, const Types::Coordinate accuracy ) const
+{
+  const Self::SpaceVectorType initial = this->m_InverseField ? this->m_InverseField->Apply( v ) : this->GetInverseFixedPoint( v, accuracy );
+  
+  if ( (this->Apply( initial ) - v).RootSumOfSquares() <= accuracy )
+    {
+    u = initial;
+    return true;
+    }
+
+  return this->ApplyInverseWithInitial( v, u, initial, accuracy );
+}
+
+DeformationField::SpaceVectorType
+DeformationField::GetInverseFixedPoint( const Self::SpaceVectorType& v, const Types::Coordinate accuracy ) const
+{
+  // iterate u <- v - d(u), where d is the displacement at u. This converges wherever the field is a contraction,
+  // i.e., for all but the most extreme deformations. We keep the best estimate in case it does not.
+  Self::SpaceVectorType u( v ), best( v );
+  Types::Coordinate bestError = FLT_MAX;
+
+  for ( int iteration = 0; iteration < 20; ++iteration )
+    {
+    const Self::SpaceVectorType delta = this->Apply( u ) - v;
+    const Types::Coordinate error = delta.RootSumOfSquares();
+    if ( error < bestError )
+      {
+      bestError = error;
+      best = u;
+      }
+    
+    if ( error <= accuracy )
+      break;
+
+    u -= delta;
+    }
+
+  return best;
+}
+
+size_t
+DeformationField::PrecomputeInverse( const Types::Coordinate accuracy ) const
+{
+  // discard previous inverse so it does not affect initialization of the new one
+  this->m_InverseField = Self::SmartPtr::Null();
+
+  Self::SmartPtr inverseField( new Self( this->m_Domain, this->m_Dims, this->m_Offset.begin() ) );
+
+  ThreadPool& threadPool = ThreadPool::GetGlobalThreadPool();
+  const size_t numberOfTasks = std::min<size_t>( 4 * threadPool.GetNumberOfThreads() - 3, this->m_Dims[2] );
+  
+  std::vector<Self::PrecomputeInverseThreadInfo> taskInfo( numberOfTasks );
+  for ( size_t taskIdx = 0; taskIdx < numberOfTasks; ++taskIdx ) 
+    {
+    taskInfo[taskIdx].thisObject = this;
+    taskInfo[taskIdx].inverseField = inverseField.GetPtr();
+    taskInfo[taskIdx].accuracy = accuracy;
+    taskInfo[taskIdx].numberOfFailures = 0;
+    }
+  
+  threadPool.Run( Self::PrecomputeInverseThread, taskInfo );
+
+  size_t numberOfFailures = 0;
+  for ( size_t taskIdx = 0; taskIdx < numberOfTasks; ++taskIdx ) 
+    numberOfFailures += taskInfo[taskIdx].numberOfFailures;
+
+  this->m_InverseField = inverseField;
+  return numberOfFailures;
+}
+
+void
+DeformationField::PrecomputeInverseThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t )
+{
+  Self::PrecomputeInverseThreadInfo *info = static_cast<Self::PrecomputeInverseThreadInfo*>( args );
+
+  const Self *me = info->thisObject;
+  Types::Coordinate* coeff = info->inverseField->m_Parameters;
+
+  for ( int z = taskIdx; z < me->m_Dims[2]; z += taskCnt )
+    {
+    Types::Coordinate* coeffZ = coeff + z * me->nextK;
+    for ( int y = 0; y < me->m_Dims[1]; ++y )
+      {
+      Types::Coordinate* coeffY = coeffZ + y * me->nextJ;
+      for ( int x = 0; x < me->m_Dims[0]; ++x, coeffY += 3 )
+	{
+	const Self::SpaceVectorType v = me->GetOriginalControlPointPosition( x, y, z );
+	
+	Self::SpaceVectorType u;
+	if ( ! me->ApplyInverse( v, u, info->accuracy ) )
+	  {
+	  // no inverse within the requested accuracy; fall back to the best fixed-point estimate, which is only
+	  // ever used to initialize ApplyInverse() and therefore cannot produce an inaccurate result.
+	  u = me->GetInverseFixedPoint( v, info->accuracy );
+	  ++info->numberOfFailures;
+	  }
+	
+	// store inverse as displacement so it can be evaluated like any other deformation field.
+	u -= v;
+	coeffY[0] = u[0];
+	coeffY[1] = u[1];
+	coeffY[2] = u[2];
+	}
+      }
+    }
+}
+
+} // namespace cmtk
@@ -367,12 +367,14 @@ SplineWarpXform::Refine()
   this->DeleteParameterActiveFlags();
   this->m_Dims = newDims;
 
+  // refinement does not move the domain, which may not start at zero for a cropped warp
+  const Self::SpaceVectorType domainOrigin = this->GetDomainOrigin();
   for ( int dim=0; dim<3; ++dim ) 
     {
     assert( this->m_Dims[dim] > 1 );
     this->m_Spacing[dim] = newSpacing[dim];
     this->m_InverseSpacing[dim] = 1.0 / this->m_Spacing[dim];
-    m_Offset[dim] = -this->m_Spacing[dim];
+    m_Offset[dim] = domainOrigin[dim] - this->m_Spacing[dim];
     }
   
   // MUST do this AFTER acutal refinement, as precomputed increments are used
@@ -427,6 +429,9 @@ SplineWarpXform::GetVolumeOfInfluence( const size_t idx, const UniformVolume::Co
       }
     }
   
+  xyzLow += this->GetDomainOrigin();
+  xyzUp += this->GetDomainOrigin();
+
   for ( int dim = 0; dim < 3; ++dim )
     {
     regionFrom[dim] = std::min( domain.To()[dim], std::max( xyzLow[dim], domain.From()[dim]) );
@@ -467,8 +472,9 @@ SplineWarpXform::RegisterVolumePoints
 ( const DataGrid::IndexType& volDims, const Self::SpaceVectorType& delta, const Self::SpaceVectorType& origin )
 {
   const int ijk[3] = { this->nextI, this->nextJ, this->nextK };
+  const Self::SpaceVectorType domainOrigin = this->GetDomainOrigin();
   for ( int axis = 0; axis < 3; ++axis )    
-    this->RegisterVolumeAxis( volDims[axis], delta[axis], origin[axis], this->m_Dims[axis], ijk[axis], this->m_InverseSpacing[axis], 
+    this->RegisterVolumeAxis( volDims[axis], delta[axis], origin[axis] - domainOrigin[axis], this->m_Dims[axis], ijk[axis], this->m_InverseSpacing[axis], 
 			      this->m_GridIndexes[axis], this->m_GridOffsets[axis], this->m_GridSpline[axis], this->m_GridDerivSpline[axis] );
 
   this->VolumeDims = volDims;
@@ -681,7 +687,7 @@ SplineWarpXform
   
   for ( int dim = 0; dim<3; ++dim ) 
     {
-    r[dim] = this->m_InverseSpacing[dim] * v[dim];
+    r[dim] = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
     grid[dim] = std::min( static_cast<int>( r[dim] ), this->m_Dims[dim]-4 );
     f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r[dim] - grid[dim] ) );
     }
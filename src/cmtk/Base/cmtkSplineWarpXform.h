@@ -104,6 +104,69 @@ public:
     return Self::SmartPtr( this->CloneVirtual() );
   }
 
+  /** Get the lower corner of the transformation domain in world coordinates.
+   * This is the location of the first "inside" control point. For a warp that
+   * covers its full original domain, this is the coordinate origin. For a
+   * cropped warp (see GetCropped), it is the origin of the retained sub-grid.
+   */
+  Self::SpaceVectorType GetDomainOrigin() const
+  {
+    return this->m_Offset + this->m_Spacing;
+  }
+
+  /** Check whether the transformation domain starts at the coordinate origin.
+   * This is the case for all warps created by CMTK registration, but not for cropped warps or warps
+   * read from ITK B-spline transforms whose grid origin is not one control point spacing below zero.
+   */
+  bool HasZeroDomainOrigin() const
+  {
+    return (this->m_Offset + this->m_Spacing).MaxAbsValue() == 0;
+  }
+
+  /// Check whether coordinate is in domain of transformation.
+  virtual bool InDomain( const Self::SpaceVectorType& v ) const 
+  {
+    const Self::SpaceVectorType origin = this->GetDomainOrigin();
+    return 
+      ( v[0] >= origin[0] ) && ( v[0] <= origin[0] + this->m_Domain[0] ) &&
+      ( v[1] >= origin[1] ) && ( v[1] <= origin[1] + this->m_Domain[1] ) &&
+      ( v[2] >= origin[2] ) && ( v[2] <= origin[2] + this->m_Domain[2] );
+  }
+
+  /// Project coordinate to domain of transformation.
+  virtual void ProjectToDomain( Self::SpaceVectorType& v ) const
+  {
+    const Self::SpaceVectorType origin = this->GetDomainOrigin();
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      v[dim] = std::max<Types::Coordinate>( origin[dim], std::min<Types::Coordinate>( v[dim], origin[dim] + this->m_Domain[dim] ) );
+      }
+  }
+
+  /** Get region of control points that support a region of interest.
+   * These are the control points of all grid cells that intersect the given region, i.e., exactly
+   * those coefficients that enter into the evaluation of the transformation anywhere inside it.
+   * The region is clipped to the transformation domain.
+   */
+  Self::ControlPointRegionType GetSupportingControlPointsRegion( const UniformVolume::CoordinateRegionType& roi /*!< Region of interest in world coordinates. */ ) const;
+
+  /** Create a cropped copy of this transformation.
+   * The new transformation keeps only the control points returned by GetSupportingControlPointsRegion
+   * for the given region of interest. Its offset is shifted accordingly, so that inside the region
+   * the cropped warp evaluates to the same values as this warp, while using a fraction of the memory.
+   *\return The cropped transformation, or a NULL pointer if the region does not intersect the
+   * transformation domain.
+   */
+  Self::SmartPtr GetCropped( const UniformVolume::CoordinateRegionType& roi /*!< Region of interest in world coordinates. */ ) const;
+
+  /** Get bounding box of the transformed image of a region of interest.
+   * By the convex hull property of the B-spline, the image of each grid cell lies within the bounding box
+   * of the coefficients of its supporting control points, so the returned box is conservative but tight.
+   *\return The bounding box of the transformed region. If the region does not intersect the transformation
+   * domain, the returned region is empty.
+   */
+  UniformVolume::CoordinateRegionType GetTransformedBoundingBox( const UniformVolume::CoordinateRegionType& roi /*!< Region of interest in world coordinates. */ ) const;
+
   /** Create inverse transformation.
    * This function returns NULL as there is no explicit inverse of a spline
    * warp transformation.
@@ -208,7 +271,7 @@ public:
       {
       // This is the (real-valued) index of the control point grid cell the
       // given location is in.
-      const Types::Coordinate r = this->m_InverseSpacing[dim] * v[dim];
+      const Types::Coordinate r = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
       // This is the actual cell index.
       grid[dim] = std::min<int>( static_cast<int>( r ), this->m_Dims[dim]-4 );
       // And here's the relative position within the cell.
@@ -259,7 +322,7 @@ public:
     for ( int dim = 0; dim<3; ++dim ) 
       {
       // This is the (real-valued) index of the control point grid cell the given location is in.
-      const Types::Coordinate r = this->m_InverseSpacing[dim] * v[dim];
+      const Types::Coordinate r = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
       // This is the actual cell index.
       grid[dim] = std::min<int>( static_cast<int>( r ), this->m_Dims[dim]-4 );
       // And here's the relative position within the cell.
@@ -431,6 +494,9 @@ protected:
 
   /// Fitting class is a friend.
   friend class FitSplineWarpToLandmarks;
+
+  /// Compact storage class is a friend.
+  friend class CompactSplineWarpXform;
 };
 
 } // namespace
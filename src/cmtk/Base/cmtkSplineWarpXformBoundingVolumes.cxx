@@ -0,0 +1,137 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkSplineWarpXformBoundingVolumes.h"
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+SplineWarpXformBoundingVolumes::SplineWarpXformBoundingVolumes
+( const SplineWarpXform& warp, const int maxBlocksPerDimension )
+{
+  this->Init( warp, maxBlocksPerDimension );
+}
+
+SplineWarpXformBoundingVolumes::SplineWarpXformBoundingVolumes
+( const CompactSplineWarpXform& warp, const int maxBlocksPerDimension )
+{
+  this->Init( warp, maxBlocksPerDimension );
+}
+
+template<class TWarp>
+void
+SplineWarpXformBoundingVolumes::Init
+( const TWarp& warp, const int maxBlocksPerDimension )
+{
+  const Xform::SpaceVectorType origin = warp.GetDomainOrigin();
+  this->m_DomainBounds = RegionType( origin, origin + warp.m_Domain );
+  this->m_TransformedBounds = warp.GetTransformedBoundingBox( this->m_DomainBounds );
+
+  // divide grid cells into at most maxBlocksPerDimension blocks per dimension
+  int numberOfBlocks[3], cellsPerBlock[3];
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    const int numberOfCells = std::max( 1, warp.m_Dims[dim] - 3 );
+    cellsPerBlock[dim] = (numberOfCells + maxBlocksPerDimension - 1) / maxBlocksPerDimension;
+    numberOfBlocks[dim] = (numberOfCells + cellsPerBlock[dim] - 1) / cellsPerBlock[dim];
+    }
+
+  this->m_BlockDomainBounds.reserve( numberOfBlocks[0] * numberOfBlocks[1] * numberOfBlocks[2] );
+  this->m_BlockTransformedBounds.reserve( numberOfBlocks[0] * numberOfBlocks[1] * numberOfBlocks[2] );
+  for ( int k = 0; k < numberOfBlocks[2]; ++k )
+    {
+    for ( int j = 0; j < numberOfBlocks[1]; ++j )
+      {
+      for ( int i = 0; i < numberOfBlocks[0]; ++i )
+	{
+	const int blockIdx[3] = { i, j, k };
+
+	Xform::SpaceVectorType from, to;
+	for ( int dim = 0; dim < 3; ++dim )
+	  {
+	  from[dim] = origin[dim] + blockIdx[dim] * cellsPerBlock[dim] * warp.m_Spacing[dim];
+	  to[dim] = std::min( origin[dim] + (blockIdx[dim]+1) * cellsPerBlock[dim] * warp.m_Spacing[dim], this->m_DomainBounds.To()[dim] );
+	  }
+
+	const RegionType block( from, to );
+	this->m_BlockDomainBounds.push_back( block );
+	this->m_BlockTransformedBounds.push_back( warp.GetTransformedBoundingBox( block ) );
+	}
+      }
+    }
+}
+
+SplineWarpXformBoundingVolumes::Classification
+SplineWarpXformBoundingVolumes::ClassifyInverse( const Xform::SpaceVectorType& v, const Types::Coordinate tolerance ) const
+{
+  if ( ! Self::IsInside( this->m_TransformedBounds, v, tolerance ) )
+    return Self::OUTSIDE;
+
+  for ( size_t block = 0; block < this->m_BlockTransformedBounds.size(); ++block )
+    {
+    if ( Self::IsInside( this->m_BlockTransformedBounds[block], v, tolerance ) )
+      return Self::UNCERTAIN;
+    }
+
+  return Self::OUTSIDE;
+}
+
+bool
+SplineWarpXformBoundingVolumes::GetInverseBoundingBox( const RegionType& region, RegionType& bbox, const Types::Coordinate tolerance ) const
+{
+  bool found = false;
+  Xform::SpaceVectorType from, to;
+  for ( size_t block = 0; block < this->m_BlockTransformedBounds.size(); ++block )
+    {
+    if ( Self::Intersect( region, this->m_BlockTransformedBounds[block], tolerance ) )
+      {
+      const RegionType& domain = this->m_BlockDomainBounds[block];
+      for ( int dim = 0; dim < 3; ++dim )
+	{
+	from[dim] = found ? std::min( from[dim], domain.From()[dim] ) : domain.From()[dim];
+	to[dim] = found ? std::max( to[dim], domain.To()[dim] ) : domain.To()[dim];
+	}
+      found = true;
+      }
+    }
+
+  if ( found )
+    bbox = RegionType( from, to );
+
+  return found;
+}
+
+} // namespace cmtk
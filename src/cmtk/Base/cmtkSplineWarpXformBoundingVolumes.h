@@ -0,0 +1,167 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#ifndef __cmtkSplineWarpXformBoundingVolumes_h_included_
+#define __cmtkSplineWarpXformBoundingVolumes_h_included_
+
+#include <cmtkconfig.h>
+
+#include <Base/cmtkSplineWarpXform.h>
+#include <Base/cmtkCompactSplineWarpXform.h>
+#include <Base/cmtkUniformVolume.h>
+
+#include <System/cmtkSmartPtr.h>
+#include <System/cmtkSmartConstPtr.h>
+
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+/** Precomputed forward and inverse bounding volumes of a spline warp.
+ * The transformation domain is divided into blocks of grid cells. By the convex hull property of the B-spline,
+ * the image of each block lies within the bounding box of the coefficients of its supporting control points.
+ * These boxes allow points to be rejected before attempting an expensive numerical inversion, and transformed
+ * regions to be bounded without dense evaluation.
+ *\note The bounding volumes are not updated when the coefficients of the underlying transformation change.
+ */
+class SplineWarpXformBoundingVolumes
+{
+public:
+  /// This class.
+  typedef SplineWarpXformBoundingVolumes Self;
+
+  /// Smart pointer to this class.
+  typedef SmartPointer<Self> SmartPtr;
+
+  /// Smart pointer-to-const to this class.
+  typedef SmartConstPointer<Self> SmartConstPtr;
+
+  /// Region type for bounding boxes.
+  typedef UniformVolume::CoordinateRegionType RegionType;
+
+  /// Classification of a point with respect to the transformation domain or range.
+  typedef enum
+  {
+    /// Point is certainly outside.
+    OUTSIDE = 0,
+    /// Point may or may not be inside.
+    UNCERTAIN = 1,
+    /// Point is certainly inside.
+    INSIDE = 2
+  } Classification;
+
+  /// Constructor.
+  SplineWarpXformBoundingVolumes( const SplineWarpXform& warp, const int maxBlocksPerDimension = 8 /*!< Upper limit for the number of cell blocks per dimension. */ );
+
+  /// Constructor for a spline warp with compact coefficient storage.
+  SplineWarpXformBoundingVolumes( const CompactSplineWarpXform& warp, const int maxBlocksPerDimension = 8 /*!< Upper limit for the number of cell blocks per dimension. */ );
+
+  /// Get bounding box of the transformation domain.
+  const RegionType& GetDomainBounds() const
+  {
+    return this->m_DomainBounds;
+  }
+
+  /// Get bounding box of the image of the transformation domain.
+  const RegionType& GetTransformedBounds() const
+  {
+    return this->m_TransformedBounds;
+  }
+
+  /// Classify a point with respect to the domain of the forward transformation; this is exact.
+  Classification ClassifyForward( const Xform::SpaceVectorType& v ) const
+  {
+    return Self::IsInside( this->m_DomainBounds, v, 0 ) ? Self::INSIDE : Self::OUTSIDE;
+  }
+
+  /** Classify a point with respect to the domain of the inverse transformation.
+   * Points that are not within the given tolerance of any block image are classified as OUTSIDE, since
+   * no numerical inversion with that accuracy can succeed for them. All other points are UNCERTAIN.
+   */
+  Classification ClassifyInverse( const Xform::SpaceVectorType& v, const Types::Coordinate tolerance = 0 ) const;
+
+  /** Get bounding box of the preimage of a region under the transformation.
+   *\return False if the region is certainly outside the image of the transformation domain, in which case 
+   * "bbox" is not modified.
+   */
+  bool GetInverseBoundingBox( const RegionType& region, RegionType& bbox, const Types::Coordinate tolerance = 0 ) const;
+
+private:
+  /// Bounding box of the transformation domain.
+  RegionType m_DomainBounds;
+
+  /// Bounding box of the image of the transformation domain.
+  RegionType m_TransformedBounds;
+
+  /// Bounding boxes of cell blocks in the transformation domain.
+  std::vector<RegionType> m_BlockDomainBounds;
+
+  /// Bounding boxes of the images of cell blocks.
+  std::vector<RegionType> m_BlockTransformedBounds;
+
+  /// Compute all bounding volumes for either type of spline warp.
+  template<class TWarp>
+  void Init( const TWarp& warp, const int maxBlocksPerDimension );
+
+  /// Test whether a point is inside a closed region, extended by a tolerance.
+  static bool IsInside( const RegionType& region, const Xform::SpaceVectorType& v, const Types::Coordinate tolerance )
+  {
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      if ( (v[dim] < region.From()[dim] - tolerance) || (v[dim] > region.To()[dim] + tolerance) )
+	return false;
+      }
+    return true;
+  }
+
+  /// Test whether two closed regions, one extended by a tolerance, intersect.
+  static bool Intersect( const RegionType& region, const RegionType& other, const Types::Coordinate tolerance )
+  {
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      if ( (other.To()[dim] < region.From()[dim] - tolerance) || (other.From()[dim] > region.To()[dim] + tolerance) )
+	return false;
+      }
+    return true;
+  }
+};
+
+//@}
+
+} // namespace cmtk
+
+#endif // #ifndef __cmtkSplineWarpXformBoundingVolumes_h_included_
@@ -0,0 +1,142 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkSplineWarpXform.h"
+
+#include <string.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup Base */
+//@{
+
+SplineWarpXform::ControlPointRegionType
+SplineWarpXform::GetSupportingControlPointsRegion( const UniformVolume::CoordinateRegionType& roi ) const
+{
+  const Self::SpaceVectorType origin = this->GetDomainOrigin();
+
+  Self::ControlPointRegionType region( (Self::ControlPointIndexType( 0 )), (Self::ControlPointIndexType( 0 )) );
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    const Types::Coordinate from = std::max( roi.From()[dim], origin[dim] );
+    const Types::Coordinate to = std::min( roi.To()[dim], origin[dim] + this->m_Domain[dim] );
+
+    // region does not intersect the domain - return empty region
+    if ( from > to )
+      return Self::ControlPointRegionType( (Self::ControlPointIndexType( 0 )), (Self::ControlPointIndexType( 0 )) );
+
+    // find the first and last grid cell touched by the region, with the same index arithmetic as in Apply()
+    const int cellFrom = std::min<int>( static_cast<int>( this->m_InverseSpacing[dim] * (from - origin[dim]) ), this->m_Dims[dim]-4 );
+    const int cellTo = std::min<int>( static_cast<int>( this->m_InverseSpacing[dim] * (to - origin[dim]) ), this->m_Dims[dim]-4 );
+
+    // each cell is supported by the 4 control points starting at the cell index.
+    region.From()[dim] = cellFrom;
+    region.To()[dim] = cellTo + 4;
+    }
+
+  return region;
+}
+
+UniformVolume::CoordinateRegionType
+SplineWarpXform::GetTransformedBoundingBox( const UniformVolume::CoordinateRegionType& roi ) const
+{
+  const Self::ControlPointRegionType region = this->GetSupportingControlPointsRegion( roi );
+  if ( ! region.Size() )
+    return UniformVolume::CoordinateRegionType( (Self::SpaceVectorType( 0.0 )), (Self::SpaceVectorType( 0.0 )) );
+
+  Self::SpaceVectorType from( FLT_MAX ), to( -FLT_MAX );
+  for ( int z = region.From()[2]; z < region.To()[2]; ++z )
+    {
+    for ( int y = region.From()[1]; y < region.To()[1]; ++y )
+      {
+      for ( int x = region.From()[0]; x < region.To()[0]; ++x )
+	{
+	const Self::SpaceVectorType cp = this->GetShiftedControlPointPosition( x, y, z );
+	for ( int dim = 0; dim < 3; ++dim )
+	  {
+	  from[dim] = std::min( from[dim], cp[dim] );
+	  to[dim] = std::max( to[dim], cp[dim] );
+	  }
+	}
+      }
+    }
+
+  return UniformVolume::CoordinateRegionType( from, to );
+}
+
+SplineWarpXform::SmartPtr
+SplineWarpXform::GetCropped( const UniformVolume::CoordinateRegionType& roi ) const
+{
+  const Self::ControlPointRegionType region = this->GetSupportingControlPointsRegion( roi );
+  if ( ! region.Size() )
+    return Self::SmartPtr( NULL );
+
+  const Self::ControlPointIndexType newDims = region.To() - region.From();
+
+  CoordinateVector::SmartPtr parameters( new CoordinateVector( 3 * newDims[0] * newDims[1] * newDims[2] ) );
+
+  // copy retained coefficients one grid row at a time
+  Types::Coordinate* dst = parameters->Elements;
+  for ( int z = region.From()[2]; z < region.To()[2]; ++z )
+    {
+    for ( int y = region.From()[1]; y < region.To()[1]; ++y, dst += 3 * newDims[0] )
+      {
+      memcpy( dst, this->m_Parameters + region.From()[0] * nextI + y * nextJ + z * nextK, 3 * newDims[0] * sizeof( *dst ) );
+      }
+    }
+
+  Self::SpaceVectorType newDomain;
+  for ( int dim = 0; dim < 3; ++dim )
+    newDomain[dim] = (newDims[dim]-3) * this->m_Spacing[dim];
+
+  Self::SmartPtr cropped( new SplineWarpXform( newDomain, newDims, parameters, this->m_InitialAffineXform ) );
+
+  // keep the exact grid spacing rather than the one re-computed from the new domain, and move the grid
+  // so the retained control points stay where they were.
+  cropped->m_Spacing = this->m_Spacing;
+  cropped->m_InverseSpacing = this->m_InverseSpacing;
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    cropped->m_Offset[dim] = this->m_Offset[dim] + region.From()[dim] * this->m_Spacing[dim];
+    }
+
+  cropped->m_GlobalScaling = this->m_GlobalScaling;
+  cropped->m_InverseAffineScaling = this->m_InverseAffineScaling;
+  cropped->m_FastMode = this->m_FastMode;
+  cropped->CopyMetaInfo( *this );
+
+  return cropped;
+}
+
+} // namespace cmtk
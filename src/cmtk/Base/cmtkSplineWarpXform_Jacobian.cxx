@@ -209,7 +209,7 @@ SplineWarpXform::GetJacobian
   
   for ( int dim = 0; dim<3; ++dim ) 
     {
-    r[dim] = this->m_InverseSpacing[dim] * v[dim];
+    r[dim] = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
     grid[dim] = std::min( static_cast<int>( r[dim] ), this->m_Dims[dim]-4 );
     f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r[dim] - grid[dim] ) );
     }
@@ -329,7 +329,7 @@ SplineWarpXform::GetJacobianDeterminant
 
   for ( int dim = 0; dim<3; ++dim ) 
     {
-    r[dim] = this->m_InverseSpacing[dim] * v[dim];
+    r[dim] = this->m_InverseSpacing[dim] * ( v[dim] - (this->m_Offset[dim] + this->m_Spacing[dim]) );
     grid[dim] = std::min( static_cast<int>( r[dim] ), this->m_Dims[dim]-4 );
     f[dim] = std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1.0, r[dim] - grid[dim] ) );
     }
@@ -45,6 +45,7 @@
 #include <System/cmtkSmartPtr.h>
 #include <System/cmtkSmartConstPtr.h>
 #include <System/cmtkException.h>
+#include <System/cmtkCompressedStream.h>
 
 #include <math.h>
 #include <stdlib.h>
@@ -327,6 +328,15 @@ public:
   {
     this->m_Deallocator = NULL;
   }
+
+  /** Keep a memory-mapped file open for as long as this array exists.
+   * This is for arrays created in place on the contents of a file mapping (see CompressedStream::GetData()),
+   * which have no deallocator. Arrays on a read-only mapping must not be modified.
+   */
+  void SetMappedFile( const CompressedStream::SmartPtr& mappedFile )
+  {
+    this->m_MappedFile = mappedFile;
+  }
   
   /** Return the number of array elements.
    *\return The number of array elements
@@ -508,6 +518,9 @@ protected:
   /// Deallocator function: if not NULL, this is a pointer to the function called to free the data array.
   Memory::DeallocatorFunctionPointer m_Deallocator;
 
+  /// Memory-mapped file that holds the data array, if any.
+  CompressedStream::SmartPtr m_MappedFile;
+
   /// The size of the data array, i.e. the number of items allocated.
   size_t DataSize;
 
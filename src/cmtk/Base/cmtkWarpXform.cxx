@@ -55,14 +55,21 @@ WarpXform::GetAllControlPointsRegion() const
 void
 WarpXform::InitGrid
 ( const FixedVector<3,Types::Coordinate>& domain, const Self::ControlPointIndexType& dims )
+{
+  this->InitGridGeometry( domain, dims );
+  this->AllocateParameterVector( 3 * this->m_NumberOfControlPoints );
+  this->Update();
+}
+
+void
+WarpXform::InitGridGeometry
+( const FixedVector<3,Types::Coordinate>& domain, const Self::ControlPointIndexType& dims )
 {
   this->m_Domain = domain;
   this->m_Dims = dims;
   std::fill( this->m_Offset.begin(), this->m_Offset.end(), 0 );
   
   this->m_NumberOfControlPoints = this->m_Dims[0] * this->m_Dims[1] * this->m_Dims[2];
-  this->AllocateParameterVector( 3 * this->m_NumberOfControlPoints );
-  this->Update();
 }
 
 void 
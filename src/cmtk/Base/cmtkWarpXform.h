@@ -188,6 +188,12 @@ public:
   /// Initialized internal data structures for new control point grid.
   virtual void InitGrid( const FixedVector<3,Types::Coordinate>& domain, const Self::ControlPointIndexType& dims );
 
+protected:
+  /// Set domain and dimensions of a new control point grid without allocating the parameter vector.
+  void InitGridGeometry( const FixedVector<3,Types::Coordinate>& domain, const Self::ControlPointIndexType& dims );
+
+public:
+
   /// Get region containing all control point indexes.
   virtual Self::ControlPointRegionType GetAllControlPointsRegion() const;
 
@@ -62,6 +62,15 @@ Xform::AllocateParameterVector
     }
 }
 
+void
+Xform::SetExternalParameterVector
+( Types::Coordinate *const parameters, const size_t numberOfParameters )
+{
+  this->m_NumberOfParameters = numberOfParameters;
+  this->m_ParameterVector = CoordinateVector::SmartPtr( new CoordinateVector( numberOfParameters, parameters, false /*freeElements*/ ) );
+  this->m_Parameters = parameters;
+}
+
 void
 Xform::SetParamVector ( CoordinateVector& v ) 
 {
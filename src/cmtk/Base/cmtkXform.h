@@ -224,6 +224,11 @@ protected:
    */
   void AllocateParameterVector( const size_t numberOfParameters );
 
+  /** Use external storage as the parameter vector.
+   * The storage is not copied or freed by this object and must remain valid for as long as the parameter vector is in use.
+   */
+  void SetExternalParameterVector( Types::Coordinate *const parameters, const size_t numberOfParameters );
+
   /// Actual virtual clone constructor function.
   virtual Self* CloneVirtual () const = 0;
 };
@@ -32,6 +32,14 @@
 
 #include "cmtkXformList.h"
 
+#include <Base/cmtkMathUtil.h>
+#include <Base/cmtkDeformationField.h>
+#include <System/cmtkThreadPool.h>
+
+#include <algorithm>
+#include <vector>
+#include <float.h>
+
 void
 cmtk::XformList::Add
 ( const Xform::SmartConstPtr& xform, const bool inverse, const Types::Coordinate globalScale  )
@@ -76,6 +84,282 @@ cmtk::XformList::ApplyInPlace( Xform::SpaceVectorType& v ) const
   return true;
 }
 
+void
+cmtk::XformList::PrecomputeInverses( const size_t numberOfPoints )
+{
+  // inverting a deformation field at every grid location once is cheaper than starting each point's inversion from scratch
+  for ( const_iterator it = this->begin(); it != this->end(); ++it ) 
+    {
+    if ( (*it)->Inverse )
+      {
+      const DeformationField* dfield = dynamic_cast<const DeformationField*>( (*it)->m_Xform.GetConstPtr() );
+      if ( dfield && !dfield->HasPrecomputedInverse() && (3 * numberOfPoints >= dfield->ParamVectorDim()) )
+	dfield->PrecomputeInverse( this->m_Epsilon );
+      }
+    }
+}
+
+void
+cmtk::XformList::ApplyInPlace( Xform::SpaceVectorType* v, bool* valid, const size_t numberOfPoints ) const
+{
+  // small batches are not worth the overhead of sorting and parallelisation
+  const size_t minimumBatch = 1024;
+  if ( numberOfPoints < minimumBatch )
+    {
+    this->ApplyInPlaceSequential( v, valid, numberOfPoints );
+    return;
+    }
+
+  // spatial ordering only pays off if the coefficients of the nonlinear transformations do not fit into cache
+  size_t nonlinearParameters = 0;
+  for ( const_iterator it = this->begin(); it != this->end(); ++it ) 
+    {
+    if ( ! (*it)->IsAffine() )
+      nonlinearParameters += (*it)->m_Xform->ParamVectorDim();
+    }
+  const bool spatialOrdering = this->m_SpatialOrdering && ( nonlinearParameters * sizeof( Types::Coordinate ) > (1<<23) ) && !Self::IsSpatiallyCoherent( v, numberOfPoints );
+
+  std::vector<Xform::SpaceVectorType> ordered;
+  std::vector<size_t> order;
+  if ( spatialOrdering )
+    {
+    // bounding box of all finite input points
+    Xform::SpaceVectorType from( FLT_MAX ), to( -FLT_MAX );
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      {
+      for ( int dim = 0; dim < 3; ++dim )
+	{
+	if ( MathUtil::IsFinite( v[n][dim] ) )
+	  {
+	  from[dim] = std::min( from[dim], v[n][dim] );
+	  to[dim] = std::max( to[dim], v[n][dim] );
+	  }
+	}
+      }
+
+    Xform::SpaceVectorType scale;
+    for ( int dim = 0; dim < 3; ++dim )
+      scale[dim] = (to[dim] > from[dim]) ? 1023 / (to[dim] - from[dim]) : 0;
+
+    std::vector<unsigned int> keys( numberOfPoints );
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      keys[n] = Self::GetMortonKey( v[n], from, scale );
+
+    // stable LSD radix sort of point indexes by key, three passes of 10 bits each
+    order.resize( numberOfPoints );
+    std::vector<size_t> buffer( numberOfPoints );
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      order[n] = n;
+
+    for ( int shift = 0; shift < 30; shift += 10 )
+      {
+      std::vector<size_t> count( 1025, 0 );
+      for ( size_t n = 0; n < numberOfPoints; ++n )
+	++count[1 + ((keys[order[n]] >> shift) & 1023)];
+      for ( size_t bin = 1; bin < count.size(); ++bin )
+	count[bin] += count[bin-1];
+      for ( size_t n = 0; n < numberOfPoints; ++n )
+	buffer[count[(keys[order[n]] >> shift) & 1023]++] = order[n];
+      order.swap( buffer );
+      }
+
+    ordered.resize( numberOfPoints );
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      ordered[n] = v[order[n]];
+    }
+
+  Xform::SpaceVectorType* batch = spatialOrdering ? &ordered[0] : v;
+  bool* batchValid = spatialOrdering ? new bool[numberOfPoints] : valid;
+
+  ThreadPool& threadPool = ThreadPool::GetGlobalThreadPool();
+  const size_t numberOfTasks = std::min<size_t>( 4 * threadPool.GetNumberOfThreads() - 3, numberOfPoints / (minimumBatch/4) );
+
+  Self::ApplyInPlaceThreadInfo info;
+  info.thisObject = this;
+  info.v = batch;
+  info.valid = batchValid;
+  info.numberOfPoints = numberOfPoints;
+  std::vector<Self::ApplyInPlaceThreadInfo> taskInfo( numberOfTasks, info );
+
+  threadPool.Run( Self::ApplyInPlaceThread, taskInfo );
+
+  if ( spatialOrdering )
+    {
+    // restore original order
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      {
+      v[order[n]] = batch[n];
+      valid[order[n]] = batchValid[n];
+      }
+    delete[] batchValid;
+    }
+}
+
+void
+cmtk::XformList::ApplyInPlaceThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t )
+{
+  const Self::ApplyInPlaceThreadInfo* info = static_cast<const Self::ApplyInPlaceThreadInfo*>( args );
+
+  const size_t chunk = info->numberOfPoints / taskCnt;
+  const size_t from = chunk * taskIdx;
+  const size_t to = ( taskIdx == (taskCnt-1) ) ? info->numberOfPoints : chunk * (taskIdx+1);
+
+  info->thisObject->ApplyInPlaceSequential( info->v + from, info->valid + from, to - from );
+}
+
+bool
+cmtk::XformList::IsSpatiallyCoherent( const Xform::SpaceVectorType* v, const size_t numberOfPoints )
+{
+  // compare distances between consecutive points with distances between points half the batch apart, for a sample of evenly spaced points
+  const size_t numberOfSamples = std::min<size_t>( 256, numberOfPoints-1 );
+  Types::Coordinate consecutive = 0, distant = 0;
+  for ( size_t sample = 0; sample < numberOfSamples; ++sample )
+    {
+    const size_t n = sample * (numberOfPoints-1) / numberOfSamples;
+    const Xform::SpaceVectorType& next = v[n+1];
+    const Xform::SpaceVectorType& other = v[(n + numberOfPoints/2) % numberOfPoints];
+    if ( MathUtil::IsFinite( v[n].RootSumOfSquares() ) && MathUtil::IsFinite( next.RootSumOfSquares() ) && MathUtil::IsFinite( other.RootSumOfSquares() ) )
+      {
+      consecutive += (next - v[n]).RootSumOfSquares();
+      distant += (other - v[n]).RootSumOfSquares();
+      }
+    }
+
+  return 4 * consecutive < distant;
+}
+
+unsigned int
+cmtk::XformList::GetMortonKey( const Xform::SpaceVectorType& v, const Xform::SpaceVectorType& from, const Xform::SpaceVectorType& scale )
+{
+  unsigned int key = 0;
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    // quantise to 10 bits; non-finite coordinates go to cell 0
+    const Types::Coordinate q = MathUtil::IsFinite( v[dim] ) ? std::max<Types::Coordinate>( 0, std::min<Types::Coordinate>( 1023, scale[dim] * (v[dim] - from[dim]) ) ) : 0;
+
+    // spread the 10 bits so there are two zero bits between each pair of consecutive bits
+    unsigned int bits = static_cast<unsigned int>( q );
+    bits = (bits | (bits << 16)) & 0x030000FF;
+    bits = (bits | (bits <<  8)) & 0x0300F00F;
+    bits = (bits | (bits <<  4)) & 0x030C30C3;
+    bits = (bits | (bits <<  2)) & 0x09249249;
+
+    key |= bits << dim;
+    }
+  return key;
+}
+
+void
+cmtk::XformList::ApplyInPlaceSequential( Xform::SpaceVectorType* v, bool* valid, const size_t numberOfPoints ) const
+{
+  std::fill( valid, valid + numberOfPoints, true );
+
+  for ( const_iterator it = this->begin(); it != this->end(); ++it ) 
+    {
+    const XformListEntry& entry = **it;
+
+    // pre-pass: reject points that are certainly outside the domain of this transformation
+    if ( entry.m_BoundingVolumes )
+      {
+      for ( size_t n = 0; n < numberOfPoints; ++n )
+	{
+	if ( valid[n] )
+	  {
+	  if ( entry.Inverse )
+	    valid[n] = ( entry.m_BoundingVolumes->ClassifyInverse( v[n], this->m_Epsilon ) != SplineWarpXformBoundingVolumes::OUTSIDE );
+	  else
+	    valid[n] = ( entry.m_BoundingVolumes->ClassifyForward( v[n] ) != SplineWarpXformBoundingVolumes::OUTSIDE );
+	  }
+	}
+      }
+
+    for ( size_t n = 0; n < numberOfPoints; ++n )
+      {
+      if ( ! valid[n] )
+	continue;
+
+      if ( entry.Inverse ) 
+	{
+	if ( entry.InverseAffineXform ) 
+	  v[n] = entry.InverseAffineXform->Apply( v[n] );
+	else
+	  valid[n] = entry.m_Xform->ApplyInverse( v[n], v[n], this->m_Epsilon );
+	} 
+      else
+	{
+	if ( entry.m_BoundingVolumes || entry.m_Xform->InDomain( v[n] ) ) 
+	  v[n] = entry.m_Xform->Apply( v[n] );
+	else
+	  valid[n] = false;
+	}
+      }
+    }
+}
+
+bool
+cmtk::XformList::GetTransformedBoundingBox
+( const UniformVolume::CoordinateRegionType& region, UniformVolume::CoordinateRegionType& bbox ) const
+{
+  UniformVolume::CoordinateRegionType current( region );
+  for ( const_iterator it = this->begin(); it != this->end(); ++it ) 
+    {
+    const XformListEntry& entry = **it;
+
+    if ( entry.IsAffine() )
+      {
+      const AffineXform* affineXform = entry.Inverse ? entry.InverseAffineXform : dynamic_cast<const AffineXform*>( entry.m_Xform.GetConstPtr() );
+      if ( ! affineXform )
+	return false;
+
+      // bounding box of the eight transformed corners
+      Xform::SpaceVectorType from( FLT_MAX ), to( -FLT_MAX );
+      for ( int corner = 0; corner < 8; ++corner )
+	{
+	Xform::SpaceVectorType v;
+	for ( int dim = 0; dim < 3; ++dim )
+	  v[dim] = (corner & (1<<dim)) ? current.To()[dim] : current.From()[dim];
+	
+	v = affineXform->Apply( v );
+	for ( int dim = 0; dim < 3; ++dim )
+	  {
+	  from[dim] = std::min( from[dim], v[dim] );
+	  to[dim] = std::max( to[dim], v[dim] );
+	  }
+	}
+      current = UniformVolume::CoordinateRegionType( from, to );
+      }
+    else if ( entry.m_BoundingVolumes )
+      {
+      if ( entry.Inverse )
+	{
+	if ( ! entry.m_BoundingVolumes->GetInverseBoundingBox( current, current, this->m_Epsilon ) )
+	  return false;
+	}
+      else if ( entry.m_CompactWarpXform )
+	{
+	if ( ! entry.m_CompactWarpXform->GetSupportingControlPointsRegion( current ).Size() )
+	  return false;
+	current = entry.m_CompactWarpXform->GetTransformedBoundingBox( current );
+	}
+      else
+	{
+	const SplineWarpXform* splineXform = static_cast<const SplineWarpXform*>( entry.m_WarpXform );
+	if ( ! splineXform->GetSupportingControlPointsRegion( current ).Size() )
+	  return false;
+	current = splineXform->GetTransformedBoundingBox( current );
+	}
+      }
+    else
+      {
+      // no bounds available for this transformation type
+      return false;
+      }
+    }
+  
+  bbox = current;
+  return true;
+}
+
 bool
 cmtk::XformList::GetJacobian
 ( const Xform::SpaceVectorType& v, Types::DataItem& jacobian, const bool correctGlobalScale ) const
@@ -55,6 +55,9 @@ class XformList :
 private:
   /// Error threshold for inverse approximation.
   Types::Coordinate m_Epsilon;
+
+  /// Flag for spatial (Morton order) sorting of points in batch transformations.
+  bool m_SpatialOrdering;
   
 public:
   /// This class.
@@ -67,13 +70,25 @@ public:
   typedef SmartConstPointer<Self> SmartConstPtr;
 
   /// Constructor.
-  XformList( const Types::Coordinate epsilon = 0.0 ) : m_Epsilon( epsilon ) {};
+  XformList( const Types::Coordinate epsilon = 0.0 ) : m_Epsilon( epsilon ), m_SpatialOrdering( true ) {};
   
   /// Set epsilon.
   void SetEpsilon( const Types::Coordinate epsilon ) 
   {
     this->m_Epsilon = epsilon;
   }
+
+  /** Set spatial ordering flag for batch transformations.
+   * If set (default), points in large batches are evaluated in Morton order of their locations, so that
+   * consecutive evaluations, and the points handled by each thread, touch nearby transformation coefficients.
+   * Ordering is skipped when the coefficients of all nonlinear transformations fit into cache anyway, and when
+   * consecutive input points are already close to each other.
+   * Results are returned in the original order either way.
+   */
+  void SetSpatialOrdering( const bool spatialOrdering )
+  {
+    this->m_SpatialOrdering = spatialOrdering;
+  }
   
   /// Add a transformation the the end of the list, i.e., to be applied after the current list of transformations
   void Add( const Xform::SmartConstPtr& xform, const bool inverse = false, const Types::Coordinate globalScale = 1.0 );
@@ -84,6 +99,35 @@ public:
   /// Apply a sequence of (inverse) transformations.
   bool ApplyInPlace( Xform::SpaceVectorType& v ) const;
   
+  /** Apply a sequence of (inverse) transformations to a batch of points.
+   * Transformations are applied one at a time to all points. Before each spline warp, points are classified
+   * against the warp's precomputed bounding volumes, so that points that cannot possibly be transformed are
+   * rejected without attempting a numerical inversion. Large batches are split into spatially contiguous
+   * chunks that are processed in parallel. This does not modify the transformations, so a list can be applied
+   * from several threads at once; see PrecomputeInverses() for speeding up inverse deformation fields.
+   *\param v Array of points, which are transformed in place.
+   *\param valid Array of flags, which on return are set to true for points that were transformed successfully
+   * and false for all others. Points that failed are left at an undefined location.
+   *\param numberOfPoints Number of points in both arrays.
+   */
+  void ApplyInPlace( Xform::SpaceVectorType* v, bool* valid, const size_t numberOfPoints ) const;
+
+  /** Precompute inverses of inverted deformation fields for batches of a given size.
+   * For every deformation field that is applied inverse and has no more grid locations than there are points,
+   * the inverse at each grid location is computed once with the current epsilon. It then initializes the
+   * numerical inversion of every point, which is much faster than starting each one from scratch.
+   * Call this after SetEpsilon() and before applying the list. It modifies the deformation fields, so it must
+   * not run while the list, or any other list sharing its transformations, is being applied.
+   */
+  void PrecomputeInverses( const size_t numberOfPoints /*!< Number of points that the list will be applied to. */ );
+
+  /** Get bounding box of the image of a region under the sequence of transformations.
+   * For spline warps the bounding box is conservative, i.e., it contains the transformed region but may be larger.
+   *\return False if the bounding box cannot be determined, either because the region does not intersect a
+   * transformation domain or because the list contains a transformation for which no bounds are available.
+   */
+  bool GetTransformedBoundingBox( const UniformVolume::CoordinateRegionType& region, UniformVolume::CoordinateRegionType& bbox ) const;
+  
   /// Get the Jacobian determinant of a sequence of transformations.
   bool GetJacobian( const Xform::SpaceVectorType& v, Types::DataItem& jacobian, const bool correctGlobalScale = true ) const;
 
@@ -104,6 +148,35 @@ public:
    * an empty string is returned here.
    */
   std::string GetMovingImagePath() const;
+
+private:
+  /// Apply sequence of transformations to a batch of points in the calling thread.
+  void ApplyInPlaceSequential( Xform::SpaceVectorType* v, bool* valid, const size_t numberOfPoints ) const;
+
+  /** Test whether consecutive points in a batch are already close to each other.
+   * This is the case, for example, for points sampled along neuron tracings or surface meshes, which gain nothing from
+   * reordering. The test is based on a fixed-size sample of points.
+   */
+  static bool IsSpatiallyCoherent( const Xform::SpaceVectorType* v, const size_t numberOfPoints );
+
+  /// Compute 30 bit Morton (Z-order) key of a point location quantised within a bounding box.
+  static unsigned int GetMortonKey( const Xform::SpaceVectorType& v, const Xform::SpaceVectorType& from, const Xform::SpaceVectorType& scale );
+
+  /// Parameter block for parallel batch transformation.
+  typedef struct
+  {
+    /// This transformation list.
+    const Self* thisObject;
+    /// Points for all tasks.
+    Xform::SpaceVectorType* v;
+    /// Validity flags for all tasks.
+    bool* valid;
+    /// Total number of points.
+    size_t numberOfPoints;
+  } ApplyInPlaceThreadInfo;
+
+  /// Thread function for parallel batch transformation; each task processes one contiguous chunk of points.
+  static void ApplyInPlaceThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t );
 };
 
 //@}
@@ -40,6 +40,7 @@ cmtk::XformListEntry::XformListEntry
     InverseAffineXform( NULL ),
     m_PolyXform( NULL ),
     m_WarpXform( NULL ),
+    m_CompactWarpXform( NULL ),
     Inverse( inverse ), 
     GlobalScale( globalScale )
 {
@@ -47,6 +48,18 @@ cmtk::XformListEntry::XformListEntry
     {
     this->m_WarpXform = dynamic_cast<const WarpXform*>( this->m_Xform.GetConstPtr() );
     this->m_PolyXform = dynamic_cast<const PolynomialXform*>( this->m_Xform.GetConstPtr() );
+
+    const SplineWarpXform* splineXform = dynamic_cast<const SplineWarpXform*>( this->m_Xform.GetConstPtr() );
+    if ( splineXform )
+      {
+      this->m_BoundingVolumes = SplineWarpXformBoundingVolumes::SmartConstPtr( new SplineWarpXformBoundingVolumes( *splineXform ) );
+      }
+
+    this->m_CompactWarpXform = dynamic_cast<const CompactSplineWarpXform*>( this->m_Xform.GetConstPtr() );
+    if ( this->m_CompactWarpXform )
+      {
+      this->m_BoundingVolumes = SplineWarpXformBoundingVolumes::SmartConstPtr( new SplineWarpXformBoundingVolumes( *(this->m_CompactWarpXform) ) );
+      }
     
     AffineXform::SmartConstPtr affineXform( AffineXform::SmartConstPtr::DynamicCastFrom( this->m_Xform ) );
     if ( affineXform ) 
@@ -70,8 +83,19 @@ cmtk::XformListEntry::CopyAsAffine() const
     {  
     if ( this->m_WarpXform )
       {
+      // deformation fields read from image files have no affine component, so they reduce to the identity
+      if ( ! this->m_WarpXform->m_InitialAffineXform )
+	return Self::SmartPtr( new Self( Xform::SmartPtr( new AffineXform ), this->Inverse, this->GlobalScale ) );
+
       return Self::SmartPtr( new Self( this->m_WarpXform->m_InitialAffineXform, this->Inverse, this->GlobalScale ) );
       }
+    else if ( this->m_CompactWarpXform )
+      {
+      if ( ! this->m_CompactWarpXform->m_InitialAffineXform )
+	return Self::SmartPtr( new Self( Xform::SmartPtr( new AffineXform ), this->Inverse, this->GlobalScale ) );
+
+      return Self::SmartPtr( new Self( this->m_CompactWarpXform->m_InitialAffineXform, this->Inverse, this->GlobalScale ) );
+      }
     else if ( this->m_PolyXform )
       {
       return Self::SmartPtr( new Self( Xform::SmartPtr( new AffineXform( this->m_PolyXform->GetGlobalAffineMatrix() ) ), this->Inverse, this->GlobalScale ) );
@@ -39,6 +39,8 @@
 #include <Base/cmtkAffineXform.h>
 #include <Base/cmtkPolynomialXform.h>
 #include <Base/cmtkWarpXform.h>
+#include <Base/cmtkCompactSplineWarpXform.h>
+#include <Base/cmtkSplineWarpXformBoundingVolumes.h>
 
 #include <System/cmtkSmartPtr.h>
 
@@ -79,6 +81,12 @@ public:
   /// The actual transformation as spline warp.
   const WarpXform* m_WarpXform;
   
+  /// The actual transformation as spline warp with compact coefficient storage.
+  const CompactSplineWarpXform* m_CompactWarpXform;
+  
+  /// Precomputed bounding volumes if transformation is a spline warp.
+  SplineWarpXformBoundingVolumes::SmartConstPtr m_BoundingVolumes;
+
   /// Apply forward (false) or inverse (true) transformation.
   bool Inverse;
   
@@ -88,7 +96,7 @@ public:
   /// Is this an affine transformation?
   bool IsAffine() const
   {
-    return (this->m_WarpXform == NULL) && (this->m_PolyXform == NULL);
+    return (this->m_WarpXform == NULL) && (this->m_CompactWarpXform == NULL) && (this->m_PolyXform == NULL);
   }
 
   /// Make a copy of this entry in which all nonrigid transformations are replaced with their associated affine initializers.
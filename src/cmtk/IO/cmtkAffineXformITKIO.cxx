@@ -34,7 +34,7 @@
 #include <string>
 #include <typeinfo>
 
-void
+bool
 cmtk::AffineXformITKIO
 ::Write( const std::string& filename, const AffineXform& affineXform )
 {
@@ -46,6 +46,7 @@ cmtk::AffineXformITKIO
     Self::Write( stream, affineXform, 0 );
     stream.close();
     }
+  return !stream.fail();
 }
 
 void
@@ -90,6 +91,13 @@ cmtk::AffineXformITKIO
 ::Read( const std::string& filename )
 {
   std::ifstream stream( filename.c_str() );
+  return Self::Read( stream );
+}
+
+cmtk::AffineXform::SmartPtr
+cmtk::AffineXformITKIO
+::Read( std::istream& stream )
+{
   if ( stream.good() )
     {
     std::string line;
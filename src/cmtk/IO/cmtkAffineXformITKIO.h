@@ -35,6 +35,7 @@
 
 #include <Base/cmtkAffineXform.h>
 
+#include <iostream>
 #include <string>
 
 namespace
@@ -51,8 +52,8 @@ public:
   /// This class.
   typedef AffineXformITKIO Self;
   
-  /// Write transformation to ITK file.
-  static void Write( const std::string& filename, const AffineXform& affineXform );
+  /// Write transformation to ITK file; return true on success.
+  static bool Write( const std::string& filename, const AffineXform& affineXform );
   
   /// Write transformation to open stream, e.g., for writing more than one transformation to the same file.
   static void Write( std::ofstream& stream /*!< An open stream to which the ITK file header has already been written.*/,
@@ -61,6 +62,9 @@ public:
   
   /// Read transformation from ITK file.
   static AffineXform::SmartPtr Read( const std::string& filename );
+
+  /// Read transformation from open stream, e.g., a string stream holding the contents of an ITK file.
+  static AffineXform::SmartPtr Read( std::istream& stream );
 };
 
 } // namespace cmtk
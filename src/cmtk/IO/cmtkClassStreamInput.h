@@ -79,6 +79,12 @@ public:
    */
   ClassStreamInput( const std::string& dir, const std::string& archive ) : TypedStreamInput( dir, archive ) {}
 
+  /** Open constructor for an archive in memory.
+   *\param data Pointer to the archive contents, which may be gzip-compressed.
+   *\param size Size of the archive contents in bytes.
+   */
+  ClassStreamInput( const void* data, const size_t size ) : TypedStreamInput( data, size ) {}
+
   /// Read (spline or linear) warp transformation.
   ClassStreamInput& operator >> ( WarpXform::SmartPtr& warpXform );
 
@@ -91,8 +97,22 @@ public:
   /// Actually read warp transformation object.
   ClassStreamInput& Get ( WarpXform*& warpXform, const AffineXform* affineXform = NULL  );
 
+  /** Read only the initial affine transformation of a spline warp.
+   * The warp's control point coefficients are neither parsed nor allocated, which makes this much faster
+   * than reading the complete warp for large control point grids.
+   *\param affineXform The initial affine transformation of the warp, or a NULL pointer if the archive does
+   * not contain a spline warp. For a warp without an initial affine transformation, this is the identity.
+   */
+  ClassStreamInput& GetWarpAffine( AffineXform::SmartPtr& affineXform );
+
   /// Read parametric plane.
   ClassStreamInput& operator >> ( ParametricPlane*& parametricPlane );
+
+private:
+  /** Move to the warp section of the archive, at the top level or inside the "registration" section.
+   *\return 1 for a spline warp, 0 for a linear warp, or -1 if the archive does not contain a warp.
+   */
+  int SeekWarp();
 };
 
 //@}
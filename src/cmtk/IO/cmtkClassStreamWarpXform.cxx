@@ -35,6 +35,12 @@
 
 #include <IO/cmtkClassStreamAffineXform.h>
 
+#include <Base/cmtkSplineWarpXform.h>
+
+#include <System/cmtkConsole.h>
+
+#include <math.h>
+
 namespace
 cmtk
 {
@@ -54,6 +60,13 @@ ClassStreamOutput::PutWarp
   if ( dynamic_cast<const SplineWarpXform*>( warpXform ) )
     this->Begin( "spline_warp" );
   
+  // upstream CMTK ignores the stored origin of absolute warps, so it reads such a warp as if its domain started at zero
+  const SplineWarpXform* splineWarpXform = dynamic_cast<const SplineWarpXform*>( warpXform );
+  if ( splineWarpXform && !splineWarpXform->HasZeroDomainOrigin() )
+    {
+    StdErr << "WARNING: the domain of this warp does not start at the coordinate origin. Only this library restores its origin from a TypedStream archive; other CMTK tools will read a different warp.\n";
+    }
+
   if ( warpXform->GetInitialAffineXform() )
     *this << (*warpXform->GetInitialAffineXform());
   
@@ -91,27 +104,9 @@ ClassStreamInput::Get
 {
   warpXform = NULL;
 
-  int WarpType = -1;
-  if ( this->Seek( "spline_warp" ) == TypedStream::CONDITION_OK ) 
-    WarpType = 1;
-  else
-    if ( this->Seek( "linear_warp" ) == TypedStream::CONDITION_OK )
-      WarpType = 0;
-    else 
-      {
-      this->Rewind();
-      if ( this->Seek( "registration", true /*forward*/ ) != TypedStream::CONDITION_OK )
-	{
-	return *this;
-	}
-      if ( this->Seek( "spline_warp" ) == TypedStream::CONDITION_OK ) 
-	WarpType = 1;
-      else
-	if ( this->Seek( "linear_warp" ) == TypedStream::CONDITION_OK )
-	  WarpType = 0;
-	else
-	  return *this;
-      }
+  const int WarpType = this->SeekWarp();
+  if ( WarpType < 0 )
+    return *this;
   
   AffineXform::SmartPtr initialInverse( NULL );
   if ( initialXform == NULL ) 
@@ -175,6 +170,17 @@ ClassStreamInput::Get
       break;
     case 1: 
       warpXform = new SplineWarpXform( domain, SplineWarpXform::ControlPointIndexType::FromPointer( dims ), parameters, initialInverse );
+      if ( absolute && (readOrigin == TypedStream::CONDITION_OK) )
+	{
+	// restore the grid position of cropped warps and other warps whose domain does not start at zero. Archives
+	// written by CMTK registration store the default origin with limited precision, so keep the exact default
+	// for origins that differ from it only by rounding.
+	for ( int dim = 0; dim < 3; ++dim )
+	  {
+	  if ( fabs( origin[dim] - warpXform->m_Offset[dim] ) > 1e-6 * warpXform->m_Spacing[dim] )
+	    warpXform->m_Offset[dim] = origin[dim];
+	  }
+	}
       break;
     };
   
@@ -199,6 +205,55 @@ ClassStreamInput::Get
   return *this;
 }
 
+ClassStreamInput&
+ClassStreamInput::GetWarpAffine
+( AffineXform::SmartPtr& affineXform )
+{
+  affineXform = AffineXform::SmartPtr::Null();
+
+  // linear warps are no longer supported, so these are not read as warps at all
+  if ( this->SeekWarp() != 1 )
+    return *this;
+
+  AffineXform::SmartPtr initialXform;
+  *this >> initialXform;
+  
+  // the warp is valid only if it has a control point grid, but its coefficients are not needed here
+  int dims[3];
+  if ( TypedStream::CONDITION_OK != this->ReadIntArray( "dims", dims, 3 ) ) 
+    {
+    return *this;
+    }
+  
+  affineXform = initialXform ? initialXform : AffineXform::SmartPtr( new AffineXform );
+  affineXform->SetMetaInfo( META_SPACE, AnatomicalOrientation::ORIENTATION_STANDARD );
+
+  this->End();
+  return *this;
+}
+
+int
+ClassStreamInput::SeekWarp()
+{
+  if ( this->Seek( "spline_warp" ) == TypedStream::CONDITION_OK ) 
+    return 1;
+
+  if ( this->Seek( "linear_warp" ) == TypedStream::CONDITION_OK )
+    return 0;
+
+  this->Rewind();
+  if ( this->Seek( "registration", true /*forward*/ ) != TypedStream::CONDITION_OK )
+    return -1;
+
+  if ( this->Seek( "spline_warp" ) == TypedStream::CONDITION_OK ) 
+    return 1;
+
+  if ( this->Seek( "linear_warp" ) == TypedStream::CONDITION_OK )
+    return 0;
+
+  return -1;
+}
+
 ClassStreamInput& 
 ClassStreamInput::operator >> ( WarpXform::SmartPtr& warpXform )
 {
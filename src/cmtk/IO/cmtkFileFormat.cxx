@@ -34,6 +34,8 @@
 
 #include <Base/cmtkTypes.h>
 #include <System/cmtkCompressedStream.h>
+#include <System/cmtkLockingPtr.h>
+#include <System/cmtkMountPoints.h>
 
 #ifdef HAVE_SYS_TYPES_H
 #  include <sys/types.h>
@@ -47,6 +49,10 @@
 #include <string.h>
 #include <limits.h>
 
+#include <algorithm>
+
+#include <zlib.h>
+
 namespace
 cmtk
 {
@@ -88,6 +94,7 @@ const FileFormatMagic FileFormatMagicNumbers[] = {
   { 0, "\x5C\x01\x00\x00", 4 }, // Analyze little endian
   { 0, "\x00\x00\x01\x5C", 4 }, // Analyze big endian
   { 0, "#Insight Transform File V1.0", 28 }, // ITK transformation file
+  { 0, "CMTKXFRM", 8 }, // CMTK binary transformation file
   { 0, NULL, 0 }  // Unknown.
 };
 
@@ -131,25 +138,59 @@ const char* FileFormatName[] =
   "ANALYZE-HDR-LITTLEENDIAN",
   /// Path is an Analyze 7.5 file in big endian.
   "ANALYZE-HDR-BIGENDIAN",
+  /// Path is an ITK transformation file.
+  "ITK-TFM",
+  /// Path is a CMTK binary transformation file.
+  "XFORM-BINARY",
   /** File type cannot be determined.
    * This ID always has to be the last one!
    */
   NULL
 };
 
+FileFormat::CacheType FileFormat::m_Cache;
+
+MutexLock FileFormat::m_CacheLock;
+
 FileFormatID 
 FileFormat::Identify( const std::string& path, const bool decompress )
 {
+  const std::string realPath = MountPoints::Translate( path );
+
+  // Stat the path itself first; only look for compressed variants of the path if it does not exist.
   CompressedStream::StatType buf;
-  if ( CompressedStream::Stat( path, &buf ) < 0 ) 
+#ifdef CMTK_USE_STAT64
+  if ( stat64( realPath.c_str(), &buf ) )
+#else
+  if ( stat( realPath.c_str(), &buf ) )
+#endif
+    {
+    if ( CompressedStream::Stat( realPath, &buf ) < 0 ) 
+      return FILEFORMAT_NEXIST;
+    }
+
+  const bool isDirectory = (buf.st_mode & S_IFDIR) != 0;
+  if ( !isDirectory && !(buf.st_mode & S_IFREG) )
     return FILEFORMAT_NEXIST;
 
-  if ( buf.st_mode & S_IFDIR ) 
-    return FileFormat::IdentifyDirectory( path );
-  else if ( buf.st_mode & S_IFREG ) 
-    return FileFormat::IdentifyFile( path, decompress );
+  const Self::CacheType::key_type key( realPath, decompress );
+  {
+  LockingPtr<Self::CacheType> cache( Self::m_Cache, Self::m_CacheLock );
+  Self::CacheType::const_iterator it = cache->find( key );
+  if ( (it != cache->end()) && (it->second.m_ModificationTime == buf.st_mtime) && (it->second.m_Size == buf.st_size) && (it->second.m_Inode == static_cast<long long int>( buf.st_ino )) )
+    return it->second.m_ID;
+  }
 
-  return FILEFORMAT_NEXIST;
+  Self::CacheEntry entry;
+  entry.m_ModificationTime = buf.st_mtime;
+  entry.m_Size = buf.st_size;
+  entry.m_Inode = buf.st_ino;
+  entry.m_ID = isDirectory ? FileFormat::IdentifyDirectory( realPath ) : FileFormat::IdentifyFile( realPath, decompress );
+
+  LockingPtr<Self::CacheType> cache( Self::m_Cache, Self::m_CacheLock );
+  (*cache)[key] = entry;
+
+  return entry.m_ID;
 }
 
 std::string
@@ -187,6 +228,10 @@ FileFormat::Describe( const FileFormatID id )
       return "RAW image file [File].";
     case FILEFORMAT_NRRD:
       return "Nrrd image file [File].";
+    case FILEFORMAT_ITK_TFM:
+      return "ITK transformation file [File].";
+    case FILEFORMAT_XFORM_BINARY:
+      return "CMTK binary transformation file [File].";
     case FILEFORMAT_UNKNOWN:
     default:
       break;
@@ -197,23 +242,29 @@ FileFormat::Describe( const FileFormatID id )
 FileFormatID 
 FileFormat::IdentifyDirectory( const std::string& path )
 {
-  char filename[PATH_MAX];
-  struct stat buf;
+  const char* const candidates[] = { "images", "images.gz", "studylist", "studylist.gz", NULL };
+  const FileFormatID candidateIDs[] = { FILEFORMAT_STUDY, FILEFORMAT_STUDY, FILEFORMAT_STUDYLIST, FILEFORMAT_STUDYLIST };
 
-  snprintf( filename, sizeof( filename ), "%s%cimages", path.c_str(), (int)CMTK_PATH_SEPARATOR );
-  if ( (!stat( filename, &buf )) && ( buf.st_mode & S_IFREG ) )
-    return FILEFORMAT_STUDY;
+  std::string filename = path;
+  filename.push_back( CMTK_PATH_SEPARATOR );
+  const size_t prefixLength = filename.length();
+  
+  struct stat buf;
+  for ( size_t i = 0; candidates[i]; ++i )
+    {
+    filename.replace( prefixLength, std::string::npos, candidates[i] );
+    if ( (!stat( filename.c_str(), &buf )) && ( buf.st_mode & S_IFREG ) )
+      return candidateIDs[i];
+    }
 
-  snprintf( filename, sizeof( filename ), "%s%cimages.gz", path.c_str(), (int)CMTK_PATH_SEPARATOR );
-  if ( (!stat( filename, &buf )) && ( buf.st_mode & S_IFREG ) )
+  // less common compression formats, e.g., zstd
+  CompressedStream::StatType cbuf;
+  filename.replace( prefixLength, std::string::npos, "images" );
+  if ( (CompressedStream::Stat( filename, &cbuf ) > 0) && ( cbuf.st_mode & S_IFREG ) )
     return FILEFORMAT_STUDY;
 
-  snprintf( filename, sizeof( filename ), "%s%cstudylist", path.c_str(), (int)CMTK_PATH_SEPARATOR );
-  if ( (!stat( filename, &buf )) && ( buf.st_mode & S_IFREG ) )
-    return FILEFORMAT_STUDYLIST;
-
-  snprintf( filename, sizeof( filename ), "%s%cstudylist.gz", path.c_str(), (int)CMTK_PATH_SEPARATOR );
-  if ( (!stat( filename, &buf )) && ( buf.st_mode & S_IFREG ) )
+  filename.replace( prefixLength, std::string::npos, "studylist" );
+  if ( (CompressedStream::Stat( filename, &cbuf ) > 0) && ( cbuf.st_mode & S_IFREG ) )
     return FILEFORMAT_STUDYLIST;
 
   return FILEFORMAT_UNKNOWN;
@@ -222,6 +273,36 @@ FileFormat::IdentifyDirectory( const std::string& path )
 FileFormatID 
 FileFormat::IdentifyFile( const std::string& path, const bool decompress )
 {
+  char buffer[348];
+  memset( buffer, 0, sizeof( buffer ) );
+
+  // Read the magic bytes directly if the file exists under the given path, and inflate only as much as needed
+  // for gzip-compressed files. Other compressed files are read via CompressedStream, which may involve an
+  // external decompression program.
+  FILE* file = fopen( path.c_str(), "rb" );
+  if ( file )
+    {
+    const size_t bytesRead = fread( buffer, 1, sizeof( buffer ), file );
+    fclose( file );
+
+    const bool gzipped = (bytesRead >= 2) && (static_cast<unsigned char>( buffer[0] ) == 0x1f) && (static_cast<unsigned char>( buffer[1] ) == 0x8b);
+    if ( ! gzipped )
+      return FileFormat::IdentifyMagic( buffer );
+
+    if ( ! decompress )
+      return FILEFORMAT_COMPRESSED_ARCHIVE;
+
+    gzFile gzfile = gzopen( path.c_str(), "rb" );
+    if ( ! gzfile )
+      return FILEFORMAT_NEXIST;
+
+    memset( buffer, 0, sizeof( buffer ) );
+    gzread( gzfile, buffer, sizeof( buffer ) );
+    gzclose( gzfile );
+
+    return FileFormat::IdentifyMagic( buffer );
+    }
+
   CompressedStream stream( path );
   if ( ! stream.IsValid() )
     return FILEFORMAT_NEXIST;
@@ -229,10 +310,27 @@ FileFormat::IdentifyFile( const std::string& path, const bool decompress )
   if ( stream.IsCompressed() && !decompress )
     return FILEFORMAT_COMPRESSED_ARCHIVE;
     
+  stream.Read( buffer, 1, 348 );
+
+  return FileFormat::IdentifyMagic( buffer );
+}
+
+FileFormatID 
+FileFormat::IdentifyMemory( const void* data, const size_t size )
+{
+  if ( ! data || ! size )
+    return FILEFORMAT_NEXIST;
+
   char buffer[348];
   memset( buffer, 0, sizeof( buffer ) );
-  stream.Read( buffer, 1, 348 );
-  
+  memcpy( buffer, data, std::min<size_t>( size, sizeof( buffer ) ) );
+
+  return FileFormat::IdentifyMagic( buffer );
+}
+
+FileFormatID 
+FileFormat::IdentifyMagic( const char* buffer )
+{
   FileFormatID id = FILEFORMAT_NEXIST; 
   while ( id != FILEFORMAT_UNKNOWN ) 
     {
@@ -280,6 +378,7 @@ FileFormat::IsXform( const FileFormatID& id )
     {
     case FILEFORMAT_STUDYLIST:
     case FILEFORMAT_TYPEDSTREAM:
+    case FILEFORMAT_XFORM_BINARY:
       return true;
     default:
       break;
@@ -35,7 +35,11 @@
 
 #include <cmtkconfig.h>
 
+#include <System/cmtkMutexLock.h>
+
+#include <map>
 #include <string>
+#include <utility>
 
 namespace 
 cmtk
@@ -86,6 +90,8 @@ typedef enum {
   FILEFORMAT_ANALYZE_HDR_BIGENDIAN = 18,
   /// Path is an ITK transformation file.
   FILEFORMAT_ITK_TFM = 19,
+  /// Path is a CMTK binary transformation file.
+  FILEFORMAT_XFORM_BINARY = 20,
   /** File type cannot be determined.
    * This ID always has to be the last one!
    */
@@ -100,13 +106,26 @@ extern const char* FileFormatName[];
 class FileFormat 
 {
 public:
+  /// This class.
+  typedef FileFormat Self;
+
   /** Identify file or directory with given path.
    * Compressed files as supported by CompressedStream are handled. If both
    * an uncompressed and a compressed file exist for the same path prefix, then
    * the uncompressed file has precedence.
+   *
+   * Results are cached by path, so identifying the same file or directory again
+   * costs a single stat() call as long as its modification time, size, and inode
+   * are unchanged.
    */
   static FileFormatID Identify( const std::string& path /*!< Image path. */, const bool decompress = true /*!< If set, compressed files are decompressed before determining their file type.*/ );
 
+  /** Identify file contents in memory.
+   * Compressed data is not decompressed, so the caller must do that before identifying the format.
+   *\return FILEFORMAT_NEXIST if the buffer is empty, otherwise the format identified by its magic number.
+   */
+  static FileFormatID IdentifyMemory( const void* data /*!< Pointer to the file contents. */, const size_t size /*!< Size of the file contents in bytes. */ );
+
   /** Return textual description of identified file format.
    */
   static std::string Describe( const FileFormatID id );
@@ -132,6 +151,36 @@ private:
   /** Identify regular file with given path.
    */
   static FileFormatID IdentifyFile( const std::string& path /*!< Image path. */, const bool decompress = true /*!< If set, compressed files are decompressed before determining their file type.*/ );
+
+  /** Identify file format from the magic numbers in the first 348 bytes of a file.
+   */
+  static FileFormatID IdentifyMagic( const char* buffer /*!< The first 348 bytes of the file, padded with zeros if the file is shorter. */ );
+
+  /// Cached identification result for one path.
+  class CacheEntry
+  {
+  public:
+    /// Modification time of the file or directory when it was identified.
+    long long int m_ModificationTime;
+
+    /// Size of the file or directory when it was identified.
+    long long int m_Size;
+
+    /// Inode of the file or directory when it was identified.
+    long long int m_Inode;
+
+    /// The identified format.
+    FileFormatID m_ID;
+  };
+
+  /// Type for the identification cache: maps path and "decompress" flag to identification results.
+  typedef std::map< std::pair<std::string,bool>, Self::CacheEntry > CacheType;
+
+  /// Identification cache.
+  static Self::CacheType m_Cache;
+
+  /// Lock for thread-safe access to the identification cache.
+  static MutexLock m_CacheLock;
 };
 
 //@}
@@ -0,0 +1,185 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkGroupwiseRegistrationArchive.h"
+
+#include <IO/cmtkClassStreamAffineXform.h>
+
+#include <System/cmtkConsole.h>
+#include <System/cmtkThreadPool.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+GroupwiseRegistrationArchive::GroupwiseRegistrationArchive( const std::string& path )
+  : m_Stream( path )
+{
+  if ( ! this->m_Stream.IsValid() )
+    return;
+
+  const int templateIdx = this->m_Stream.FindSection( "template" );
+  if ( (templateIdx < 0) || (this->m_Stream.EnterSection( templateIdx ) != TypedStream::CONDITION_OK) )
+    {
+    StdErr << "ERROR: no 'template' section in groupwise registration archive " << path << "\n";
+    return;
+    }
+
+  int dims[3];
+  UniformVolume::CoordinateVectorType size, origin;
+  if ( (this->m_Stream.ReadIntArray( "dims", dims, 3 ) != TypedStream::CONDITION_OK) ||
+       (this->m_Stream.ReadCoordinateArray( "size", size.begin(), 3 ) != TypedStream::CONDITION_OK) ||
+       (this->m_Stream.ReadCoordinateArray( "origin", origin.begin(), 3 ) != TypedStream::CONDITION_OK) )
+    {
+    StdErr << "ERROR: incomplete template grid in groupwise registration archive " << path << "\n";
+    return;
+    }
+  this->m_Stream.End();
+
+  UniformVolume::SmartPtr templateGrid( new UniformVolume( DataGrid::IndexType::FromPointer( dims ), size ) );
+  templateGrid->m_Offset = origin;
+
+  // each subject's target path is at the top level between the preceding section and the subject's
+  // transformation; only the sections are located here, their contents are left for GetXform to parse
+  const TypedStreamInput::SectionIndexType& sections = this->m_Stream.GetSectionIndex();
+  long subjectBegin = 0;
+  for ( size_t sectionIdx = 0; sectionIdx < sections.size(); ++sectionIdx )
+    {
+    if ( sections[sectionIdx].m_Parent != -1 )
+      continue;
+
+    const bool isWarp = (sections[sectionIdx].m_Name == "spline_warp");
+    if ( isWarp || (sections[sectionIdx].m_Name == "affine_xform") )
+      {
+      Subject subject;
+      if ( this->m_Stream.SeekKey( "target", subjectBegin, sections[sectionIdx].m_Offset ) == TypedStream::CONDITION_OK )
+	subject.m_Path = this->m_Stream.ReadStdString( "target", "", true /*forward*/ );
+      else
+	StdErr << "WARNING: no target path for subject " << this->m_Subjects.size() << " in groupwise registration archive " << path << "\n";
+      subject.m_SectionIdx = sectionIdx;
+      subject.m_IsWarp = isWarp;
+      subject.m_Loaded = false;
+      this->m_Subjects.push_back( subject );
+      }
+    subjectBegin = sections[sectionIdx].m_End;
+    }
+
+  this->m_TemplateGrid = templateGrid;
+}
+
+Xform::SmartConstPtr
+GroupwiseRegistrationArchive::GetXform( const size_t idx )
+{
+  if ( idx >= this->m_Subjects.size() )
+    {
+    StdErr << "ERROR: subject index " << idx << " out of range for groupwise registration archive with " << this->m_Subjects.size() << " subjects\n";
+    return Xform::SmartConstPtr::Null();
+    }
+
+  this->m_SubjectsLock.Lock();
+  const bool loaded = this->m_Subjects[idx].m_Loaded;
+  Xform::SmartConstPtr xform = this->m_Subjects[idx].m_Xform;
+  this->m_SubjectsLock.Unlock();
+
+  if ( loaded )
+    return xform;
+
+  // parse without holding the lock, so other subjects can be parsed at the same time
+  xform = this->ReadXform( idx );
+
+  this->m_SubjectsLock.Lock();
+  if ( ! this->m_Subjects[idx].m_Loaded )
+    {
+    this->m_Subjects[idx].m_Xform = xform;
+    this->m_Subjects[idx].m_Loaded = true;
+    }
+  xform = this->m_Subjects[idx].m_Xform;
+  this->m_SubjectsLock.Unlock();
+
+  return xform;
+}
+
+void
+GroupwiseRegistrationArchive::LoadAll()
+{
+  std::vector<Self::LoadThreadParameters> taskParameters;
+  this->m_SubjectsLock.Lock();
+  for ( size_t idx = 0; idx < this->m_Subjects.size(); ++idx )
+    {
+    if ( ! this->m_Subjects[idx].m_Loaded )
+      {
+      Self::LoadThreadParameters parameters;
+      parameters.thisObject = this;
+      parameters.m_Idx = idx;
+      taskParameters.push_back( parameters );
+      }
+    }
+  this->m_SubjectsLock.Unlock();
+
+  if ( ! taskParameters.empty() )
+    ThreadPool::GetGlobalThreadPool().Run( Self::LoadThread, taskParameters );
+}
+
+void
+GroupwiseRegistrationArchive::LoadThread( void *const args, const size_t, const size_t, const size_t, const size_t )
+{
+  Self::LoadThreadParameters* parameters = static_cast<Self::LoadThreadParameters*>( args );
+  parameters->thisObject->GetXform( parameters->m_Idx );
+}
+
+Xform::SmartConstPtr
+GroupwiseRegistrationArchive::ReadXform( const size_t idx ) const
+{
+  const Subject& subject = this->m_Subjects[idx];
+
+  // each thread reads through its own view of the section, while the text is shared with the archive
+  ClassStreamInput stream;
+  stream.Open( this->m_Stream, subject.m_SectionIdx );
+  if ( ! stream.IsValid() )
+    return Xform::SmartConstPtr::Null();
+
+  if ( subject.m_IsWarp )
+    {
+    WarpXform::SmartPtr warpXform;
+    stream >> warpXform;
+    return warpXform;
+    }
+
+  AffineXform::SmartPtr affineXform;
+  stream >> affineXform;
+  return affineXform;
+}
+
+} // namespace cmtk
@@ -0,0 +1,172 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#ifndef __cmtkGroupwiseRegistrationArchive_h_included_
+#define __cmtkGroupwiseRegistrationArchive_h_included_
+
+#include <cmtkconfig.h>
+
+#include <IO/cmtkClassStreamInput.h>
+
+#include <Base/cmtkXform.h>
+#include <Base/cmtkUniformVolume.h>
+
+#include <System/cmtkCannotBeCopied.h>
+#include <System/cmtkMutexLock.h>
+#include <System/cmtkSmartPtr.h>
+
+#include <string>
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+/** Read access to the per-subject transformations of a groupwise registration archive.
+ * The archive, as written by the groupwise registration tools, holds a "template" section with the
+ * template grid, followed by a "target" path and an "affine_xform" or "spline_warp" section for each subject.
+ * The archive is read and indexed once when it is opened, but the transformations are parsed only on demand,
+ * either one subject at a time or all subjects concurrently. The template grid is read once and is the common
+ * reference grid of all subjects; each subject's warp keeps its own control point grid.
+ */
+class GroupwiseRegistrationArchive :
+  /// Make class uncopyable via inheritance.
+  private CannotBeCopied
+{
+public:
+  /// This class.
+  typedef GroupwiseRegistrationArchive Self;
+
+  /// Smart pointer to this class.
+  typedef SmartPointer<Self> SmartPtr;
+
+  /// Smart pointer to constant object of this class.
+  typedef SmartConstPointer<Self> SmartConstPtr;
+
+  /// Constructor: open and index an archive.
+  GroupwiseRegistrationArchive( const std::string& path /*!< Path of the archive. */ );
+
+  /// Check whether the archive was opened and holds a template grid.
+  bool IsValid() const
+  {
+    return this->m_TemplateGrid;
+  }
+
+  /// Get the template grid, i.e., the common reference grid of all subjects.
+  UniformVolume::SmartConstPtr GetTemplateGrid() const
+  {
+    return this->m_TemplateGrid;
+  }
+
+  /// Get the number of subjects in the archive.
+  size_t GetNumberOfSubjects() const
+  {
+    return this->m_Subjects.size();
+  }
+
+  /** Get the image path of one subject; idx must be less than GetNumberOfSubjects().
+   *\return The subject's target path, or an empty string if the archive has none for this subject.
+   */
+  const std::string& GetSubjectPath( const size_t idx ) const
+  {
+    return this->m_Subjects[idx].m_Path;
+  }
+
+  /** Get the transformation of one subject.
+   * The transformation is parsed on first access and kept for later calls. This function can be called
+   * concurrently from several threads.
+   *\return The subject's transformation, or a NULL pointer if it could not be read or idx is not a valid subject index.
+   */
+  Xform::SmartConstPtr GetXform( const size_t idx );
+
+  /// Parse the transformations of all subjects that have not been accessed yet, in parallel.
+  void LoadAll();
+
+private:
+  /// Archive contents, which are shared with the views on the subject sections.
+  ClassStreamInput m_Stream;
+
+  /// Template grid.
+  UniformVolume::SmartConstPtr m_TemplateGrid;
+
+  /// One subject of the groupwise registration.
+  class Subject
+  {
+  public:
+    /// Path of the subject's image.
+    std::string m_Path;
+
+    /// Index of the subject's transformation section in the archive's section index.
+    int m_SectionIdx;
+
+    /// Whether the transformation section holds a spline warp rather than an affine transformation.
+    bool m_IsWarp;
+
+    /// Transformation, or a NULL pointer until it has been read.
+    Xform::SmartConstPtr m_Xform;
+
+    /// Whether reading the transformation has been attempted.
+    bool m_Loaded;
+  };
+
+  /// Subjects in the order in which they appear in the archive.
+  std::vector<Subject> m_Subjects;
+
+  /// Lock for the transformations of the subjects.
+  MutexLock m_SubjectsLock;
+
+  /// Parse the transformation of one subject from its section of the archive.
+  Xform::SmartConstPtr ReadXform( const size_t idx ) const;
+
+  /// Parameters for the parallel parsing of subject transformations.
+  class LoadThreadParameters
+  {
+  public:
+    /// This archive.
+    Self* thisObject;
+
+    /// Index of the subject to read.
+    size_t m_Idx;
+  };
+
+  /// Thread function to parse one subject's transformation.
+  static void LoadThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t threadIdx, const size_t threadCnt );
+};
+
+//@}
+
+} // namespace cmtk
+
+#endif // #ifndef __cmtkGroupwiseRegistrationArchive_h_included_
@@ -0,0 +1,109 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkNiftiHeader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+NiftiHeader::NiftiHeader( const void *const header )
+  : FileConstHeader( header, false )
+{
+  // the header size field tells us the byte order of the file
+  this->m_IsBigEndian = !this->IsValid();
+}
+
+void
+NiftiHeader::GetIndexToWorldMatrix( double (*matrix)[4] )
+{
+  float pixdim[8];
+  this->GetArray( pixdim, 76, 8 );
+
+  memset( matrix, 0, 3 * sizeof( *matrix ) );
+  if ( this->GetField<short>( 254 ) > 0 )
+    {
+    for ( int row = 0; row < 3; ++row )
+      {
+      float srow[4];
+      this->GetArray( srow, 280 + 16 * row, 4 );
+      for ( int col = 0; col < 4; ++col )
+	matrix[row][col] = srow[col];
+      }
+    }
+  else if ( this->GetField<short>( 252 ) > 0 )
+    {
+    const double b = this->GetField<float>( 256 );
+    const double c = this->GetField<float>( 260 );
+    const double d = this->GetField<float>( 264 );
+    const double a = sqrt( std::max<double>( 0.0, 1.0 - (b*b + c*c + d*d) ) );
+    const double qfac = (pixdim[0] < 0) ? -1.0 : 1.0;
+
+    const double rotation[3][3] = 
+      { { a*a+b*b-c*c-d*d, 2*(b*c-a*d), 2*(b*d+a*c) },
+	{ 2*(b*c+a*d), a*a+c*c-b*b-d*d, 2*(c*d-a*b) },
+	{ 2*(b*d-a*c), 2*(c*d+a*b), a*a+d*d-b*b-c*c } };
+    const double scale[3] = { pixdim[1], pixdim[2], qfac * pixdim[3] };
+    for ( int row = 0; row < 3; ++row )
+      {
+      for ( int col = 0; col < 3; ++col )
+	matrix[row][col] = rotation[row][col] * scale[col];
+      matrix[row][3] = this->GetField<float>( 268 + 4 * row );
+      }
+    }
+  else
+    {
+    for ( int dim = 0; dim < 3; ++dim )
+      matrix[dim][dim] = pixdim[1+dim];
+    }
+}
+
+void
+NiftiHeader::GetScaling( double& slope, double& inter )
+{
+  slope = this->GetField<float>( 112 );
+  inter = this->GetField<float>( 116 );
+  if ( (slope == 0) || !std::isfinite( slope ) || !std::isfinite( inter ) )
+    {
+    slope = 1;
+    inter = 0;
+    }
+}
+
+} // namespace cmtk
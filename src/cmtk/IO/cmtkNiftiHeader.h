@@ -0,0 +1,102 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#ifndef __cmtkNiftiHeader_h_included_
+#define __cmtkNiftiHeader_h_included_
+
+#include <cmtkconfig.h>
+
+#include <IO/cmtkFileConstHeader.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+/** Read-only access to the fields of a NIfTI-1 header.
+ * The byte order of the header is detected from its size field, which also holds for Analyze 7.5 headers.
+ */
+class NiftiHeader :
+  /// Inherit field access.
+  public FileConstHeader
+{
+public:
+  /// This class.
+  typedef NiftiHeader Self;
+
+  /// Size of the header in bytes.
+  static const size_t HeaderSize = 348;
+
+  /// Constructor.
+  NiftiHeader( const void *const header /*!< Pointer to at least HeaderSize bytes of header data. */ );
+
+  /// Check whether the header size field holds the correct value in either byte order.
+  bool IsValid()
+  {
+    return this->GetField<int>( 0 ) == static_cast<int>( Self::HeaderSize );
+  }
+
+  /// Check whether the header is stored in big endian byte order.
+  bool IsBigEndian() const
+  {
+    return this->m_IsBigEndian;
+  }
+
+  /// Check whether data values must be byte-swapped on this platform.
+  bool IsSwapped() const
+  {
+#ifdef WORDS_BIGENDIAN
+    return !this->m_IsBigEndian;
+#else
+    return this->m_IsBigEndian;
+#endif
+  }
+
+  /** Get matrix that maps voxel indexes to world coordinates.
+   * The matrix is taken from the sform if there is one, otherwise from the qform, otherwise from the pixel size.
+   */
+  void GetIndexToWorldMatrix( double (*matrix)[4] /*!< Matrix with 3 rows and 4 columns, the last of which is the translation. */ );
+
+  /** Get value scaling.
+   * A slope of zero or a non-finite slope or intercept means that values are not scaled; in this case,
+   * slope and intercept are returned as 1 and 0, respectively.
+   */
+  void GetScaling( double& slope, double& inter );
+};
+
+//@}
+
+} // namespace cmtk
+
+#endif // #ifndef __cmtkNiftiHeader_h_included_
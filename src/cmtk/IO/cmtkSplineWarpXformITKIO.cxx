@@ -0,0 +1,326 @@
+/*
+//
+//  Copyright 2009-2010, 2013 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkSplineWarpXformITKIO.h"
+
+#include <Base/cmtkAffineXform.h>
+#include <Base/cmtkAnatomicalOrientationBase.h>
+
+#include <System/cmtkConsole.h>
+
+#include <cmath>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+/// One transformation read from an ITK transform file.
+struct ITKTransform
+{
+  /// Transformation type, e.g., "AffineTransform_double_3_3".
+  std::string m_Type;
+
+  /// Transformation parameters.
+  std::vector<double> m_Parameters;
+
+  /// Fixed parameters, e.g., the center of an affine transformation or the grid of a B-spline transformation.
+  std::vector<double> m_FixedParameters;
+
+  /// Check whether this transformation is of a given class, regardless of its precision.
+  bool IsA( const char* className ) const
+  {
+    const size_t length = strlen( className );
+    return (this->m_Type.compare( 0, length, className ) == 0) && (this->m_Type.length() > length) && (this->m_Type[length] == '_');
+  }
+};
+
+/// Parse whitespace-separated numbers.
+void
+ParseValues( const char* text, std::vector<double>& values )
+{
+  char* end;
+  for ( double value = strtod( text, &end ); end != text; value = strtod( text, &end ) )
+    {
+    values.push_back( value );
+    text = end;
+    }
+}
+
+/** Get the 3x4 matrix of an ITK affine transformation.
+ * ITK transforms x to M(x-c)+c+t, with the matrix M and translation t as parameters and the center c as fixed parameters.
+ */
+bool
+GetAffineMatrix( const ITKTransform& transform, double (*matrix)[4] )
+{
+  if ( transform.m_Parameters.size() != 12 )
+    return false;
+
+  double center[3] = { 0, 0, 0 };
+  for ( size_t i = 0; (i < 3) && (i < transform.m_FixedParameters.size()); ++i )
+    center[i] = transform.m_FixedParameters[i];
+
+  for ( int i = 0; i < 3; ++i )
+    {
+    matrix[i][3] = transform.m_Parameters[9+i] + center[i];
+    for ( int j = 0; j < 3; ++j )
+      {
+      matrix[i][j] = transform.m_Parameters[3*i+j];
+      matrix[i][3] -= matrix[i][j] * center[j];
+      }
+    }
+  return true;
+}
+
+/// Apply 3x4 matrix to a point.
+void
+ApplyAffineMatrix( const double (*matrix)[4], const double* v, cmtk::Types::Coordinate* result )
+{
+  for ( int i = 0; i < 3; ++i )
+    result[i] = matrix[i][0] * v[0] + matrix[i][1] * v[1] + matrix[i][2] * v[2] + matrix[i][3];
+}
+} // namespace
+
+cmtk::Xform::SmartPtr
+cmtk::SplineWarpXformITKIO
+::Read( const std::string& filename )
+{
+  std::ifstream stream( filename.c_str() );
+  return Self::Read( stream );
+}
+
+cmtk::Xform::SmartPtr
+cmtk::SplineWarpXformITKIO
+::Read( std::istream& stream )
+{
+  std::string line;
+  std::getline( stream, line );
+  if ( line.compare( 0, 28, "#Insight Transform File V1.0" ) )
+    return Xform::SmartPtr( NULL );
+
+  // each transformation starts with its type, followed by its parameters and fixed parameters; comment lines are ignored
+  std::vector<ITKTransform> transforms;
+  while ( std::getline( stream, line ) )
+    {
+    if ( line.compare( 0, 11, "Transform: " ) == 0 )
+      {
+      transforms.push_back( ITKTransform() );
+      transforms.back().m_Type = line.substr( 11, line.find_last_not_of( " \t\r" ) - 10 );
+      }
+    else if ( !transforms.empty() && (line.compare( 0, 11, "Parameters:" ) == 0) )
+      {
+      ParseValues( line.c_str() + 11, transforms.back().m_Parameters );
+      }
+    else if ( !transforms.empty() && (line.compare( 0, 16, "FixedParameters:" ) == 0) )
+      {
+      ParseValues( line.c_str() + 16, transforms.back().m_FixedParameters );
+      }
+    }
+
+  // a composite transformation lists its components in the following entries; these are applied last to first
+  const bool composite = !transforms.empty() && transforms[0].IsA( "CompositeTransform" );
+  if ( composite )
+    transforms.erase( transforms.begin() );
+
+  // a legacy B-spline transformation may be followed by a bulk transformation, which is added to its displacements
+  const bool bulk = !composite && (transforms.size() == 2) && transforms[0].IsA( "BSplineDeformableTransform" );
+  if ( (transforms.size() > 1) && !composite && !bulk )
+    {
+    StdErr << "ERROR: ITK transformation file holds more than one transformation, but not as a composite transformation\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // combine all affine transformations applied after the B-spline, i.e., listed before it, into one matrix
+  double affine[3][4] = { {1,0,0,0}, {0,1,0,0}, {0,0,1,0} };
+  const ITKTransform* bspline = NULL;
+  for ( size_t idx = 0; idx < transforms.size(); ++idx )
+    {
+    const ITKTransform& transform = transforms[idx];
+    if ( transform.IsA( "BSplineTransform" ) || transform.IsA( "BSplineDeformableTransform" ) )
+      {
+      if ( bspline )
+	{
+	StdErr << "ERROR: ITK transformation file holds more than one B-spline transformation, which is not supported\n";
+	return Xform::SmartPtr( NULL );
+	}
+      bspline = &transform;
+      }
+    else if ( transform.IsA( "AffineTransform" ) || transform.IsA( "MatrixOffsetTransformBase" ) )
+      {
+      if ( bspline && !bulk )
+	{
+	StdErr << "ERROR: ITK composite transformation applies an affine transformation before a B-spline transformation, which is not supported\n";
+	return Xform::SmartPtr( NULL );
+	}
+
+      double matrix[3][4];
+      if ( !GetAffineMatrix( transform, matrix ) )
+	{
+	StdErr << "ERROR: ITK affine transformation has " << transform.m_Parameters.size() << " parameters rather than 12\n";
+	return Xform::SmartPtr( NULL );
+	}
+
+      double product[3][4];
+      for ( int i = 0; i < 3; ++i )
+	{
+	for ( int j = 0; j < 4; ++j )
+	  {
+	  product[i][j] = affine[i][0] * matrix[0][j] + affine[i][1] * matrix[1][j] + affine[i][2] * matrix[2][j] + ((j == 3) ? affine[i][3] : 0);
+	  }
+	}
+      memcpy( affine, product, sizeof( affine ) );
+      }
+    else
+      {
+      StdErr << "ERROR: ITK transformation type " << transform.m_Type << " is not supported\n";
+      return Xform::SmartPtr( NULL );
+      }
+    }
+
+  if ( transforms.empty() )
+    {
+    StdErr << "ERROR: ITK transformation file holds no transformation\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // CMTK stores affine matrices transposed, i.e., with the translation in the last row
+  Types::Coordinate matrix[4][4] = { {0,0,0,0}, {0,0,0,0}, {0,0,0,0}, {0,0,0,1} };
+  for ( int i = 0; i < 3; ++i )
+    {
+    for ( int j = 0; j < 4; ++j )
+      matrix[j][i] = affine[i][j];
+    }
+
+  AffineXform::SmartPtr affineXform;
+  try
+    {	
+    affineXform = AffineXform::SmartPtr( new AffineXform( matrix ) );
+    affineXform->SetMetaInfo( META_SPACE, AnatomicalOrientationBase::SPACE_ITK );
+    }
+  catch ( const AffineXform::MatrixType::SingularMatrixException& )
+    {
+    StdErr << "ERROR: singular matrix in cmtk::SplineWarpXformITKIO::Read()\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  if ( !bspline )
+    return affineXform;
+
+  // fixed parameters of a B-spline transformation are grid size, origin, spacing, and direction matrix (row by row)
+  const std::vector<double>& fixed = bspline->m_FixedParameters;
+  if ( fixed.size() != 18 )
+    {
+    StdErr << "ERROR: ITK B-spline transformation has " << fixed.size() << " fixed parameters rather than 18\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  SplineWarpXform::ControlPointIndexType dims;
+  SplineWarpXform::SpaceVectorType domain, offset;
+  Types::Coordinate spacing[3];
+  bool flip[3];
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    dims[dim] = static_cast<int>( fixed[dim] );
+    spacing[dim] = fixed[6+dim];
+    if ( (dims[dim] < 4) || (dims[dim] != fixed[dim]) || !(spacing[dim] > 0) )
+      {
+      StdErr << "ERROR: ITK B-spline transformation has invalid control point grid\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    const double direction = fixed[9+4*dim];
+    for ( int other = 0; other < 3; ++other )
+      {
+      if ( (other != dim) && (fabs( fixed[9+3*dim+other] ) > 1e-6) )
+	{
+	StdErr << "ERROR: ITK B-spline transformation grid is not aligned with the coordinate axes, which is not supported\n";
+	return Xform::SmartPtr( NULL );
+	}
+      }
+    if ( fabs( fabs( direction ) - 1 ) > 1e-6 )
+      {
+      StdErr << "ERROR: ITK B-spline transformation has invalid grid direction\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    // ITK control points are at origin + direction * index * spacing; a flipped axis is reversed so it runs in positive direction
+    flip[dim] = (direction < 0);
+    domain[dim] = spacing[dim] * (dims[dim] - 3);
+    offset[dim] = flip[dim] ? fixed[3+dim] - (dims[dim] - 1) * spacing[dim] : fixed[3+dim];
+    }
+
+  const size_t nControlPoints = static_cast<size_t>( dims[0] ) * dims[1] * dims[2];
+  if ( bspline->m_Parameters.size() != 3 * nControlPoints )
+    {
+    StdErr << "ERROR: ITK B-spline transformation has " << bspline->m_Parameters.size() << " parameters rather than " << 3 * nControlPoints << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // ITK stores the displacements of all control points for x, then for y, then for z; CMTK stores the transformed
+  // control point positions as (x,y,z) triples
+  CoordinateVector::SmartPtr parameters( new CoordinateVector( 3 * nControlPoints ) );
+  Types::Coordinate* coeff = parameters->Elements;
+  for ( int z = 0; z < dims[2]; ++z )
+    {
+    const size_t zITK = flip[2] ? dims[2]-1-z : z;
+    for ( int y = 0; y < dims[1]; ++y )
+      {
+      const size_t yITK = flip[1] ? dims[1]-1-y : y;
+      for ( int x = 0; x < dims[0]; ++x, coeff += 3 )
+	{
+	const size_t xITK = flip[0] ? dims[0]-1-x : x;
+	const size_t idxITK = xITK + dims[0] * (yITK + dims[1] * zITK);
+	
+	const double controlPoint[3] = { offset[0] + x * spacing[0], offset[1] + y * spacing[1], offset[2] + z * spacing[2] };
+	const double displacement[3] = 
+	  { bspline->m_Parameters[idxITK], bspline->m_Parameters[nControlPoints+idxITK], bspline->m_Parameters[2*nControlPoints+idxITK] };
+
+	if ( bulk )
+	  {
+	  ApplyAffineMatrix( affine, controlPoint, coeff );
+	  for ( int dim = 0; dim < 3; ++dim )
+	    coeff[dim] += displacement[dim];
+	  }
+	else
+	  {
+	  const double moved[3] = { controlPoint[0] + displacement[0], controlPoint[1] + displacement[1], controlPoint[2] + displacement[2] };
+	  ApplyAffineMatrix( affine, moved, coeff );
+	  }
+	}
+      }
+    }
+
+  SplineWarpXform::SmartPtr splineXform( new SplineWarpXform( domain, dims, parameters, affineXform ) );
+  splineXform->m_Offset = offset;
+  splineXform->SetMetaInfo( META_SPACE, AnatomicalOrientationBase::SPACE_ITK );
+  return splineXform;
+}
@@ -36,21 +36,41 @@
 #include <Base/cmtkSplineWarpXform.h>
 #include <Base/cmtkUniformVolume.h>
 
+#include <iostream>
 #include <string>
 
 namespace
 cmtk
 {
 
-/** Class for reading and writing affine transformations from and to ITK's file format.
- * This should also be understood by Slicer3 for transformation exchange with CMTK tools
- * run as plugins.
+/** Class for reading and writing spline warp transformations from and to ITK's file format.
+ * ITK B-spline transformations of order 3 are read into SplineWarpXform objects, with the control point grid
+ * origin, spacing, and direction mapped onto the grid of the spline warp. The grid direction must be aligned with
+ * the coordinate axes, but axes may be flipped.
+ *
+ * Composite transformations are supported if they consist of affine transformations and at most one B-spline
+ * transformation, with all affine transformations applied after the B-spline. These are combined into a single
+ * spline warp by transforming its control points, which is exact. A legacy B-spline transformation followed by a
+ * second, affine "bulk" transformation is read the same way, with the bulk transformation added to the B-spline
+ * displacements.
  */
 class SplineWarpXformITKIO
 {
 public:
+  /// This class.
+  typedef SplineWarpXformITKIO Self;
+
   /// Write transformation to ITK file.
   static void Write( const std::string& filename, const SplineWarpXform& xform, const UniformVolume& refVolume, const UniformVolume& fltVolume );
+
+  /** Read transformation from ITK file.
+   *\return A spline warp if the file holds a B-spline transformation, an affine transformation if it holds only
+   * affine transformations, or a NULL pointer if the file cannot be read or holds unsupported transformations.
+   */
+  static Xform::SmartPtr Read( const std::string& filename );
+
+  /// Read transformation from open stream, e.g., a string stream holding the contents of an ITK file.
+  static Xform::SmartPtr Read( std::istream& stream );
 };
 
 } // namespace cmtk
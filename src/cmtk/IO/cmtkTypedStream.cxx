@@ -174,7 +174,7 @@ TypedStream
 {
   if ( this->m_DebugFlag != Self::DEBUG_ON ) return;
 
-  static char buffer[1024];
+  char buffer[1024];
 
   va_list args;
   va_start(args, format);
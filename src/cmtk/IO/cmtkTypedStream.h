@@ -165,10 +165,13 @@ public:
   /// Default constructor.
   TypedStream();
 
+  /// Virtual destructor.
+  virtual ~TypedStream() {}
+
   /** Return validity of archive.
    *\return 1 if an archive is currently open, 0 if not.
    */
-  int IsValid() 
+  virtual int IsValid() 
   {
     return (this->File != NULL) || (this->GzFile != NULL); 
   }
@@ -205,6 +208,7 @@ protected:
    * native resolution is lost. This field determines, how many significant
    * digits are preserved when converting single precision float numbers to
    * strings.
+   * Arrays are always written with full precision.
    */
   int PrecisionFloat;
 
@@ -213,6 +217,7 @@ protected:
    * native resolution is lost. This field determines, how many significant
    * digits are preserved when converting double precision float numbers to
    * strings.
+   * Arrays are always written with full precision.
    */
   int PrecisionDouble;
 
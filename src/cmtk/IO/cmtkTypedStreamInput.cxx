@@ -34,31 +34,86 @@
 
 #include <System/cmtkFileUtils.h>
 #include <System/cmtkConsole.h>
+#include <System/cmtkCompressedStream.h>
 
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
 
+#include <algorithm>
+
 #ifdef HAVE_MALLOC_H
 #  include <malloc.h>
 #endif
 
+namespace
+{
+
+/** Split a string into tokens separated by spaces, tabs, and newlines.
+ * This works like strtok(), but keeps its state in the "next" parameter rather than in static storage,
+ * so different archives can be read concurrently.
+ */
+char*
+SplitToken( char* str, char*& next )
+{
+  char* token = str ? str : next;
+  if ( ! token )
+    return NULL;
+
+  token += strspn( token, "\t\n " );
+  if ( ! *token )
+    {
+    next = NULL;
+    return NULL;
+    }
+
+  char* end = token + strcspn( token, "\t\n " );
+  if ( *end )
+    {
+    *end = '\0';
+    next = end + 1;
+    }
+  else
+    {
+    next = NULL;
+    }
+
+  return token;
+}
+
+} // anonymous namespace
+
 namespace
 cmtk
 {
 
 TypedStreamInput::TypedStreamInput
 ( const std::string& filename )
+  : m_Text( NULL ),
+    m_TextSize( 0 ),
+    m_Position( 0 )
 {
   this->Open( filename );
 }
 
 TypedStreamInput::TypedStreamInput
 ( const std::string& dir, const std::string& archive )
+  : m_Text( NULL ),
+    m_TextSize( 0 ),
+    m_Position( 0 )
 {
   this->Open( dir, archive );
 }
 
+TypedStreamInput::TypedStreamInput
+( const void* data, const size_t size )
+  : m_Text( NULL ),
+    m_TextSize( 0 ),
+    m_Position( 0 )
+{
+  this->Open( data, size );
+}
+
 TypedStreamInput
 ::~TypedStreamInput()
 {
@@ -70,22 +125,11 @@ TypedStreamInput
 ::Open
 ( const std::string& dir, const std::string& archive )
 {
-  static char fname[PATH_MAX];
-  
   // If "dir" parameter is empty, use current directory instead.
+  std::string fname = archive;
   if ( dir != "" ) 
     {
-    if ( static_cast<size_t>( snprintf( fname, sizeof( fname ), "%s%c%s", dir.c_str(), CMTK_PATH_SEPARATOR, archive.c_str() ) ) >= sizeof( fname ) )
-      {
-      StdErr << "WARNING: length of path exceeds system PATH_MAX in TypedStreamInput::Open and will be truncated.\n";
-      }
-    } 
-  else 
-    {
-    if ( static_cast<size_t>( snprintf( fname, sizeof( fname ), "%s", archive.c_str() ) ) >= sizeof( fname ) )
-      {
-      StdErr << "WARNING: length of path exceeds system PATH_MAX in TypedStreamInput::Open and will be truncated.\n";
-      }
+    fname = dir + CMTK_PATH_SEPARATOR + archive;
     }
   
   this->Open( fname );
@@ -99,133 +143,339 @@ TypedStreamInput
   this->m_Status = Self::ERROR_NONE;
   this->Close();
   
+  // Uncompressed archives are memory-mapped where possible and parsed in place; the mapping is followed by
+  // a NULL character just like the archive contents read into memory. Only existing files without a compression
+  // suffix are tried, so that opening a compressed archive does not set up a decompressing reader only to discard it.
+  if ( (CompressedStream::GetBaseName( filename ) == filename) && (CompressedStream::Stat( filename ) == 0) &&
+       this->m_MappedFile.Open( filename ) && this->m_MappedFile.GetData() )
+    {
+    this->m_Text = this->m_MappedFile.GetData();
+    this->m_TextSize = this->m_MappedFile.GetDataSize();
+    this->ParseContents();
+    return;
+    }
+  this->m_MappedFile.Close();
+
   // Use text mode for fopen so that \r\n is translated to \n on Windows
   // (TypedStream files may have CRLF from git checkout with autocrlf).
-  // Use binary mode for gzopen since .gz files must be read as raw bytes.
-  if ( ! ( File = fopen( filename.c_str(), "r" ) ) )
+  bool readError = false;
+  FILE* file = fopen( filename.c_str(), "r" );
+  if ( file )
     {
-    const std::string gzName = filename + ".gz";
-    GzFile = gzopen( gzName.c_str(), "rb" );
-    if ( ! GzFile ) 
+    // Read the complete archive into memory. All later seeks, including those back to the beginning
+    // of a section, are then simple position changes rather than re-reads of the file.
+    size_t size = 0;
+    while ( ! feof( file ) && ! ferror( file ) )
       {
-      StdErr << "ERROR: could not open file \"" << filename << "\"\n";
-      this->m_Status = Self::ERROR_SYSTEM;
-      return;
+      this->m_Data.resize( size + Self::LIMIT_READ_CHUNK );
+      size += fread( &this->m_Data[size], 1, Self::LIMIT_READ_CHUNK, file );
       }
+    readError = (ferror( file ) != 0);
+    fclose( file );
+    this->m_Data.resize( size );
     }
-  
-  if ( GzFile ) 
+  else
     {
-    if (! gzgets( GzFile, Buffer, sizeof( this->Buffer ) ) ) 
+    // Inflate a gzip-compressed archive in a single call if possible. Anything else, e.g., other
+    // compression formats such as zstd, or a ".gz" file that is not actually compressed, is read
+    // completely through CompressedStream, which picks the reader engine for the file's suffix.
+    if ( ! this->InflateFile( filename + ".gz" ) )
       {
-      this->m_Status = Self::ERROR_FORMAT;
-      gzclose( GzFile );
-      return;
+      CompressedStream stream( filename );
+      if ( ! stream.IsValid() )
+	{
+	StdErr << "ERROR: could not open file \"" << filename << "\"\n";
+	this->m_Status = Self::ERROR_SYSTEM;
+	return;
+	}
+      
+      size_t size = 0;
+      while ( true )
+	{
+	this->m_Data.resize( size + Self::LIMIT_READ_CHUNK );
+	const size_t got = stream.Read( &this->m_Data[size], 1, Self::LIMIT_READ_CHUNK );
+	size += got;
+	if ( got < Self::LIMIT_READ_CHUNK )
+	  break;
+	}
+      this->m_Data.resize( size );
       }
-    } 
-  else
-    if (! fgets( Buffer, sizeof( this->Buffer) , File ) ) 
+    }
+  this->m_Data.push_back( '\0' );
+
+  if ( readError )
+    {
+    StdErr << "ERROR: could not read file \"" << filename << "\"\n";
+    this->Close();
+    this->m_Status = Self::ERROR_SYSTEM;
+    return;
+    }
+
+  this->m_Text = &this->m_Data[0];
+  this->m_TextSize = this->m_Data.size() - 1;
+  this->ParseContents();
+}
+
+void 
+TypedStreamInput
+::Open
+( const void* data, const size_t size )
+{
+  this->m_Status = Self::ERROR_NONE;
+  this->Close();
+
+  // Compressed buffers are recognized by the gzip magic number; anything else is taken as archive text.
+  const unsigned char* bytes = static_cast<const unsigned char*>( data );
+  if ( (size >= 2) && (bytes[0] == 0x1f) && (bytes[1] == 0x8b) )
+    {
+    if ( ! CompressedStream::InflateGzip( data, size, this->m_Data ) )
       {
+      StdErr << "ERROR: could not decompress archive in memory\n";
+      this->Close();
       this->m_Status = Self::ERROR_FORMAT;
-      fclose( File );
-      File = NULL;
       return;
       }
-  
-  if (Buffer[0] != '!' && Buffer[0] != '#') 
+    }
+  else
     {
+    this->m_Data.assign( static_cast<const char*>( data ), static_cast<const char*>( data ) + size );
+    }
+  this->m_Data.push_back( '\0' );
+
+  this->m_Text = &this->m_Data[0];
+  this->m_TextSize = this->m_Data.size() - 1;
+  this->ParseContents();
+}
+
+void 
+TypedStreamInput
+::Open
+( const Self& archive, const int sectionIdx )
+{
+  this->m_Status = Self::ERROR_NONE;
+  this->Close();
+
+  if ( ! archive.m_Text || (sectionIdx < 0) || (sectionIdx >= static_cast<int>( archive.m_SectionIndex.size() )) )
+    {
+    this->m_Status = Self::ERROR_ARG;
+    return;
+    }
+
+  // the section's text starts with the line that opens it, which ends right before the section's first line
+  const Self::SectionIndexEntry& section = archive.m_SectionIndex[sectionIdx];
+  size_t begin = section.m_Offset - 1;
+  while ( (begin > 0) && (archive.m_Text[begin-1] != '\n') )
+    --begin;
+
+  // there is no archive header, so the version is that of the other archive
+  this->m_Text = archive.m_Text + begin;
+  this->m_TextSize = section.m_End - begin;
+  this->m_ReleaseMajor = archive.m_ReleaseMajor;
+  this->m_ReleaseMinor = archive.m_ReleaseMinor;
+  this->BuildIndex();
+}
+
+void
+TypedStreamInput
+::ParseContents()
+{
+  if ( ! this->ReadLine() || (Buffer[0] != '!' && Buffer[0] != '#') ) 
+    {
+    this->Close();
     this->m_Status = Self::ERROR_FORMAT;
-    if ( GzFile )
-      {
-      gzclose( GzFile );
-      GzFile = NULL;
-      }
-    
-    if ( File )
-      {
-      fclose( File );
-      File = NULL;
-      }
     return;
     }
+
   if (2 != sscanf( Buffer+1, " TYPEDSTREAM %4d.%4d", &this->m_ReleaseMajor, &this->m_ReleaseMinor)) 
     {
+    this->Close();
     this->m_Status = Self::ERROR_FORMAT;
-    if ( GzFile )
-      {
-      gzclose( GzFile );
-      GzFile = NULL;
-      }
-    
-    if ( File )
-      {
-      fclose( File );
-      File = NULL;
-      }
+    return;
     }
-  else
+
+  if ( (this->m_ReleaseMajor > CMTK_VERSION_MAJOR) || ( (this->m_ReleaseMajor == CMTK_VERSION_MAJOR) && (this->m_ReleaseMinor > CMTK_VERSION_MINOR)) )
     {
-    if ( (this->m_ReleaseMajor > CMTK_VERSION_MAJOR) || ( (this->m_ReleaseMajor == CMTK_VERSION_MAJOR) && (this->m_ReleaseMinor > CMTK_VERSION_MINOR)) )
-      {
-      StdErr << "WARNING: input archive was written by newer version of CMTK (" << this->m_ReleaseMajor << "." << this->m_ReleaseMinor << " or higher) - proceed with caution.\n";
-      }
+    StdErr << "WARNING: input archive was written by newer version of CMTK (" << this->m_ReleaseMajor << "." << this->m_ReleaseMinor << " or higher) - proceed with caution.\n";
     }
+
+  this->BuildIndex();
+}
+
+bool
+TypedStreamInput
+::InflateFile( const std::string& path )
+{
+  FILE* file = fopen( path.c_str(), "rb" );
+  if ( ! file )
+    return false;
+
+  std::vector<char> compressed;
+  size_t size = 0;
+  while ( ! feof( file ) && ! ferror( file ) )
+    {
+    compressed.resize( size + Self::LIMIT_READ_CHUNK );
+    size += fread( &compressed[size], 1, Self::LIMIT_READ_CHUNK, file );
+    }
+  const bool readError = (ferror( file ) != 0);
+  fclose( file );
+
+  return ! readError && CompressedStream::InflateGzip( &compressed[0], size, this->m_Data );
 }
 
 void
 TypedStreamInput
 ::Close()
 {
-  if ( File || GzFile )
+  while ( ! LevelStack.empty() ) 
     {
-    while ( ! LevelStack.empty() ) 
+    LevelStack.pop();      
+    }
+  
+  // swap rather than clear so that the memory is actually released
+  std::vector<char>().swap( this->m_Data );
+  this->m_MappedFile.Close();
+  this->m_Text = NULL;
+  this->m_TextSize = 0;
+  this->m_Position = 0;
+
+  this->m_SectionIndex.clear();
+  this->m_KeyIndex.clear();
+  
+  this->m_Status = Self::ERROR_NONE;
+  SplitPosition = NULL;
+}
+
+void
+TypedStreamInput
+::Reset()
+{
+  while ( ! LevelStack.empty() ) 
+    {
+    LevelStack.pop();      
+    }
+
+  this->m_Position = 0;
+  this->m_Status = Self::ERROR_NONE;
+  SplitPosition = NULL;
+}
+
+void
+TypedStreamInput
+::BuildIndex()
+{
+  std::stack<int> openSections;
+  
+  this->m_Position = 0;
+  while ( this->m_Position < this->GetDataSize() )
+    {
+    const size_t lineStart = this->m_Position;
+    const size_t lineLength = this->GetLineLength( lineStart );
+    
+    // Value and comment lines, which make up almost all of a large archive, are not indexed, so skip
+    // them without copying. Everything else goes through the regular tokenizer.
+    const char* line = this->m_Text + lineStart;
+    size_t skip = 0;
+    while ( (skip < lineLength) && ((line[skip] == ' ') || (line[skip] == '\t')) )
+      ++skip;
+    
+    const char first = (skip < lineLength) ? line[skip] : '\0';
+    if ( (first == '\n') || (first == '!') || (first == '#') || (first == '\"') || (first == '-') || (first == '.') || ((first >= '0') && (first <= '9')) )
       {
-      LevelStack.pop();      
+      this->m_Position += lineLength;
+      continue;
       }
     
-    if ( GzFile ) 
+    switch ( this->ReadLineToken() )
+      {
+      case Self::TOKEN_BEGIN:
       {
-      gzclose( GzFile );
-      GzFile = NULL;
+      Self::SectionIndexEntry entry;
+      entry.m_Name = Self::GetKeyName( BufferKey );
+      entry.m_Parent = openSections.empty() ? -1 : openSections.top();
+      entry.m_Offset = this->m_Position;
+      entry.m_End = this->GetDataSize();
+      
+      openSections.push( this->m_SectionIndex.size() );
+      this->m_SectionIndex.push_back( entry );
+      break;
       }
-    if ( File ) 
+      case Self::TOKEN_END:
+	if ( ! openSections.empty() )
+	  {
+	  this->m_SectionIndex[openSections.top()].m_End = this->m_Position;
+	  openSections.pop();
+	  }
+	break;
+      case Self::TOKEN_KEY:
       {
-      fclose( File );
-      File = NULL;
+      Self::KeyIndexEntry entry;
+      entry.m_Key = Self::GetKeyName( BufferKey );
+      entry.m_Section = openSections.empty() ? -1 : openSections.top();
+      entry.m_Offset = lineStart;
+
+      this->m_KeyIndex.push_back( entry );
+      break;
+      }
+      default:
+	break;
       }
     }
   
-  this->m_Status = Self::ERROR_NONE;
-  SplitPosition = NULL;
+  // group key lines by section, keeping file order within each section
+  std::stable_sort( this->m_KeyIndex.begin(), this->m_KeyIndex.end(), Self::KeyIndexEntry::CompareSection );
+  
+  this->m_Position = 0;
+}
+
+std::string
+TypedStreamInput
+::GetKeyName( const char* key )
+{
+  const char* keyEnd = key;
+  while ( *keyEnd && (*keyEnd != ' ') && (*keyEnd != '\t') && (*keyEnd != '\n') )
+    ++keyEnd;
+
+  return std::string( key, keyEnd - key );
+}
+
+int
+TypedStreamInput
+::GetOpenSection() const
+{
+  if ( LevelStack.empty() )
+    return -1;
+
+  // sections are indexed in the order in which they begin, so their offsets are sorted
+  Self::SectionIndexEntry probe;
+  probe.m_Offset = LevelStack.top();
+  Self::SectionIndexType::const_iterator it = std::lower_bound( this->m_SectionIndex.begin(), this->m_SectionIndex.end(), probe, Self::SectionIndexEntry::CompareOffset );
+  if ( (it != this->m_SectionIndex.end()) && (it->m_Offset == probe.m_Offset) )
+    return it - this->m_SectionIndex.begin();
+
+  return -1;
+}
+
+size_t
+TypedStreamInput
+::GetSectionEnd( const int sectionIdx ) const
+{
+  if ( sectionIdx < 0 )
+    return this->GetDataSize();
+
+  return this->m_SectionIndex[sectionIdx].m_End;
 }
 
 TypedStreamInput::Condition 
 TypedStreamInput
 ::Begin()
 {
-  if ( !File && !GzFile)
+  if ( ! this->IsValid() )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
     }
 
-  if ( GzFile )
-    {
-    if ( -1 == gzseek( GzFile, LevelStack.top(), SEEK_SET ) )
-      {
-      this->m_Status = Self::ERROR_SYSTEM;
-      return Self::CONDITION_ERROR;
-      }
-    }
-  else
-    {
-    if ( fseek( File, LevelStack.top(), SEEK_SET ) )
-      {
-      this->m_Status = Self::ERROR_SYSTEM;
-      return Self::CONDITION_ERROR;
-      }
-    }
-
+  this->m_Position = LevelStack.empty() ? 0 : LevelStack.top();
   return Self::CONDITION_OK;
 }
 
@@ -233,7 +483,7 @@ TypedStreamInput::Condition
 TypedStreamInput
 ::End()
 {
-  if ( ! File && ! GzFile )
+  if ( ! this->IsValid() )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
@@ -246,34 +496,65 @@ TypedStreamInput
     return Self::CONDITION_ERROR;
     }
   
-  Self::Token token;
-  int currentLevel = 1;
-  while ( currentLevel && (Self::TOKEN_EOF != ( token = this->ReadLineToken() ) ) ) 
-    {
-    if ( token == Self::TOKEN_BEGIN ) 
-      {
-      this->DebugOutput( "Skipping section %s at level %d.", BufferKey, currentLevel );
-      ++currentLevel;
-      }
-    else
-      if ( token == Self::TOKEN_END ) 
-	{
-	this->DebugOutput( "Leaving section %d.", currentLevel );
-	--currentLevel;
-	}
-      }
-  
+  this->DebugOutput( "Leaving section at level %d.", static_cast<int>( LevelStack.size() ) );
+  this->m_Position = this->GetSectionEnd( this->GetOpenSection() );
   LevelStack.pop();
   
   return Self::CONDITION_OK;
 }
+
+const TypedStreamInput::SectionIndexType&
+TypedStreamInput
+::GetSectionIndex() const
+{
+  return this->m_SectionIndex;
+}
+
+int
+TypedStreamInput
+::FindSection( const char* section, const int parent ) const
+{
+  for ( size_t idx = 0; idx < this->m_SectionIndex.size(); ++idx )
+    {
+    if ( (this->m_SectionIndex[idx].m_Parent == parent) && (this->StringCmp( this->m_SectionIndex[idx].m_Name.c_str(), section ) == 0) )
+      return idx;
+    }
+  
+  return -1;
+}
+
+TypedStreamInput::Condition
+TypedStreamInput
+::EnterSection( const int sectionIdx )
+{
+  if ( (sectionIdx < 0) || (sectionIdx >= static_cast<int>( this->m_SectionIndex.size() )) )
+    {
+    this->m_Status = Self::ERROR_ARG;
+    return Self::CONDITION_ERROR;
+    }
+
+  // collect the section and all enclosing sections, innermost first
+  std::vector<int> path;
+  for ( int idx = sectionIdx; idx >= 0; idx = this->m_SectionIndex[idx].m_Parent )
+    path.push_back( idx );
+
+  while ( ! LevelStack.empty() ) 
+    {
+    LevelStack.pop();      
+    }
   
+  for ( std::vector<int>::const_reverse_iterator it = path.rbegin(); it != path.rend(); ++it )
+    LevelStack.push( this->m_SectionIndex[*it].m_Offset );
+
+  return this->Begin();
+}
+
 TypedStreamInput::Condition
 TypedStreamInput
 ::Seek
 ( const char* section, const bool forward )
 {
-  if ( ! File && ! GzFile )
+  if ( ! this->IsValid() )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
@@ -285,97 +566,73 @@ TypedStreamInput
     return Self::CONDITION_ERROR;
     }
 
-  unsigned initialLevel = LevelStack.size();
+  const size_t from = forward ? this->m_Position : (LevelStack.empty() ? 0 : LevelStack.top());
   
-  if ( ! forward )
+  // The section is found if it is directly inside the open section, or if it follows the open
+  // section inside the same parent.
+  const int openSection = this->GetOpenSection();
+  const int parentSection = (openSection < 0) ? -1 : this->m_SectionIndex[openSection].m_Parent;
+
+  this->DebugOutput( "Seeking section %s from level %d.", section, static_cast<int>( LevelStack.size() ) );
+  for ( size_t idx = 0; idx < this->m_SectionIndex.size(); ++idx )
     {
-    if ( GzFile ) 
+    const Self::SectionIndexEntry& entry = this->m_SectionIndex[idx];
+    if ( entry.m_Offset <= static_cast<long>( from ) )
+      continue;
+    
+    const bool inside = (entry.m_Parent == openSection);
+    const bool following = (openSection >= 0) && (entry.m_Parent == parentSection);
+    if ( (inside || following) && (this->StringCmp( entry.m_Name.c_str(), section ) == 0) ) 
       {
-      if ( initialLevel ) 
-	{
-	if ( -1 == gzseek( GzFile, LevelStack.top(), SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	} 
-      else 
-	{
-	if ( -1 == gzseek( GzFile, 0, SEEK_SET) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}
-      } 
-    else
-      if ( initialLevel ) 
-	{
-	if ( fseek( File, LevelStack.top(), SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	} 
-      else 
-	{
-	if ( fseek( File, 0, SEEK_SET) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}
-    }
+      if ( following )
+	LevelStack.pop();
+      LevelStack.push( entry.m_Offset );
 
-  unsigned currentLevel = initialLevel;
+      this->m_Position = entry.m_Offset;
+      return Self::CONDITION_OK;
+      }
+    }
   
-  this->DebugOutput( "Seeking section %s from level %d.", section, initialLevel );
-  Self::Token token;
-  while ( Self::TOKEN_EOF != ( token = this->ReadLineToken() ) ) 
+  // leave the stream where a scan for the section would have stopped: at the end of the parent section
+  this->m_Position = this->GetSectionEnd( parentSection );
+
+  this->DebugOutput( "Section %s not found.", section );
+  this->m_Status = Self::ERROR_NONE;
+  return Self::CONDITION_ERROR;
+}
+
+TypedStreamInput::Condition
+TypedStreamInput
+::SeekKey
+( const char* key, const long from, const long to )
+{
+  if ( ! this->IsValid() )
     {
-    if ( token == Self::TOKEN_BEGIN ) 
+    this->m_Status = Self::ERROR_INVALID;
+    return Self::CONDITION_ERROR;
+    }
+
+  if ( ! key ) 
+    {
+    this->m_Status = Self::ERROR_ARG;
+    return Self::CONDITION_ERROR;
+    }
+
+  // key lines are indexed by section, and in file order within each section
+  const int openSection = this->GetOpenSection();
+
+  Self::KeyIndexEntry probe;
+  probe.m_Section = openSection;
+  Self::KeyIndexType::const_iterator it = std::lower_bound( this->m_KeyIndex.begin(), this->m_KeyIndex.end(), probe, Self::KeyIndexEntry::CompareSection );
+  for ( ; (it != this->m_KeyIndex.end()) && (it->m_Section == openSection) && (it->m_Offset < to); ++it )
+    {
+    if ( (it->m_Offset >= from) && (this->StringCmp( it->m_Key.c_str(), key ) == 0) )
       {
-      this->DebugOutput( "Enter section %s at level %d.", BufferKey, currentLevel );
-      if ( this->StringCmp( BufferKey, section ) == 0 ) 
-	{
-	if ( currentLevel == LevelStack.size() ) 
-	  {
-	  if ( GzFile )
-	    LevelStack.push( gztell( GzFile ) );
-	  else
-	    LevelStack.push( ftell( File ) );
-	  return Self::CONDITION_OK;
-	  }
-	if ( currentLevel == LevelStack.size()-1 ) 
-	  {
-	  LevelStack.pop();
-	  if ( GzFile )
-	    LevelStack.push( gztell( GzFile ) );
-	  else
-	    LevelStack.push( ftell( File ) );
-	  return Self::CONDITION_OK;
-	  }
-	}
-      ++ currentLevel;
-      }
-    if ( token == Self::TOKEN_END ) 
-      {
-      this->DebugOutput( "Leaving section %d.", currentLevel );
-      if ( ! currentLevel ) 
-	{
-	this->m_Status = Self::ERROR_LEVEL;
-	return Self::CONDITION_ERROR;
-	}
-      if ( currentLevel < initialLevel ) 
-	{
-	this->m_Status = Self::ERROR_NONE;
-	return Self::CONDITION_ERROR;
-	}
-      -- currentLevel;
+      this->m_Position = it->m_Offset;
+      return Self::CONDITION_OK;
       }
     }
-  
-  this->DebugOutput( "Section %s not found.", section );
+
   this->m_Status = Self::ERROR_NONE;
   return Self::CONDITION_ERROR;
 }
@@ -384,7 +641,7 @@ TypedStreamInput::Condition
 TypedStreamInput
 ::Rewind()
 {
-  if ( ! File && ! GzFile )
+  if ( ! this->IsValid() )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
@@ -393,40 +650,7 @@ TypedStreamInput
   if ( !LevelStack.empty() )
     LevelStack.pop();
   
-  if ( LevelStack.empty() ) 
-    {
-    if ( GzFile ) 
-      {
-      if ( -1 == gzseek( GzFile, 0, SEEK_SET ) ) 
-	{
-	this->m_Status = Self::ERROR_SYSTEM;
-	return Self::CONDITION_ERROR;
-	}
-      } 
-    else
-      if ( -1 == fseek( File, 0, SEEK_SET ) )
-	{
-	this->m_Status = Self::ERROR_SYSTEM;
-	return Self::CONDITION_ERROR;
-	}
-    } 
-  else 
-    {
-    if ( GzFile ) 
-      {
-      if (-1 == gzseek( GzFile, LevelStack.top(), SEEK_SET)) 
-	{
-	this->m_Status = Self::ERROR_SYSTEM;
-	return Self::CONDITION_ERROR;
-	}
-      }
-    else
-      if (-1 == fseek( File, LevelStack.top(), SEEK_SET)) 
-	{
-	this->m_Status = Self::ERROR_SYSTEM;
-	return Self::CONDITION_ERROR;
-	}
-    }
+  this->m_Position = LevelStack.empty() ? 0 : LevelStack.top();
   return Self::CONDITION_OK;
 }
 
@@ -543,51 +767,40 @@ TypedStreamInput
     return Self::CONDITION_ERROR;
     }
   
+  if ( ! this->IsValid() )
+    {
+    this->m_Status = Self::ERROR_INVALID;
+    return Self::CONDITION_ERROR;
+    }
+  
   unsigned currentLevel = LevelStack.size();
   if ( ! forward ) 
     {
-    if ( GzFile ) 
+    // go straight to the first line with this key in the open section
+    const int openSection = this->GetOpenSection();
+
+    Self::KeyIndexEntry probe;
+    probe.m_Section = openSection;
+    Self::KeyIndexType::const_iterator it = std::lower_bound( this->m_KeyIndex.begin(), this->m_KeyIndex.end(), probe, Self::KeyIndexEntry::CompareSection );
+    for ( ; (it != this->m_KeyIndex.end()) && (it->m_Section == openSection); ++it )
       {
-      if ( currentLevel )
-	{
-	if ( -1 == gzseek( GzFile, LevelStack.top(), SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}
-      else
-	{
-	if ( -1 == gzseek( GzFile, 0, SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}	  
+      if ( this->StringCmp( it->m_Key.c_str(), key ) == 0 )
+	break;
       }
-    else
+
+    if ( (it == this->m_KeyIndex.end()) || (it->m_Section != openSection) )
       {
-      if ( currentLevel )
-	{
-	if ( fseek( File, LevelStack.top(), SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}
-      else
-	{
-	if ( fseek( File, 0, SEEK_SET ) )
-	  {
-	  this->m_Status = Self::ERROR_SYSTEM;
-	  return Self::CONDITION_ERROR;
-	  }
-	}
+      this->m_Position = this->GetSectionEnd( openSection );
+      this->m_Status = Self::ERROR_NONE;
+      return Self::CONDITION_ERROR;
       }
+
+    this->m_Position = it->m_Offset;
     }
   
   int line;
   char *buffer;
+  char *nextToken = NULL;
   while ( Self::TOKEN_EOF != ( line = this->ReadLineToken() ) ) 
     {
     if ( line == Self::TOKEN_KEY) 
@@ -598,31 +811,9 @@ TypedStreamInput
 	switch (type) 
 	  {
 	  case Self::TYPE_INT: 
-	  {
-	  int *arrayInt = static_cast<int*>( array ); 
-	  do
-	    {
-	    buffer = strtok( BufferValue, "\t\n " );
-	    while ( buffer ) 
-	      {
-	      if ( *buffer == '\"' ) 
-		{
-		this->m_Status = Self::ERROR_TYPE;
-		return Self::CONDITION_ERROR;
-		}
-	      if ( i >= arraySize )
-		return Self::CONDITION_OK;
-	      arrayInt[i++] = atoi(buffer);
-	      buffer = strtok( NULL, "\t\n " );
-	      }
-	    } while ( i < arraySize && Self::TOKEN_VALUE == this->ReadLineToken() );
-	  if ( i < arraySize) 
-	    {
-	    this->m_Status = Self::ERROR_ARG;
-	    return Self::CONDITION_ERROR;
-	    }
-	  break;
-	  }
+	  case Self::TYPE_FLOAT: 
+	  case Self::TYPE_DOUBLE: 
+	    return this->ReadNumericArray( type, array, arraySize );
 	  case Self::TYPE_BOOL: 
 	  {
 	  int *arrayInt = static_cast<int*>( array ); 
@@ -633,7 +824,7 @@ TypedStreamInput
 	    }
 	  do 
 	    {
-	    buffer = strtok( BufferValue, "\t\n " );
+	    buffer = SplitToken( BufferValue, nextToken );
 	    while ( buffer ) 
 	      {
 	      if ( i >= arraySize )
@@ -648,7 +839,7 @@ TypedStreamInput
 		{
 		arrayInt[i++] = 0;
 		}
-	      buffer = strtok( NULL, "\t\n " );
+	      buffer = SplitToken( NULL, nextToken );
 	      }
 	    } while ( i < arraySize && Self::TOKEN_VALUE == this->ReadLineToken() );
 	  if ( i < arraySize ) 
@@ -663,7 +854,7 @@ TypedStreamInput
 	  byte *arrayInt = static_cast<byte*>( array ); 
 	  do 
 	    {
-	    buffer = strtok( BufferValue, "\t\n " );
+	    buffer = SplitToken( BufferValue, nextToken );
 	    if ( buffer )
 	      {
 	      int idx = 0;
@@ -687,58 +878,6 @@ TypedStreamInput
 	    }
 	  break;
 	  }
-	  case Self::TYPE_FLOAT: 
-	  {
-	  float *arrayFloat = static_cast<float*>( array );
-	  do
-	    {
-	    buffer = strtok( BufferValue, "\t\n " );
-	    while ( buffer ) 
-	      {
-	      if ( *buffer == '\"' ) 
-		{
-		this->m_Status = Self::ERROR_TYPE;
-		return Self::CONDITION_ERROR;
-		}
-	      if ( i >= arraySize )
-		return Self::CONDITION_OK;
-	      arrayFloat[i++] = static_cast<float>( atof( buffer ) );
-	      buffer = strtok( NULL, "\t\n " );
-	      }
-	    } while ( i < arraySize && Self::TOKEN_VALUE == this->ReadLineToken() );
-	  if ( i < arraySize ) 
-	    {
-	    this->m_Status = Self::ERROR_ARG;
-	    return Self::CONDITION_ERROR;
-	    }
-	  break;
-	  }
-	case Self::TYPE_DOUBLE: 
-	{
-	double *arrayDouble = static_cast<double*>( array );
-	do
-	  {
-	  buffer = strtok( BufferValue, "\t\n " );
-	  while ( buffer ) 
-	    {
-	    if ( *buffer == '\"' ) 
-	      {
-	      this->m_Status = Self::ERROR_TYPE;
-	      return Self::CONDITION_ERROR;
-	      }
-	    if ( i >= arraySize )
-	      return Self::CONDITION_OK;
-	    arrayDouble[i++] = atof( buffer );
-	    buffer = strtok( NULL, "\t\n " );
-	    }
-	  } while ( i < arraySize && Self::TOKEN_VALUE == this->ReadLineToken() );
-	if ( i < arraySize ) 
-	  {
-	  this->m_Status = Self::ERROR_ARG;
-	  return Self::CONDITION_ERROR;
-	  }
-	break;
-	}
 	  case Self::TYPE_STRING: 
 	  {
 	  char **arrayString = static_cast<char**>( array );
@@ -806,10 +945,7 @@ TypedStreamInput
       }
     if ( line == Self::TOKEN_BEGIN ) 
       {
-      if ( GzFile )
-	LevelStack.push( gztell( GzFile ) );
-      else
-	LevelStack.push( ftell( File ) );
+      LevelStack.push( this->m_Position );
       continue;
       }
     if ( line == Self::TOKEN_END ) 
@@ -831,14 +967,8 @@ TypedStreamInput::Token
 TypedStreamInput
 ::ReadLineToken()
 {
-  if ( GzFile )
-    {
-    if (! gzgets( GzFile, Buffer, sizeof( this->Buffer ) ) )
-      return Self::TOKEN_EOF;
-    }
-  else
-    if (! fgets( Buffer, sizeof( this->Buffer ), File ) )
-      return Self::TOKEN_EOF;
+  if ( ! this->ReadLine() )
+    return Self::TOKEN_EOF;
   
   char* buffer;
   for ( buffer = Buffer; *buffer; buffer++)
@@ -876,4 +1006,34 @@ TypedStreamInput
   return Self::TOKEN_COMMENT;
 }
 
+bool
+TypedStreamInput
+::ReadLine()
+{
+  if ( this->m_Position >= this->GetDataSize() )
+    return false;
+
+  const size_t length = this->GetLineLength( this->m_Position );
+  memcpy( this->Buffer, this->m_Text + this->m_Position, length );
+  this->Buffer[length] = '\0';
+  this->m_Position += length;
+
+  return true;
+}
+
+size_t
+TypedStreamInput
+::GetLineLength( const size_t position ) const
+{
+  // same semantics as fgets(): stop after a newline or when the line buffer is full
+  const char* line = this->m_Text + position;
+  const size_t length = std::min<size_t>( this->GetDataSize() - position, sizeof( this->Buffer ) - 1 );
+
+  const char* newline = static_cast<const char*>( memchr( line, '\n', length ) );
+  if ( newline )
+    return newline - line + 1;
+
+  return length;
+}
+
 } // namespace cmtk
@@ -39,6 +39,8 @@
 
 #include <IO/cmtkTypedStream.h>
 
+#include <System/cmtkCompressedStream.h>
+
 #include <stack>
 #include <stdio.h>
 
@@ -49,6 +51,7 @@
 #endif
 
 #include <string>
+#include <vector>
 
 namespace
 cmtk
@@ -71,7 +74,7 @@ public:
   typedef TypedStream Superclass;
 
   /// Default constructor.
-  TypedStreamInput() : TypedStream() {}
+  TypedStreamInput() : TypedStream(), m_Text( NULL ), m_TextSize( 0 ), m_Position( 0 ) {}
 
   /** Open constructor.
    *\param filename Name of the archive to open.
@@ -85,6 +88,12 @@ public:
    */
   TypedStreamInput( const std::string& dir, const std::string& archive );
 
+  /** Open constructor for an archive in memory.
+   *\param data Pointer to the archive contents, which may be gzip-compressed.
+   *\param size Size of the archive contents in bytes.
+   */
+  TypedStreamInput( const void* data, const size_t size );
+
   /** Destructor.
    * Close() is called to close a possibly open archive.
    */
@@ -98,10 +107,37 @@ public:
    */
   void Open( const std::string& dir, const std::string& archive );
 
+  /** Open an archive in memory.
+   * The archive contents are copied (or decompressed, if they are gzip-compressed), so the buffer
+   * need not remain valid after this function returns.
+   */
+  void Open( const void* data /*!< Pointer to the archive contents. */, const size_t size /*!< Size of the archive contents in bytes. */ );
+
+  /** Open a section of another open archive as an archive of its own.
+   * The section becomes the only section at the top level of this archive. Its text is shared with the other
+   * archive rather than copied, so the other archive must remain open while this one is in use. Several
+   * sections of the same archive can thus be read concurrently, each through its own object.
+   */
+  void Open( const Self& archive /*!< Open archive that holds the section. */, const int sectionIdx /*!< Index of the section in the other archive's section index. */ );
+
   /** Close an open archive.
    */
   void Close();
 
+  /** Return to the beginning of the open archive.
+   * All open sections are left and the error status is cleared, as if the archive had just been
+   * opened again, but without re-reading it.
+   */
+  void Reset();
+
+  /** Return validity of archive.
+   *\return 1 if an archive is currently open, 0 if not.
+   */
+  virtual int IsValid() 
+  {
+    return this->m_Text != NULL;
+  }
+
   /** Move to a particular section in the open archive.
    * The named section is found if it is either inside the currently open
    * section or after it on the same level.
@@ -113,6 +149,15 @@ public:
   Self::Condition Seek( const char* section /*!< Name of the section whose beginning stream pointer is moved to. */, 
 			     const bool forward = false /*!< Flag: read forward from current position in stream (if false, reset to current section start) */);
 
+  /** Move to a key line of the open section within a range of stream positions.
+   * Sections inside the open section are not searched. After a key is found, it can be read by a forward
+   * read, e.g., ReadStdString( key, "", true ).
+   *\return CONDITION_OK if the key was found; otherwise, the stream position is not changed.
+   */
+  Self::Condition SeekKey( const char* key /*!< The name of the field. */,
+			   const long from /*!< Stream position where the search starts. */,
+			   const long to /*!< Stream position where the search ends; key lines at or after this position are not found. */ );
+
   /** Rewind archive.
    * This function resets filepointer of an open archive to the beginning of
    * the current section.
@@ -131,6 +176,51 @@ public:
    */
   Self::Condition End();
 
+  /// Entry in the section index of an archive.
+  class SectionIndexEntry
+  {
+  public:
+    /// Name of the section.
+    std::string m_Name;
+
+    /// Index of the enclosing section's entry, or -1 for sections at the top level.
+    int m_Parent;
+
+    /// Stream position of the first line inside the section.
+    long m_Offset;
+
+    /// Stream position following the line that closes the section.
+    long m_End;
+
+    /// Order entries by offset.
+    static bool CompareOffset( const SectionIndexEntry& a, const SectionIndexEntry& b )
+    {
+      return a.m_Offset < b.m_Offset;
+    }
+  };
+
+  /// Index of all sections in an archive, in the order in which they begin.
+  typedef std::vector<Self::SectionIndexEntry> SectionIndexType;
+
+  /** Get the index of all sections in the archive.
+   * The index is built in a single pass through the archive when it is opened.
+   */
+  const Self::SectionIndexType& GetSectionIndex() const;
+
+  /** Find a section in the archive's section index.
+   *\return Index of the first section with the given name (compared as by Seek()) that is directly
+   * inside the given parent section, or -1 if there is no such section.
+   */
+  int FindSection( const char* section /*!< Name of the section to find. */, 
+		   const int parent = -1 /*!< Index of the enclosing section, or -1 to find sections at the top level. */ ) const;
+
+  /** Enter a section from the archive's section index.
+   * All open sections are left and the indexed section and all sections that enclose it are entered,
+   * as if they had been found by successive calls to Seek().
+   *\return Error condition.
+   */
+  Self::Condition EnterSection( const int sectionIdx /*!< Index of the section in the section index. */ );
+
   /** Read boolean value from an open archive.
    * This function recognizes both yes/no and 0/1 entries in the archive.
    * First, "yes" and "no" is tried, if that doesn't work the function reads
@@ -317,6 +407,9 @@ public:
   }
 
 private:
+  /// Size of the chunks in which the archive is read into memory.
+  static const int LIMIT_READ_CHUNK = 1 << 18;
+
   /** Utility function: Read an array of arbitrary type.
    * This function is called by all reader functions. Internally, a "switch"
    * statement selects the correct code for the effective data type to be read.
@@ -332,6 +425,139 @@ private:
   /// Read the next archive line to the buffer.
   Self::Token ReadLineToken();
 
+  /** Read an array of int, float, or double values.
+   * The tokens on the current key line and all its continuation lines are first counted, then converted
+   * in a single pass directly from the archive contents in memory. Large arrays are converted in parallel,
+   * in chunks whose first element index is recorded while the tokens are counted.
+   */
+  Self::Condition ReadNumericArray( const int type /*!< Array data type ID (TYPE_INT, TYPE_FLOAT, or TYPE_DOUBLE) */, 
+				    void *const array /*!< Target storage space for read data */, 
+				    const int arraySize /*!< Number of array elements */ );
+
+  /// Thread parameters for parallel conversion of numeric array text.
+  class ParseNumericThreadInfo
+  {
+  public:
+    /// Array data type ID.
+    int m_Type;
+
+    /// Pointer to the target array.
+    void* m_Array;
+
+    /// First character of this chunk's text.
+    const char* m_Text;
+
+    /// Index of the first array element in this chunk.
+    size_t m_FirstIndex;
+
+    /// Number of array elements in this chunk.
+    size_t m_Count;
+  };
+
+  /** Convert numeric array text that has been split into chunks.
+   * Chunks are converted in parallel if there is more than one chunk and more than one thread.
+   */
+  static void ParseNumericChunks( const int type /*!< Array data type ID */,
+				  const char* text /*!< Text that chunk offsets are relative to. */, 
+				  const std::vector<size_t>& chunkOffset /*!< Offset of each chunk's text. */, 
+				  const std::vector<size_t>& chunkFirstIndex /*!< Array index of each chunk's first element. */, 
+				  void *const array /*!< Target storage space for converted values. */, 
+				  const size_t arraySize /*!< Total number of array elements; the last chunk ends here. */ );
+
+  /// Thread function for parallel conversion of numeric array text.
+  static void ParseNumericThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t, const size_t );
+
+  /** Convert a sequence of whitespace-separated values.
+   * Results are bit-identical to converting each token with atoi() or atof(), respectively.
+   *\return Pointer to the first character following the last converted token.
+   */
+  static const char* ParseNumericValues( const int type /*!< Array data type ID (TYPE_INT, TYPE_FLOAT, or TYPE_DOUBLE) */, 
+					 const char* text /*!< Text to convert; must be terminated by a NULL character. */, 
+					 void *const array /*!< Target storage space for converted values. */, 
+					 const size_t count /*!< Number of values to convert. */ );
+
+  /** Contents of the open archive read into memory, followed by a terminating NULL character.
+   * Compressed archives are held in decompressed form. This is empty if the archive is memory-mapped.
+   */
+  std::vector<char> m_Data;
+
+  /** Stream holding the memory mapping of an uncompressed archive file.
+   * Mapped archives are parsed in place rather than copied to m_Data.
+   */
+  CompressedStream m_MappedFile;
+
+  /** Complete text of the open archive, followed by a terminating NULL character.
+   * This points either to m_Data or to the memory mapping held by m_MappedFile, and is NULL if no archive is open.
+   */
+  const char* m_Text;
+
+  /// Size of the archive text (not counting the terminating NULL character).
+  size_t m_TextSize;
+
+  /// Current read position in m_Text. This takes the place of the file pointer.
+  size_t m_Position;
+
+  /// Index of all sections in the archive.
+  Self::SectionIndexType m_SectionIndex;
+
+  /// Entry in the index of key lines.
+  class KeyIndexEntry
+  {
+  public:
+    /// Key (field name).
+    std::string m_Key;
+
+    /// Index of the section that directly contains the key line, or -1 for the top level.
+    int m_Section;
+
+    /// Stream position of the key line.
+    long m_Offset;
+
+    /// Order entries by section.
+    static bool CompareSection( const KeyIndexEntry& a, const KeyIndexEntry& b )
+    {
+      return a.m_Section < b.m_Section;
+    }
+  };
+
+  /// Index of all key lines in the archive, grouped by section and in file order within each section.
+  typedef std::vector<Self::KeyIndexEntry> KeyIndexType;
+
+  /// Index of all key lines in the archive.
+  Self::KeyIndexType m_KeyIndex;
+
+  /** Read a gzip-compressed archive into memory and decompress it in a single call.
+   *\return True if successful. If false, the file could not be read or is not a valid gzip file.
+   */
+  bool InflateFile( const std::string& path );
+
+  /// Check the header of the archive contents in memory, then build the indexes.
+  void ParseContents();
+
+  /// Build section and key line indexes in a single pass through the archive.
+  void BuildIndex();
+
+  /// Get the key (field name) that begins at the given character as a string.
+  static std::string GetKeyName( const char* key );
+
+  /// Get index of the innermost open section, or -1 if no section is open.
+  int GetOpenSection() const;
+
+  /// Get stream position following the end of a section, or the size of the archive for the top level (-1).
+  size_t GetSectionEnd( const int sectionIdx ) const;
+
+  /// Get size of the archive contents (not counting the terminating NULL character).
+  size_t GetDataSize() const
+  {
+    return this->m_TextSize;
+  }
+
+  /// Get length of the archive line starting at the given position, limited to the size of the line buffer.
+  size_t GetLineLength( const size_t position ) const;
+
+  /// Read the next archive line from memory to the buffer, like fgets() does from a file.
+  bool ReadLine();
+
   /// Release major version.
   int m_ReleaseMajor;
 
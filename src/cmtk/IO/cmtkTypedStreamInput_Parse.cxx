@@ -0,0 +1,428 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkTypedStreamInput.h"
+
+#include <System/cmtkThreadPool.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+cmtk
+{
+
+namespace
+{
+
+/// Test for the token separators used by the archive format.
+inline bool
+IsSeparator( const char c )
+{
+  return (c == ' ') || (c == '\t') || (c == '\n');
+}
+
+/// Return pointer to the first character following the current token.
+inline const char*
+SkipToken( const char* p )
+{
+  while ( *p && ! IsSeparator( *p ) )
+    ++p;
+  return p;
+}
+
+/// Powers of ten that are exactly representable in double precision.
+const double ExactPowersOfTen[] = 
+{ 
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 
+};
+
+/** Convert one integer token.
+ * Tokens with more than nine digits are handed to atoi() so that overflow behaves exactly as before.
+ */
+const char*
+ParseToken( const char* p, int& value )
+{
+  const char* start = p;
+
+  const bool negative = (*p == '-');
+  if ( (*p == '-') || (*p == '+') )
+    ++p;
+  
+  int result = 0;
+  int digits = 0;
+  for ( ; (*p >= '0') && (*p <= '9'); ++p, ++digits )
+    result = 10 * result + (*p - '0');
+  
+  if ( digits > 9 )
+    value = atoi( start );
+  else
+    value = negative ? -result : result;
+
+  return SkipToken( p );
+}
+
+/** Convert one floating point token.
+ * If the decimal mantissa fits into 53 bits and the decimal exponent is within [-22,22], both are exact
+ * doubles and a single multiplication or division gives the correctly rounded result, i.e., the same
+ * value as strtod(). All other tokens, including hexadecimal, "inf", and "nan", are handed to strtod().
+ */
+const char*
+ParseToken( const char* p, double& value )
+{
+  const char* start = p;
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+  const bool negative = (*p == '-');
+  if ( (*p == '-') || (*p == '+') )
+    ++p;
+
+  unsigned long long mantissa = 0;
+  int significant = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+
+  for ( ; (*p >= '0') && (*p <= '9'); ++p )
+    {
+    anyDigits = true;
+    mantissa = 10 * mantissa + (*p - '0');
+    if ( mantissa )
+      ++significant;
+    }
+
+  // hexadecimal notation is left to the library
+  const bool hex = (*p == 'x') || (*p == 'X');
+
+  if ( *p == '.' )
+    {
+    for ( ++p; (*p >= '0') && (*p <= '9'); ++p )
+      {
+      anyDigits = true;
+      mantissa = 10 * mantissa + (*p - '0');
+      if ( mantissa )
+	++significant;
+      --exponent;
+      }
+    }
+  
+  if ( (*p == 'e') || (*p == 'E') )
+    {
+    const char* e = p+1;
+    const bool negativeExponent = (*e == '-');
+    if ( (*e == '-') || (*e == '+') )
+      ++e;
+
+    // without exponent digits, the 'e' is not part of the number
+    if ( (*e >= '0') && (*e <= '9') )
+      {
+      int exponentValue = 0;
+      for ( ; (*e >= '0') && (*e <= '9'); ++e )
+	{
+	if ( exponentValue < 10000 )
+	  exponentValue = 10 * exponentValue + (*e - '0');
+	}
+      exponent += negativeExponent ? -exponentValue : exponentValue;
+      p = e;
+      }
+    }
+  
+  if ( anyDigits && !hex && (significant <= 19) && (mantissa <= (1ULL << 53)) && (exponent >= -22) && (exponent <= 22) )
+    {
+    double result = static_cast<double>( mantissa );
+    if ( exponent < 0 )
+      result /= ExactPowersOfTen[-exponent];
+    else
+      result *= ExactPowersOfTen[exponent];
+    
+    value = negative ? -result : result;
+    return SkipToken( p );
+    }
+#endif // #if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0)
+
+  value = strtod( start, NULL );
+  return SkipToken( start );
+}
+
+/// Convert one single-precision token the same way as static_cast<float>( atof() ).
+inline const char*
+ParseToken( const char* p, float& value )
+{
+  double result;
+  p = ParseToken( p, result );
+  value = static_cast<float>( result );
+  return p;
+}
+
+/// Get the size of one array element of the given type.
+inline size_t
+GetElementSize( const int type )
+{
+  switch ( type )
+    {
+    case TypedStream::TYPE_INT:
+      return sizeof( int );
+    case TypedStream::TYPE_FLOAT:
+      return sizeof( float );
+    case TypedStream::TYPE_DOUBLE:
+    default:
+      return sizeof( double );
+    }
+}
+
+/** Count the tokens in a line of array values.
+ * Counting stops once the array is complete, just as conversion does.
+ *\return Pointer to the end of the last counted token, or NULL if a string token was found where a number was expected.
+ */
+const char*
+CountTokens( const char* p, const char *const end, const size_t arraySize, size_t& tokens )
+{
+  while ( true )
+    {
+    while ( (p < end) && IsSeparator( *p ) )
+      ++p;
+    if ( (p == end) || ! *p )
+      break;
+    if ( *p == '\"' )
+      return NULL;
+    if ( tokens >= arraySize )
+      break;
+    ++tokens;
+    while ( (p < end) && *p && ! IsSeparator( *p ) )
+      ++p;
+    }
+
+  return p;
+}
+
+/// Convert a sequence of tokens of one type.
+template<class T>
+const char*
+ParseTokens( const char* p, T *const values, const size_t count )
+{
+  for ( size_t i = 0; i < count; ++i )
+    {
+    while ( IsSeparator( *p ) )
+      ++p;
+    p = ParseToken( p, values[i] );
+    }
+  return p;
+}
+
+} // namespace
+
+const char*
+TypedStreamInput
+::ParseNumericValues( const int type, const char* text, void *const array, const size_t count )
+{
+  switch ( type )
+    {
+    case Self::TYPE_INT:
+      return ParseTokens( text, static_cast<int*>( array ), count );
+    case Self::TYPE_FLOAT:
+      return ParseTokens( text, static_cast<float*>( array ), count );
+    case Self::TYPE_DOUBLE:
+    default:
+      return ParseTokens( text, static_cast<double*>( array ), count );
+    }
+}
+
+void
+TypedStreamInput
+::ParseNumericThread( void *const args, const size_t, const size_t, const size_t, const size_t )
+{
+  const Self::ParseNumericThreadInfo* info = static_cast<const Self::ParseNumericThreadInfo*>( args );
+  Self::ParseNumericValues( info->m_Type, info->m_Text, static_cast<char*>( info->m_Array ) + info->m_FirstIndex * GetElementSize( info->m_Type ), info->m_Count );
+}
+
+void
+TypedStreamInput
+::ParseNumericChunks( const int type, const char* text, const std::vector<size_t>& chunkOffset, const std::vector<size_t>& chunkFirstIndex, void *const array, const size_t arraySize )
+{
+  ThreadPool& threadPool = ThreadPool::GetGlobalThreadPool();
+  const size_t numberOfChunks = chunkOffset.size();
+  if ( (numberOfChunks < 2) || (threadPool.GetNumberOfThreads() < 2) )
+    {
+    Self::ParseNumericValues( type, text + chunkOffset[0], static_cast<char*>( array ) + chunkFirstIndex[0] * GetElementSize( type ), arraySize - chunkFirstIndex[0] );
+    return;
+    }
+
+  const size_t numberOfTasks = std::min<size_t>( 4 * threadPool.GetNumberOfThreads() - 3, numberOfChunks );
+  std::vector<Self::ParseNumericThreadInfo> taskInfo( numberOfTasks );
+  for ( size_t taskIdx = 0; taskIdx < numberOfTasks; ++taskIdx )
+    {
+    const size_t fromChunk = (taskIdx * numberOfChunks) / numberOfTasks;
+    const size_t toChunk = ((taskIdx+1) * numberOfChunks) / numberOfTasks;
+    
+    taskInfo[taskIdx].m_Type = type;
+    taskInfo[taskIdx].m_Array = array;
+    taskInfo[taskIdx].m_Text = text + chunkOffset[fromChunk];
+    taskInfo[taskIdx].m_FirstIndex = chunkFirstIndex[fromChunk];
+    taskInfo[taskIdx].m_Count = ((toChunk < numberOfChunks) ? chunkFirstIndex[toChunk] : arraySize) - chunkFirstIndex[fromChunk];
+    }
+  
+  threadPool.Run( Self::ParseNumericThread, taskInfo );
+}
+
+TypedStreamInput::Condition
+TypedStreamInput
+::ReadNumericArray( const int type, void *const array, const int arraySize )
+{
+  const size_t size = arraySize;
+
+  // Every time another block of value text has been passed, record its offset and the index of the
+  // next array element, so that the text can be split at line boundaries for parallel conversion.
+  const size_t chunkSize = 1 << 16;
+  std::vector<size_t> chunkOffset;
+  std::vector<size_t> chunkFirstIndex;
+
+  // The key line itself is in the line buffer.
+  size_t tokens = 0;
+  const char* firstLineEnd = CountTokens( this->BufferValue, this->BufferValue + strlen( this->BufferValue ), size, tokens );
+  if ( ! firstLineEnd )
+    {
+    this->m_Status = Self::ERROR_TYPE;
+    return Self::CONDITION_ERROR;
+    }
+
+  std::string text( this->BufferValue, firstLineEnd - this->BufferValue );
+  text.push_back( '\n' );
+  const size_t firstLineTokens = tokens;
+  
+  // Continuation lines are counted and converted where they are in memory. A line that does not fit
+  // the line buffer would be split by ReadLineToken(), so if one is found, go through the buffer
+  // after all.
+  const size_t continuationBegin = this->m_Position;
+  bool inPlace = true;
+
+  chunkOffset.push_back( continuationBegin );
+  chunkFirstIndex.push_back( tokens );
+  while ( (tokens < size) && (this->m_Position < this->GetDataSize()) )
+    {
+    const char* line = this->m_Text + this->m_Position;
+    const size_t lineLength = this->GetLineLength( this->m_Position );
+    if ( (line[lineLength-1] != '\n') && (this->m_Position + lineLength < this->GetDataSize()) )
+      {
+      inPlace = false;
+      break;
+      }
+
+    // the line is consumed whether it continues the array or not, as by ReadLineToken()
+    this->m_Position += lineLength;
+
+    const char* first = line;
+    while ( (*first == ' ') || (*first == '\t') )
+      ++first;
+    if ( (*first != '\"') && (*first != '-') && (*first != '.') && ((*first < '0') || (*first > '9')) )
+      break;
+
+    const char* lineEnd = CountTokens( line, line + lineLength, size, tokens );
+    if ( ! lineEnd )
+      {
+      this->m_Status = Self::ERROR_TYPE;
+      return Self::CONDITION_ERROR;
+      }
+
+    // an embedded NULL character ends the line in the buffer, but not in memory
+    if ( (lineEnd < line + lineLength) && ! *lineEnd )
+      {
+      inPlace = false;
+      break;
+      }
+    
+    if ( this->m_Position - chunkOffset.back() >= chunkSize )
+      {
+      chunkOffset.push_back( this->m_Position );
+      chunkFirstIndex.push_back( tokens );
+      }
+    }
+
+  if ( ! inPlace )
+    {
+    this->m_Position = continuationBegin;
+    tokens = firstLineTokens;
+
+    chunkOffset.assign( 1, 0 );
+    chunkFirstIndex.assign( 1, 0 );
+    while ( tokens < size && Self::TOKEN_VALUE == this->ReadLineToken() )
+      {
+      const char* lineEnd = CountTokens( this->BufferValue, this->BufferValue + strlen( this->BufferValue ), size, tokens );
+      if ( ! lineEnd )
+	{
+	this->m_Status = Self::ERROR_TYPE;
+	return Self::CONDITION_ERROR;
+	}
+      
+      text.append( this->BufferValue, lineEnd - this->BufferValue );
+      text.push_back( '\n' );
+      
+      if ( text.size() - chunkOffset.back() >= chunkSize )
+	{
+	chunkOffset.push_back( text.size() );
+	chunkFirstIndex.push_back( tokens );
+	}
+      }
+    }
+  
+  if ( tokens < size ) 
+    {
+    this->m_Status = Self::ERROR_ARG;
+    return Self::CONDITION_ERROR;
+    }
+
+  // drop a trailing chunk that holds no array elements
+  while ( (chunkFirstIndex.size() > 1) && (chunkFirstIndex.back() >= size) )
+    {
+    chunkOffset.pop_back();
+    chunkFirstIndex.pop_back();
+    }
+  
+  if ( inPlace )
+    {
+    Self::ParseNumericValues( type, text.c_str(), array, firstLineTokens );
+    if ( firstLineTokens < size )
+      Self::ParseNumericChunks( type, this->m_Text, chunkOffset, chunkFirstIndex, array, size );
+    }
+  else
+    {
+    Self::ParseNumericChunks( type, text.c_str(), chunkOffset, chunkFirstIndex, array, size );
+    }
+  
+  return Self::CONDITION_OK;
+}
+
+} // namespace cmtk
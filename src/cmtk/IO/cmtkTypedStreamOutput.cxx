@@ -41,6 +41,12 @@
 #include <stdlib.h>
 #include <limits.h>
 
+#include <limits>
+
+#if __cplusplus >= 201703L
+#  include <charconv>
+#endif
+
 #ifdef HAVE_FCNTL_H
 #  include <fcntl.h>
 #endif
@@ -53,6 +59,43 @@
 #  include <sys/stat.h>
 #endif
 
+namespace
+{
+
+/// Append an integer value to a string.
+void
+AppendNumber( std::string& str, const long long int value )
+{
+  char buffer[32];
+  str.append( buffer, snprintf( buffer, sizeof( buffer ), "%lld", value ) );
+}
+
+/// Append an integer value to a string.
+void
+AppendNumber( std::string& str, const int value )
+{
+  AppendNumber( str, static_cast<long long int>( value ) );
+}
+
+/** Append a floating point value to a string.
+ * The shortest string that reads back as exactly the same value is used if the standard library
+ * supports it, otherwise enough digits to guarantee that the value reads back exactly.
+ */
+template<class T>
+void
+AppendNumber( std::string& str, const T value )
+{
+  char buffer[32];
+#if defined(__cpp_lib_to_chars) && (__cpp_lib_to_chars >= 201611L)
+  const std::to_chars_result result = std::to_chars( buffer, buffer + sizeof( buffer ), value );
+  str.append( buffer, result.ptr );
+#else
+  str.append( buffer, snprintf( buffer, sizeof( buffer ), "%.*g", std::numeric_limits<T>::max_digits10, static_cast<double>( value ) ) );
+#endif
+}
+
+} // namespace
+
 namespace
 cmtk
 {
@@ -60,14 +103,25 @@ cmtk
 /** \addtogroup IO */
 //@{
 
+TypedStreamOutput::TypedStreamOutput()
+  : TypedStream(),
+    m_Mode( MODE_UNSET ),
+    m_BytesWritten( 0 )
+{
+}
+
 TypedStreamOutput::TypedStreamOutput
 ( const std::string& filename, const Self::Mode mode )
+  : m_Mode( MODE_UNSET ),
+    m_BytesWritten( 0 )
 {
   this->Open( filename, mode );
 }
 
 TypedStreamOutput::TypedStreamOutput
 ( const std::string& dir, const std::string& archive, const Self::Mode mode )
+  : m_Mode( MODE_UNSET ),
+    m_BytesWritten( 0 )
 {
   this->Open( dir, archive, mode );
 }
@@ -83,22 +137,11 @@ TypedStreamOutput
 ::Open
 ( const std::string& dir, const std::string& archive, const Self::Mode mode )
 {
-  static char fname[PATH_MAX];
-  
   // If "dir" parameter is empty, use current directory instead.
+  std::string fname = archive;
   if ( dir != "" ) 
     {
-    if ( static_cast<size_t>( snprintf( fname, sizeof( fname ), "%s%c%s", dir.c_str(), CMTK_PATH_SEPARATOR, archive.c_str() ) ) >= sizeof( fname ) )
-      {
-      StdErr << "WARNING: length of path exceeds system PATH_MAX in TypedStreamOutput::Open and will be truncated.\n";
-      }
-    } 
-  else 
-    {
-    if ( static_cast<size_t>( snprintf( fname, sizeof( fname ), "%s", archive.c_str() ) ) >= sizeof( fname ) )
-      {
-      StdErr << "WARNING: length of path exceeds system PATH_MAX in TypedStreamOutput::Open and will be truncated.\n";
-      }
+    fname = dir + CMTK_PATH_SEPARATOR + archive;
     }
   
 #if !defined(_MSC_VER) && !defined(_WIN32)
@@ -162,13 +205,15 @@ TypedStreamOutput
   if ( mode == Self::MODE_WRITE_ZLIB )
     {
     const std::string gzName = filename + ".gz";
-    GzFile = gzopen( gzName.c_str(), modestr );
-    if ( ! GzFile ) 
+    File = fopen( gzName.c_str(), modestr );
+    if ( ! File ) 
       {
       StdErr << "ERROR: could not open gz file \"" << gzName << "\" with mode \"" << modestr << "\"\n";
       this->m_Status = Self::ERROR_SYSTEM;
       return;
       }
+    // compress blocks of the archive in parallel
+    this->m_GzipWriter = CompressedStream::GzipWriter::SmartPtr( new CompressedStream::GzipWriter( File ) );
     }
   else
     {
@@ -182,69 +227,113 @@ TypedStreamOutput
     }
   
   this->m_Mode = mode;
+  this->m_BytesWritten = this->m_GzipWriter ? 0 : ftell( File );
+  this->m_OutputBuffer.clear();
+  this->m_OutputBuffer.reserve( Self::OUTPUT_BUFFER_SIZE + Self::LIMIT_BUFFER );
+
   switch ( this->m_Mode ) 
     {
     default: break;
     case Self::MODE_WRITE:
     case Self::MODE_WRITE_ZLIB:
-      if ( GzFile )
-	gzprintf( GzFile, "%s\n", Self::GetTypedStreamIdent() );
-      else
-	fprintf( File, "%s\n", Self::GetTypedStreamIdent() );
+      this->m_OutputBuffer.append( Self::GetTypedStreamIdent() ).append( "\n" );
       break;
       
     case Self::MODE_APPEND:
-      if ( GzFile ) 
-	{
-	if ( 0 == gztell( this->GzFile) )
-	  gzprintf( GzFile, "%s\n", Self::GetTypedStreamIdent() );
-	} 
-      else
-	if ( 0 == ftell( File) )
-	  fprintf( File, "%s\n", Self::GetTypedStreamIdent() );
+      if ( 0 == this->m_BytesWritten )
+	this->m_OutputBuffer.append( Self::GetTypedStreamIdent() ).append( "\n" );
       break;
     }
 }
 
-void
+TypedStreamOutput::Condition
 TypedStreamOutput
 ::Close()
 {
-  if ( File || GzFile )
+  if ( File )
     {
     while ( ! LevelStack.empty() ) 
       {
       LevelStack.pop();
-      int streamLevel = LevelStack.size();
-      if ( GzFile ) 
-	{
-	for ( int level = 0; level < streamLevel; level++)
-	  gzputs( GzFile, "\t" );
-	gzputs( GzFile, "}\n" );
-	} 
-      else
-	{
-	for ( int level = 0; level < streamLevel; level++)
-	  fputs( "\t", File );
-	fputs( "}\n", File );
-	}
+      this->PutIndent();
+      this->m_OutputBuffer.append( "}\n" );
       }
+
+    this->FlushOutputBuffer();
     } 
 
-  if ( this->GzFile )
+  if ( this->m_GzipWriter )
     {
-    gzclose( this->GzFile );
-    this->GzFile = NULL;
+    if ( ! this->m_GzipWriter->Close() )
+      {
+      StdErr << "ERROR: could not write compressed archive\n";
+      this->m_Status = Self::ERROR_SYSTEM;
+      }
+    this->m_GzipWriter = CompressedStream::GzipWriter::SmartPtr::Null();
     }
   
   if ( this->File )
     {
-    fclose( this->File );
+    if ( fclose( this->File ) )
+      this->m_Status = Self::ERROR_SYSTEM;
     this->File = NULL;
     }
   
+  this->m_OutputBuffer.clear();
+  this->m_BytesWritten = 0;
+
+  const Self::Condition condition = (this->m_Status == Self::ERROR_NONE) ? Self::CONDITION_OK : Self::CONDITION_ERROR;
   this->m_Status = Self::ERROR_NONE;
   SplitPosition = NULL;
+
+  return condition;
+}
+
+void
+TypedStreamOutput
+::FlushOutputBuffer()
+{
+  if ( this->m_OutputBuffer.empty() )
+    return;
+
+  bool written = false;
+  if ( this->m_GzipWriter )
+    written = this->m_GzipWriter->Write( this->m_OutputBuffer.data(), this->m_OutputBuffer.size() );
+  else if ( File )
+    written = (fwrite( this->m_OutputBuffer.data(), 1, this->m_OutputBuffer.size(), File ) == this->m_OutputBuffer.size());
+
+  if ( ! written )
+    {
+    StdErr << "ERROR: could not write archive\n";
+    this->m_Status = Self::ERROR_SYSTEM;
+    }
+
+  this->m_BytesWritten += this->m_OutputBuffer.size();
+  this->m_OutputBuffer.clear();
+}
+
+void
+TypedStreamOutput
+::PutIndent()
+{
+  this->m_OutputBuffer.append( LevelStack.size(), '\t' );
+}
+
+void
+TypedStreamOutput
+::PutKey( const char* key )
+{
+  this->PutIndent();
+  this->m_OutputBuffer.append( key ).append( " " );
+}
+
+void
+TypedStreamOutput
+::PutLineEnd()
+{
+  this->m_OutputBuffer.append( "\n" );
+  if ( this->m_OutputBuffer.size() >= Self::OUTPUT_BUFFER_SIZE )
+    this->FlushOutputBuffer();
 }
 
 TypedStreamOutput::Condition 
@@ -252,32 +341,17 @@ TypedStreamOutput
 ::Begin
 ( const std::string& section )
 {
-  if ( !File && !GzFile)
+  if ( !File )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
     }
 
-  int streamLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < streamLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( GzFile, "%s {\n", section.c_str() );
-    }
-  else
-    {
-    for ( int level = 0; level < streamLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s {\n", section.c_str() );
-    }
+  this->PutIndent();
+  this->m_OutputBuffer.append( section ).append( " {" );
+  this->PutLineEnd();
   
-  if ( GzFile )
-    LevelStack.push( gztell( GzFile ) );
-  else
-    LevelStack.push( ftell( File ) );
+  LevelStack.push( static_cast<int>( this->m_BytesWritten + this->m_OutputBuffer.size() ) );
   
   return Self::CONDITION_OK;
 }
@@ -287,7 +361,7 @@ TypedStreamOutput
 ::End
 ( const bool flush )
 {
-  if ( ! File && ! GzFile )
+  if ( ! File )
     {
     this->m_Status = Self::ERROR_INVALID;
     return Self::CONDITION_ERROR;
@@ -302,22 +376,15 @@ TypedStreamOutput
     }
   
   LevelStack.pop();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < streamLevel-1; level++ )
-      gzputs( GzFile, "\t" );
-    gzputs( GzFile, "}\n" );
-    }
-  else 
-    {
-    for ( int level = 0; level < streamLevel-1; level++ )
-      fputs( "\t", File );
-    fputs( "}\n", File ); 
-    }
+  this->PutIndent();
+  this->m_OutputBuffer.append( "}" );
+  this->PutLineEnd();
   
   if ( flush ) 
     {
-    fflush( File );
+    this->FlushOutputBuffer();
+    if ( File )
+      fflush( File );
     }
   
   return Self::CONDITION_OK;
@@ -327,19 +394,10 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteBool( const char* key, const bool value )
 {
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      gzputs( GzFile, "\t" );
-    gzprintf( GzFile, "%s %s\n", key, (value) ? "yes" : "no");
-    } 
-  else
-    { 
-    for ( int level = 0; level < currentLevel; level++ )
-      fputs( "\t", File );
-    fprintf( File, "%s %s\n", key, (value) ? "yes" : "no");
-    }
+  this->PutKey( key );
+  this->m_OutputBuffer.append( (value) ? "yes" : "no" );
+  this->PutLineEnd();
+  
   return Self::CONDITION_OK;
 }
 
@@ -347,19 +405,10 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteInt( const char* key, const int value )
 {
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      gzputs( GzFile, "\t" );
-    gzprintf( GzFile, "%s %d\n", key, value );
-    } 
-  else
-    { 
-    for ( int level = 0; level < currentLevel; level++ )
-      fputs( "\t", File );
-    fprintf( File, "%s %d\n", key, value );
-    }
+  this->PutKey( key );
+  AppendNumber( this->m_OutputBuffer, value );
+  this->PutLineEnd();
+  
   return Self::CONDITION_OK;
 }
 
@@ -367,19 +416,13 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteFloat( const char* key, const float value )
 {
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      gzputs( GzFile, "\t" );
-    gzprintf( GzFile, "%s %.*f\n", key, PrecisionFloat, value );
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      fputs( "\t", File );
-    fprintf( File, "%s %.*f\n", key, PrecisionFloat, value );
-    }
+  char buffer[Self::LIMIT_BUFFER];
+  snprintf( buffer, sizeof( buffer ), "%.*f", PrecisionFloat, value );
+
+  this->PutKey( key );
+  this->m_OutputBuffer.append( buffer );
+  this->PutLineEnd();
+  
   return Self::CONDITION_OK;
 }
 
@@ -387,19 +430,13 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteDouble( const char* key, const double value )
 {
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      gzputs( GzFile, "\t" );
-    gzprintf( this->GzFile, "%s %.*f\n", key, PrecisionDouble, value );
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++ )
-      fputs( "\t", File );
-    fprintf( File, "%s %.*f\n", key, PrecisionDouble, value );
-    }
+  char buffer[Self::LIMIT_BUFFER];
+  snprintf( buffer, sizeof( buffer ), "%.*f", PrecisionDouble, value );
+
+  this->PutKey( key );
+  this->m_OutputBuffer.append( buffer );
+  this->PutLineEnd();
+  
   return Self::CONDITION_OK;
 }
 
@@ -414,55 +451,38 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteString( const char* key, const char* value )
 {
-  char *buffer = Buffer;
-  
-  const char *strValue = (value) ? value : "";
-  while (*strValue) 
+  this->PutKey( key );
+  this->m_OutputBuffer.append( "\"" );
+
+  for ( const char *strValue = (value) ? value : ""; *strValue; ++strValue )
     {
-    if (*strValue == '\\') 
-      {
-      *buffer++ = '\\';
-      *buffer++ = *strValue++;
-      continue;
-      }
-    if (*strValue == '\"') 
+    switch ( *strValue )
       {
-      *buffer++ = '\\';
-      *buffer++ = *strValue++;
-      continue;
+      case '\\':
+	this->m_OutputBuffer.append( "\\\\" );
+	break;
+      case '\"':
+	this->m_OutputBuffer.append( "\\\"" );
+	break;
+      case '\n':
+	this->m_OutputBuffer.append( "\\n" );
+	break;
+      default:
+	this->m_OutputBuffer.push_back( *strValue );
+	break;
       }
-    if (*strValue == '\n') 
-      {
-      *buffer++ = '\\';
-      *buffer++ = 'n';
-      strValue++;
-      continue;
-      }
-    *buffer++ = *strValue++;
     }
   
-  *buffer++ = '\0';
-  
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    gzprintf( GzFile, "%s \"%s\"\n", key, Buffer);
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    fprintf( File, "%s \"%s\"\n", key, Buffer);
-    }
+  this->m_OutputBuffer.append( "\"" );
+  this->PutLineEnd();
   
   return Self::CONDITION_OK;
 }
 
+template<class T>
 TypedStreamOutput::Condition
 TypedStreamOutput
-::WriteIntArray( const char* key, const int* array, const int size, const int valuesPerLine )
+::WriteNumericArray( const char* key, const T* array, const int size, const int valuesPerLine )
 {
   if ( !array || size < 1) 
     {
@@ -470,104 +490,35 @@ TypedStreamOutput
     return Self::CONDITION_ERROR;
     }
   
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( this->GzFile, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	gzprintf( GzFile, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  gzputs( GzFile, "\t" );
-	}
-      gzprintf( GzFile, "%d ", array[i] );
-      }
-    
-    gzputs( GzFile, "\n" );
-    } 
-  else
+  this->PutKey( key );
+  for ( int i = 0; i < size; i++ ) 
     {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
+    if (i && (i % valuesPerLine) == 0) 
       {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	fprintf( File, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  fputs( "\t", File );
-	}
-      fprintf( File, "%d ", array[i] );
+      this->PutLineEnd();
+      this->m_OutputBuffer.append( "\t" );
+      this->PutIndent();
       }
-    
-    fputs( "\n", File);
+    AppendNumber( this->m_OutputBuffer, array[i] );
+    this->m_OutputBuffer.append( " " );
     }
+  this->PutLineEnd();
   
   return Self::CONDITION_OK;
 }
 
+TypedStreamOutput::Condition
+TypedStreamOutput
+::WriteIntArray( const char* key, const int* array, const int size, const int valuesPerLine )
+{
+  return this->WriteNumericArray( key, array, size, valuesPerLine );
+}
+
 TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteIntArray( const char* key, const long long int* array, const int size, const int valuesPerLine )
 {
-  if ( !array || size < 1) 
-    {
-    this->m_Status = Self::ERROR_ARG;
-    return Self::CONDITION_ERROR;
-    }
-  
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( this->GzFile, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	gzprintf( GzFile, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  gzputs( GzFile, "\t" );
-	}
-      gzprintf( GzFile, "%lld ", array[i] );
-      }
-    
-    gzputs( GzFile, "\n" );
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	fprintf( File, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  fputs( "\t", File );
-	}
-      fprintf( File, "%lld ", array[i] );
-      }
-    
-    fputs( "\n", File);
-    }
-  
-  return Self::CONDITION_OK;
+  return this->WriteNumericArray( key, array, size, valuesPerLine );
 }
 
 TypedStreamOutput::Condition
@@ -580,47 +531,18 @@ TypedStreamOutput
     return Self::CONDITION_ERROR;
     }
   
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
+  this->PutKey( key );
+  for ( int i = 0; i < size; i++) 
     {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( GzFile, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
+    if (i && (i % valuesPerLine) == 0) 
       {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	gzprintf( GzFile, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  gzputs( GzFile, "\t" );
-	}
-      gzprintf( GzFile, "%d", (array[i/8]>>(i%8))&1 );
+      this->PutLineEnd();
+      this->m_OutputBuffer.append( "\t" );
+      this->PutIndent();
       }
-    
-    gzputs( GzFile, "\n" );
-    }
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s ", key );
-    
-    for ( int i = 0; i < size; i++) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	fprintf( File, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  fputs( "\t", File );
-	}
-      fprintf( File, "%d", (array[i/8]>>(i%8))&1 );
-      }
-    
-    fputs( "\n", File );
+    this->m_OutputBuffer.push_back( ((array[i/8]>>(i%8))&1) ? '1' : '0' );
     }
+  this->PutLineEnd();
   
   return Self::CONDITION_OK;
 }
@@ -629,110 +551,14 @@ TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteFloatArray( const char* key, const float* array, const int size, const int valuesPerLine )
 {
-  if ( !array || size < 1) 
-    {
-    this->m_Status = Self::ERROR_ARG;
-    return Self::CONDITION_ERROR;
-    }
-  
-  int currentLevel = LevelStack.size();
-  if ( GzFile ) 
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( GzFile, "%s ", key );
-    
-    for ( int i = 0; i < size; i++ ) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	gzprintf( GzFile, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  gzputs( GzFile, "\t" );
-	}
-      gzprintf( GzFile, "%.*g ", PrecisionFloat, array[i] );
-      }
-    
-    gzprintf( GzFile, "\n" );
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s ", key );
-    
-    for ( int i = 0; i < size; i++ ) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	fprintf( File, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  fputs( "\t", File );
-	}
-      fprintf( File, "%.*g ", PrecisionFloat, array[i] );
-      }
-    
-    fprintf( File, "\n" );
-    }
-  
-  return Self::CONDITION_OK;
+  return this->WriteNumericArray( key, array, size, valuesPerLine );
 }
 
 TypedStreamOutput::Condition
 TypedStreamOutput
 ::WriteDoubleArray( const char* key, const double* array, const int size, const int valuesPerLine )
 {
-  if ( !array || size < 1) 
-    {
-    this->m_Status = Self::ERROR_ARG;
-    return Self::CONDITION_ERROR;
-    }
-  
-  int currentLevel = LevelStack.size();
-  if ( GzFile )
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      gzputs( GzFile, "\t" );
-    
-    gzprintf( GzFile, "%s ", key );
-    
-    for ( int i = 0; i < size; i++ ) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	gzprintf( GzFile, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  gzputs( GzFile, "\t" );
-	}
-      gzprintf( GzFile, "%.*g ", PrecisionDouble, array[i] );
-      }
-    
-    gzprintf( GzFile, "\n" );
-    } 
-  else
-    {
-    for ( int level = 0; level < currentLevel; level++)
-      fputs( "\t", File );
-    
-    fprintf( File, "%s ", key );
-    
-    for ( int i = 0; i < size; i++ ) 
-      {
-      if (i && (i % valuesPerLine) == 0) 
-	{
-	fprintf( File, "\n\t");
-	for ( int level = 0; level < currentLevel; level++ )
-	  fputs( "\t", File );
-	}
-      fprintf( File, "%.*g ", PrecisionDouble, array[i] );
-      }
-    
-    fprintf( File, "\n" );
-    }
-  
-  return Self::CONDITION_OK;
+  return this->WriteNumericArray( key, array, size, valuesPerLine );
 }
 
 } // namespace cmtk
@@ -41,6 +41,8 @@
 
 #include <IO/cmtkTypedStream.h>
 
+#include <System/cmtkCompressedStream.h>
+
 #include <stack>
 #include <stdio.h>
 
@@ -77,14 +79,14 @@ public:
     MODE_UNSET,
     /// Write-only access.
     MODE_WRITE,
-    /// Write-only access piped through zlib/gzip compression.
+    /// Write-only access with gzip compression, done in parallel blocks.
     MODE_WRITE_ZLIB,
     /// Open existing archive and append to it.
     MODE_APPEND
   } Mode;
   
   /// Default constructor.
-  TypedStreamOutput() : TypedStream(), m_Mode( MODE_UNSET ) {}
+  TypedStreamOutput();
 
   /** Open constructor.
    *\param filename Name of the archive to open.
@@ -113,8 +115,10 @@ public:
   void Open( const std::string& dir, const std::string& archive, const Self::Mode mode );
 
   /** Close an open archive.
+   *\return CONDITION_ERROR if any operation on the archive since it was opened failed, including opening the
+   * archive and writing buffered text or compressed data to the file; CONDITION_OK otherwise.
    */
-  void Close();
+  Self::Condition Close();
 
   /** Begin a section.
    * This function will start a new section and increase the indentation level by one.
@@ -198,6 +202,7 @@ public:
 				       const int valuesPerLine = 10 /*!< Optional number of values per line of text written to the archive. This improves readability of the resulting archive as a text. */ );
 
   /** Write array of single-precision values to an open archive.
+   * Each value is written with the fewest digits that read back as exactly the same value.
    */
   Self::Condition WriteFloatArray( const char* key/*!< The name of the field under which to write this array in the archive.*/, 
 					const float* array /*!< Pointer to the array to be written.*/, 
@@ -205,6 +210,7 @@ public:
 					const int valuesPerLine = 10 /*!< Optional number of values per line of text written to the archive. This improves readability of the resulting archive as a text. */ );
 
   /** Write array of double-precision values to an open archive.
+   * Each value is written with the fewest digits that read back as exactly the same value.
    */
   Self::Condition WriteDoubleArray( const char* key /*!< The name of the field under which to write this array in the archive.*/, 
 					 const double* array /*!< Pointer to the array to be written.*/, 
@@ -252,6 +258,36 @@ public:
 private:
   /// Mode the current archive was opened with.
   Self::Mode m_Mode;
+
+  /// Size of the output buffer: archive text is written to the file in blocks of this size.
+  static const size_t OUTPUT_BUFFER_SIZE = 1 << 20;
+
+  /// Buffer for formatted archive text not yet written to the file.
+  std::string m_OutputBuffer;
+
+  /// Number of bytes written to the file so far.
+  size_t m_BytesWritten;
+
+  /// Writer that compresses the archive in MODE_WRITE_ZLIB.
+  CompressedStream::GzipWriter::SmartPtr m_GzipWriter;
+
+  /// Write the contents of the output buffer to the file; set the archive status to ERROR_SYSTEM if this fails.
+  void FlushOutputBuffer();
+
+  /// Put indentation for the current section level into the output buffer.
+  void PutIndent();
+
+  /// Put indentation and key of a field into the output buffer.
+  void PutKey( const char* key );
+
+  /// End the current line in the output buffer, and write the buffer to the file if it is full.
+  void PutLineEnd();
+
+  /** Write array of numeric values to an open archive.
+   * Floating point values are written with as many digits as necessary to read them back exactly.
+   */
+  template<class T>
+  Self::Condition WriteNumericArray( const char* key, const T* array, const int size, const int valuesPerLine );
 };
 
 //@}
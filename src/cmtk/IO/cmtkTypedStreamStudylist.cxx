@@ -62,6 +62,7 @@ void TypedStreamStudylist::Clear()
   ReferenceStudyIndex = 0;
   this->m_AffineXform = AffineXform::SmartPtr( NULL );
   this->m_WarpXform = WarpXform::SmartPtr( NULL );
+  this->m_WarpAffineXform = AffineXform::SmartPtr( NULL );
 }
 
 TypedStreamStudylist::~TypedStreamStudylist()
@@ -71,15 +72,15 @@ TypedStreamStudylist::~TypedStreamStudylist()
 }
 
 bool
-TypedStreamStudylist::Read( const std::string& studylistpath )
+TypedStreamStudylist::Read( const std::string& studylistpath, const bool warpAffineOnly )
 {
-  char archive[PATH_MAX];
+  const std::string studylistDir = MountPoints::Translate( studylistpath );
 
-  snprintf( archive, sizeof( archive ), "%s%cstudylist", MountPoints::Translate( studylistpath ).c_str(), (int)CMTK_PATH_SEPARATOR );
+  std::string archive = studylistDir + CMTK_PATH_SEPARATOR + "studylist";
   ClassStreamInput classStream( archive );
   if ( ! classStream.IsValid() ) 
     {
-    StdErr.printf( "Could not open studylist archive %s.\n", archive );
+    StdErr.printf( "Could not open studylist archive %s.\n", archive.c_str() );
     return false;
     }
   
@@ -92,11 +93,11 @@ TypedStreamStudylist::Read( const std::string& studylistpath )
   StudyPath[1] = classStream.ReadString( "studyname", "<unknown>" );
   classStream.Close();
   
-  snprintf( archive, sizeof( archive ), "%s%cregistration", MountPoints::Translate(studylistpath).c_str(), (int)CMTK_PATH_SEPARATOR  );
+  archive = studylistDir + CMTK_PATH_SEPARATOR + "registration";
   classStream.Open( archive );
   if ( ! classStream.IsValid() ) 
     {
-    StdErr.printf( "Could not open studylist archive %s.\n", archive );
+    StdErr.printf( "Could not open studylist archive %s.\n", archive.c_str() );
     return false;
     }
   
@@ -116,7 +117,7 @@ TypedStreamStudylist::Read( const std::string& studylistpath )
       }
     else
       {
-      StdErr.printf( "WARNING: Studylist %s/registration apparently has neither new 'floating_study' nor old 'model_study' entry\n", archive );
+      StdErr.printf( "WARNING: Studylist %s/registration apparently has neither new 'floating_study' nor old 'model_study' entry\n", studylistDir.c_str() );
       }
     }
   
@@ -136,16 +137,27 @@ TypedStreamStudylist::Read( const std::string& studylistpath )
     this->m_AffineXform = AffineXform::SmartPtr( this->m_AffineXform->MakeInverse() );
     }
 
-  classStream.Get( this->m_WarpXform );
-  if ( this->m_WarpXform )
+  Xform::SmartPtr warp;
+  if ( warpAffineOnly )
+    {
+    classStream.GetWarpAffine( this->m_WarpAffineXform );
+    warp = this->m_WarpAffineXform;
+    }
+  else
+    {
+    classStream.Get( this->m_WarpXform );
+    warp = this->m_WarpXform;
+    }
+
+  if ( warp )
     {
     if ( referenceStudy )
       {
-      this->m_WarpXform->SetMetaInfo( META_XFORM_FIXED_IMAGE_PATH, referenceStudy );
+      warp->SetMetaInfo( META_XFORM_FIXED_IMAGE_PATH, referenceStudy );
       }
     if ( floatingStudy )
       {
-      this->m_WarpXform->SetMetaInfo( META_XFORM_MOVING_IMAGE_PATH, floatingStudy );
+      warp->SetMetaInfo( META_XFORM_MOVING_IMAGE_PATH, floatingStudy );
       }
     }
   
@@ -67,14 +67,19 @@ public:
 
   /** Read constructor.
    */
-  TypedStreamStudylist ( const std::string& studylistpath /*!<  The typedstream archive to read the object from. */) 
+  TypedStreamStudylist ( const std::string& studylistpath /*!<  The typedstream archive to read the object from. */,
+			 const bool warpAffineOnly = false /*!< If set, read only the initial affine transformation of the local deformation. */ ) 
   { 
     this->Clear();
-    this->Read( studylistpath );
+    this->Read( studylistpath, warpAffineOnly );
   }
 
-  /// Read object from disk.
-  bool Read( const std::string& studylistpath );
+  /** Read object from disk.
+   * If the warpAffineOnly flag is set, the local deformation's control point coefficients are not read.
+   * GetWarpXform() then returns a NULL pointer, and the initial affine transformation of the deformation
+   * is available from GetWarpAffineXform() instead.
+   */
+  bool Read( const std::string& studylistpath, const bool warpAffineOnly = false );
 
   /// Return affine transformation as stored in the studylist.
   AffineXform::SmartPtr& GetAffineXform() 
@@ -88,6 +93,12 @@ public:
     return this->m_WarpXform;
   }
 
+  /// Return initial affine transformation of the local deformation, if only this was read.
+  AffineXform::SmartPtr& GetWarpAffineXform() 
+  { 
+    return this->m_WarpAffineXform;
+  }
+
   /// Return study path.
   const char* GetStudyPath( const int index ) const 
   {
@@ -125,6 +136,9 @@ private:
   /// Pointer to the local deformation of this studylist.
   WarpXform::SmartPtr m_WarpXform;
 
+  /// Pointer to the initial affine transformation of the local deformation, if the deformation itself was not read.
+  AffineXform::SmartPtr m_WarpAffineXform;
+
   /// Initialize all internal data structures.
   void Clear();
 };
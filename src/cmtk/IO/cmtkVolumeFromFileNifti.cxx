@@ -0,0 +1,229 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkVolumeFromFile.h"
+
+#include <IO/cmtkNiftiHeader.h>
+#include <IO/nifti1.h>
+
+#include <System/cmtkConsole.h>
+#include <System/cmtkCompressedStream.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+const UniformVolume::SmartPtr
+VolumeFromFile::ReadNifti( const std::string& pathHdr, const bool detached, const bool readData )
+{
+  // uncompressed files are mapped read-only; their image data is either used in place unchanged or copied
+  CompressedStream::SmartPtr hdrStream( new CompressedStream( pathHdr, true /*readOnly*/ ) );
+  if ( !hdrStream->IsValid() )
+    {
+    StdErr << "ERROR: could not open NIfTI header file " << pathHdr << "\n";
+    return UniformVolume::SmartPtr( NULL );
+    }
+
+  char buffer[NiftiHeader::HeaderSize];
+  if ( hdrStream->Read( buffer, 1, sizeof( buffer ) ) != sizeof( buffer ) )
+    {
+    StdErr << "ERROR: NIfTI header file " << pathHdr << " is truncated\n";
+    return UniformVolume::SmartPtr( NULL );
+    }
+
+  NiftiHeader header( buffer );
+  if ( !header.IsValid() )
+    {
+    StdErr << "ERROR: " << pathHdr << " does not have a valid NIfTI header\n";
+    return UniformVolume::SmartPtr( NULL );
+    }
+
+  short dim[8];
+  header.GetArray( dim, 40, 8 );
+  if ( (dim[0] < 1) || (dim[1] < 1) )
+    {
+    StdErr << "ERROR: NIfTI file " << pathHdr << " has invalid dimensions\n";
+    return UniformVolume::SmartPtr( NULL );
+    }
+
+  // images of fewer than three dimensions are read as a single slice; of images with more, only the first volume is read
+  const int dims[3] = { dim[1], (dim[0] > 1) ? std::max<short>( 1, dim[2] ) : 1, (dim[0] > 2) ? std::max<short>( 1, dim[3] ) : 1 };
+
+  double matrix[3][4];
+  header.GetIndexToWorldMatrix( matrix );
+
+  Types::Coordinate delta[3];
+  for ( int axis = 0; axis < 3; ++axis )
+    {
+    delta[axis] = sqrt( matrix[0][axis]*matrix[0][axis] + matrix[1][axis]*matrix[1][axis] + matrix[2][axis]*matrix[2][axis] );
+    if ( delta[axis] == 0 )
+      delta[axis] = 1;
+    }
+
+  UniformVolume::SmartPtr volume( new UniformVolume( DataGrid::IndexType::FromPointer( dims ), delta[0], delta[1], delta[2] ) );
+
+  // NIfTI matrices map column vectors, whereas ours map row vectors
+  volume->m_IndexToPhysicalMatrix = AffineXform::MatrixType::Identity();
+  for ( int axis = 0; axis < 3; ++axis )
+    {
+    for ( int dim3 = 0; dim3 < 3; ++dim3 )
+      volume->m_IndexToPhysicalMatrix[axis][dim3] = matrix[dim3][axis];
+    volume->m_IndexToPhysicalMatrix[3][axis] = matrix[axis][3];
+    }
+
+  volume->SetMetaInfo( META_SPACE, "RAS" );
+  volume->SetMetaInfo( META_SPACE_ORIGINAL, "RAS" );
+
+  const std::string orientation = volume->GetOrientationFromDirections();
+  volume->SetMetaInfo( META_IMAGE_ORIENTATION, orientation );
+  volume->SetMetaInfo( META_IMAGE_ORIENTATION_ORIGINAL, orientation );
+
+  if ( !readData )
+    return volume;
+
+  ScalarDataType dtype = TYPE_NONE;
+  const short dataType = header.GetField<short>( 70 );
+  switch ( dataType )
+    {
+    case NIFTI_TYPE_UINT8:
+      dtype = TYPE_BYTE;
+      break;
+    case NIFTI_TYPE_INT8:
+      dtype = TYPE_CHAR;
+      break;
+    case NIFTI_TYPE_INT16:
+      dtype = TYPE_SHORT;
+      break;
+    case NIFTI_TYPE_UINT16:
+      dtype = TYPE_USHORT;
+      break;
+    case NIFTI_TYPE_INT32:
+      dtype = TYPE_INT;
+      break;
+    case NIFTI_TYPE_UINT32:
+      dtype = TYPE_UINT;
+      break;
+    case NIFTI_TYPE_FLOAT32:
+      dtype = TYPE_FLOAT;
+      break;
+    case NIFTI_TYPE_FLOAT64:
+      dtype = TYPE_DOUBLE;
+      break;
+    default:
+      StdErr << "ERROR: NIfTI file " << pathHdr << " has unsupported data type " << dataType << "\n";
+      return UniformVolume::SmartPtr( NULL );
+    }
+
+  // single-file images hold the image data following the header; detached headers have their data in a separate ".img" file
+  CompressedStream::SmartPtr imgStream = hdrStream;
+  size_t position = sizeof( buffer );
+  if ( detached )
+    {
+    std::string pathImg = CompressedStream::GetBaseName( pathHdr );
+    if ( (pathImg.length() > 4) && (pathImg.compare( pathImg.length() - 4, 4, ".hdr" ) == 0) )
+      pathImg.replace( pathImg.length() - 4, 4, ".img" );
+    else
+      pathImg += ".img";
+
+    imgStream = CompressedStream::SmartPtr( new CompressedStream( pathImg, true /*readOnly*/ ) );
+    if ( !imgStream->IsValid() )
+      {
+      StdErr << "ERROR: could not open NIfTI image file " << pathImg << "\n";
+      return UniformVolume::SmartPtr( NULL );
+      }
+    position = 0;
+    }
+  
+  const size_t nPixels = volume->GetNumberOfPixels();
+  const size_t imageOffset = static_cast<size_t>( std::max<float>( 0, header.GetField<float>( 108 ) ) );
+
+  double slope, inter;
+  header.GetScaling( slope, inter );
+  const bool rescale = (slope != 1) || (inter != 0);
+
+  // scaled integer values are converted to floating point first so they are not truncated; the conversion makes a copy
+  const bool convert = rescale && (dtype != TYPE_FLOAT) && (dtype != TYPE_DOUBLE);
+
+  TypedArray::SmartPtr data;
+
+  // uncompressed files are memory-mapped, so the array can use the mapped image data in place if it is suitably aligned
+  // and needs neither byte swapping nor rescaling in place, both of which would have to modify the read-only mapping
+  const char* mapped = imgStream->GetData();
+  if ( mapped && !header.IsSwapped() && (!rescale || convert) && (imageOffset <= imgStream->GetDataSize()) )
+    {
+    const size_t itemSize = TypeItemSize( dtype );
+    const char* imageData = mapped + imageOffset;
+    if ( (imgStream->GetDataSize() - imageOffset >= nPixels * itemSize) && !(reinterpret_cast<size_t>( imageData ) % itemSize) )
+      {
+      data = TypedArray::Create( dtype, const_cast<char*>( imageData ), nPixels );
+      data->SetMappedFile( imgStream );
+      }
+    }
+  
+  if ( !data )
+    {
+    // otherwise, read (and decompress) the image data directly into the final array
+    data = TypedArray::Create( dtype, nPixels );
+    if ( (imageOffset > position) && (imgStream->Seek( imageOffset - position, SEEK_CUR ) < 0) )
+      {
+      StdErr << "ERROR: NIfTI file " << pathHdr << " is truncated\n";
+      return UniformVolume::SmartPtr( NULL );
+      }
+
+    if ( imgStream->Read( data->GetDataPtr(), data->GetItemSize(), nPixels ) != nPixels )
+      {
+      StdErr << "ERROR: NIfTI image data for " << pathHdr << " is truncated\n";
+      return UniformVolume::SmartPtr( NULL );
+      }
+    }
+
+  if ( header.IsSwapped() )
+    data->ChangeEndianness();
+
+  if ( rescale )
+    {
+    if ( convert )
+      data = data->Convert( TYPE_FLOAT );
+    data->Rescale( slope, inter );
+    }
+  
+  volume->SetData( data );
+  return volume;
+}
+
+} // namespace cmtk
@@ -32,11 +32,16 @@
 
 #include "cmtkXformIO.h"
 
+#include <Base/cmtkDeformationField.h>
+#include <Base/cmtkCompactSplineWarpXform.h>
+
 #include <System/cmtkConsole.h>
 #include <System/cmtkDebugOutput.h>
 #include <System/cmtkFileUtils.h>
 #include <System/cmtkMountPoints.h>
 #include <System/cmtkExitException.h>
+#include <System/cmtkCompressedStream.h>
+#include <System/cmtkMemory.h>
 
 #include <IO/cmtkFileFormat.h>
 #include <IO/cmtkClassStreamInput.h>
@@ -45,8 +50,13 @@
 #include <IO/cmtkClassStreamPolynomialXform.h>
 #include <IO/cmtkTypedStreamStudylist.h>
 #include <IO/cmtkAffineXformITKIO.h>
+#include <IO/cmtkSplineWarpXformITKIO.h>
 
+#include <cmath>
+#include <sstream>
 #include <string>
+#include <string.h>
+#include <vector>
 
 namespace
 cmtk
@@ -57,27 +67,55 @@ cmtk
 
 Xform::SmartPtr 
 XformIO::Read( const std::string& path )
+{
+  return Self::ReadPath( path, false /*affineOnly*/ );
+}
+
+Xform::SmartPtr 
+XformIO::ReadAffine( const std::string& path )
+{
+  return Self::ReadPath( path, true /*affineOnly*/ );
+}
+
+Xform::SmartPtr 
+XformIO::Read( const void* data, const size_t size )
+{
+  return Self::ReadMemory( data, size, false /*affineOnly*/ );
+}
+
+Xform::SmartPtr 
+XformIO::ReadAffine( const void* data, const size_t size )
+{
+  return Self::ReadMemory( data, size, true /*affineOnly*/ );
+}
+
+Xform::SmartPtr 
+XformIO::ReadPath( const std::string& path, const bool affineOnly )
 {
   const std::string realPath = MountPoints::Translate( path );
   
   switch ( FileFormat::Identify( realPath ) ) 
     {
     case FILEFORMAT_NRRD: 
-#ifdef CMTK_BUILD_NRRD
+      DebugOutput( 1 ) << "Reading deformation field from Nrrd file " << realPath << "\n";
       return Self::ReadNrrd( realPath );
-#else
-      StdErr << "ERROR: " << realPath << " is a Nrrd file, but Nrrd support is not enabled.\n"
-	     << "  Please re-configure software using either '--with-nrrd' or '--with-nrrd-teem' switch.\n";
-      return Xform::SmartPtr( NULL );
-#endif
     case FILEFORMAT_ITK_TFM:
-      return AffineXformITKIO::Read( path );
+      return SplineWarpXformITKIO::Read( realPath );
+    case FILEFORMAT_NIFTI_DETACHED:
+    case FILEFORMAT_NIFTI_SINGLEFILE:
+      DebugOutput( 1 ) << "Reading deformation field from NIfTI file " << realPath << "\n";
+      return Self::ReadNIFTI( realPath );
+    case FILEFORMAT_XFORM_BINARY:
+      DebugOutput( 1 ) << "Reading transformation from binary file " << realPath << "\n";
+      return Self::ReadBinary( realPath, affineOnly );
     case FILEFORMAT_STUDYLIST: 
       DebugOutput( 1 ) << "Reading transformation from studylist " << realPath << "\n";
       {
-      TypedStreamStudylist studylist( realPath );
+      TypedStreamStudylist studylist( realPath, affineOnly );
       if ( studylist.GetWarpXform() )
 	return studylist.GetWarpXform();
+      else if ( studylist.GetWarpAffineXform() )
+	return studylist.GetWarpAffineXform();
       else
 	return studylist.GetAffineXform();
       }
@@ -85,35 +123,7 @@ XformIO::Read( const std::string& path )
       DebugOutput( 1 ) << "Reading transformation from typedstream file " << realPath << "\n";
       {
       ClassStreamInput stream( realPath );
-      WarpXform* warpXform;
-      stream >> warpXform;
-      
-      if ( warpXform ) 
-	return Xform::SmartPtr( warpXform );
-      
-      stream.Open( realPath );
-      PolynomialXform polyXform;
-      try 
-	{
-	stream >> polyXform;
-	return Xform::SmartPtr( new PolynomialXform( polyXform ) );
-	}
-      catch ( const cmtk::Exception& )
-	{
-	}
-      
-      stream.Open( realPath );
-      AffineXform affineXform;
-      try 
-	{
-	stream >> affineXform;
-	}
-      catch ( const cmtk::Exception& ex )
-	{
-	StdErr << "ERROR: " << ex.what() << "\n";
-	return Xform::SmartPtr( NULL );
-	}
-      return Xform::SmartPtr( new AffineXform( affineXform ) );
+      return Self::ReadTypedStream( stream, affineOnly );
       }
     case FILEFORMAT_NEXIST:
       StdErr << "The file/directory " << realPath << " does not exist or cannot be read\n";
@@ -125,9 +135,255 @@ XformIO::Read( const std::string& path )
   return Xform::SmartPtr( NULL );
 }
 
-void 
-XformIO::Write
-( const Xform* xform, const std::string& path )
+Xform::SmartPtr 
+XformIO::ReadMemory( const void* data, const size_t size, const bool affineOnly )
+{
+  const char* contents = static_cast<const char*>( data );
+  size_t contentsSize = size;
+
+  // Decompress gzip-compressed contents up front, so that all formats are supported in either form.
+  std::vector<char> inflated;
+  if ( (size >= 2) && (static_cast<unsigned char>( contents[0] ) == 0x1f) && (static_cast<unsigned char>( contents[1] ) == 0x8b) )
+    {
+    if ( ! CompressedStream::InflateGzip( data, size, inflated ) )
+      {
+      StdErr << "ERROR: could not decompress in-memory transformation\n";
+      return Xform::SmartPtr( NULL );
+      }
+    contents = inflated.empty() ? NULL : &inflated[0];
+    contentsSize = inflated.size();
+    }
+
+  switch ( FileFormat::IdentifyMemory( contents, contentsSize ) ) 
+    {
+    case FILEFORMAT_ITK_TFM:
+    {
+    std::istringstream stream( std::string( contents, contentsSize ) );
+    return SplineWarpXformITKIO::Read( stream );
+    }
+    case FILEFORMAT_NRRD:
+      DebugOutput( 1 ) << "Reading deformation field from in-memory Nrrd file\n";
+      return Self::ReadNrrd( contents, contentsSize, "<memory>" );
+    case FILEFORMAT_NIFTI_SINGLEFILE:
+      DebugOutput( 1 ) << "Reading deformation field from in-memory NIfTI file\n";
+      return Self::ReadNIFTI( contents, contentsSize, contents, contentsSize, "<memory>" );
+    case FILEFORMAT_XFORM_BINARY:
+      DebugOutput( 1 ) << "Reading transformation from in-memory binary file\n";
+      return Self::ReadBinary( contents, contentsSize, "<memory>", affineOnly );
+    case FILEFORMAT_TYPEDSTREAM: 
+      DebugOutput( 1 ) << "Reading transformation from in-memory typedstream archive\n";
+      {
+      ClassStreamInput stream( contents, contentsSize );
+      return Self::ReadTypedStream( stream, affineOnly );
+      }
+    case FILEFORMAT_NEXIST:
+      StdErr << "ERROR: in-memory transformation is empty\n";
+      break;
+    default:
+      StdErr << "ERROR: in-memory transformation does not seem to be in a supported format\n";
+      break;
+    }
+  return Xform::SmartPtr( NULL );
+}
+
+XformIO::FileContents::FileContents( const std::string& path )
+  : m_Data( NULL ), 
+    m_Size( 0 ),
+    m_Decompressed( false )
+{
+  CompressedStream::SmartPtr stream( new CompressedStream( path ) );
+  if ( ! stream->IsValid() )
+    return;
+  
+  this->m_Decompressed = stream->IsCompressed();
+  if ( stream->GetData() )
+    {
+    this->m_Data = stream->GetData();
+    this->m_Size = stream->GetDataSize();
+    this->m_MappedFile = stream;
+    return;
+    }
+  
+  char chunk[65536];
+  size_t bytesRead;
+  while ( (bytesRead = stream->Read( chunk, 1, sizeof( chunk ) )) > 0 )
+    this->m_Buffer.insert( this->m_Buffer.end(), chunk, chunk + bytesRead );
+  
+  if ( ! this->m_Buffer.empty() )
+    {
+    this->m_Data = &this->m_Buffer[0];
+    this->m_Size = this->m_Buffer.size();
+    }
+}
+
+namespace
+{
+/// Convert displacement vectors of one value type to deformation field parameters, swapping bytes and flipping axes as necessary.
+template<class T>
+void
+ConvertDisplacements
+( const char* data, const bool swapBytes, const double slope, const double inter, const int* dims, const bool* flip, 
+  const size_t componentStride, const size_t pixelStride, Types::Coordinate* parameters )
+{
+  size_t pixel = 0;
+  for ( int z = 0; z < dims[2]; ++z )
+    {
+    const int zOut = flip[2] ? dims[2]-1-z : z;
+    for ( int y = 0; y < dims[1]; ++y )
+      {
+      const int yOut = flip[1] ? dims[1]-1-y : y;
+      Types::Coordinate* row = parameters + 3 * ( static_cast<size_t>( dims[0] ) * (yOut + static_cast<size_t>( dims[1] ) * zOut) );
+      for ( int x = 0; x < dims[0]; ++x, ++pixel )
+	{
+	Types::Coordinate* vector = row + 3 * (flip[0] ? dims[0]-1-x : x);
+	for ( int component = 0; component < 3; ++component )
+	  {
+	  T value;
+	  memcpy( &value, data + (pixel * pixelStride + component * componentStride) * sizeof( T ), sizeof( T ) );
+	  if ( swapBytes )
+	    value = Memory::ByteSwap( value );
+	  vector[component] = slope * value + inter;
+	  }
+	}
+      }
+    }
+}
+} // namespace
+
+Xform::SmartPtr
+XformIO::MakeDeformationField
+( const int* dims, const double (*matrix)[4], const char* data, const bool isDouble, const bool swapBytes, const size_t componentStride, const size_t pixelStride, 
+  const double slope, const double inter, const char* formatName, const std::string& path, const CompressedStream::SmartPtr& mappedFile )
+{
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    if ( dims[dim] < 2 )
+      {
+      StdErr << "ERROR: " << formatName << " deformation field " << path << " must have at least two pixels along each spatial dimension\n";
+      return Xform::SmartPtr( NULL );
+      }
+    }
+
+  // the grid must be aligned with the world coordinate axes; axes pointing in negative direction are flipped
+  Types::Coordinate domain[3], offset[3];
+  bool flip[3];
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    const double spacing = matrix[dim][dim];
+    for ( int other = 0; other < 3; ++other )
+      {
+      if ( (other != dim) && (fabs( matrix[dim][other] ) > 1e-6 * fabs( spacing )) )
+	{
+	StdErr << "ERROR: " << formatName << " deformation field " << path << " is not aligned with the coordinate axes, which is not supported\n";
+	return Xform::SmartPtr( NULL );
+	}
+      }
+
+    if ( (spacing == 0) || !std::isfinite( spacing ) )
+      {
+      StdErr << "ERROR: " << formatName << " deformation field " << path << " has invalid pixel size\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    flip[dim] = (spacing < 0);
+    domain[dim] = fabs( spacing ) * (dims[dim] - 1);
+    offset[dim] = flip[dim] ? matrix[dim][3] - domain[dim] : matrix[dim][3];
+    }
+
+  const FixedVector<3,Types::Coordinate> fieldDomain = FixedVector<3,Types::Coordinate>::FromPointer( domain );
+  const DataGrid::IndexType fieldDims = DataGrid::IndexType::FromPointer( dims );
+
+  // use the displacements in place if they are stored exactly like the field parameters
+  if ( mappedFile && isDouble && (sizeof( Types::Coordinate ) == sizeof( double )) && !swapBytes && (componentStride == 1) && (pixelStride == 3) &&
+       !flip[0] && !flip[1] && !flip[2] && (slope == 1) && (inter == 0) && 
+       (data >= mappedFile->GetData()) && (data < mappedFile->GetData() + mappedFile->GetDataSize()) &&
+       (reinterpret_cast<size_t>( data ) % sizeof( Types::Coordinate ) == 0) )
+    {
+    return DeformationField::SmartPtr( new DeformationField( fieldDomain, fieldDims, offset, mappedFile, data - mappedFile->GetData() ) );
+    }
+
+  DeformationField::SmartPtr dfield( new DeformationField( fieldDomain, fieldDims, offset ) );
+  if ( isDouble )
+    ConvertDisplacements<double>( data, swapBytes, slope, inter, dims, flip, componentStride, pixelStride, dfield->m_Parameters );
+  else
+    ConvertDisplacements<float>( data, swapBytes, slope, inter, dims, flip, componentStride, pixelStride, dfield->m_Parameters );
+
+  return dfield;
+}
+
+Xform::SmartPtr 
+XformIO::ReadTypedStream( ClassStreamInput& stream, const bool affineOnly )
+{
+  // Scan the archive once to see which transformation it holds, so that only the matching reader
+  // runs. Readers look for their section at the top level or inside the "registration" section.
+  const int registration = stream.FindSection( "registration" );
+  const bool topLevelWarp = (stream.FindSection( "spline_warp" ) >= 0);
+  const bool nestedWarp = (registration >= 0) && (stream.FindSection( "spline_warp", registration ) >= 0);
+  const bool polynomial = (stream.FindSection( "polynomial_xform" ) >= 0) || ((registration >= 0) && (stream.FindSection( "polynomial_xform", registration ) >= 0));
+
+  if ( topLevelWarp || nestedWarp )
+    {
+    if ( ! topLevelWarp )
+      stream.EnterSection( registration );
+
+    if ( affineOnly )
+      {
+      AffineXform::SmartPtr warpAffineXform;
+      stream.GetWarpAffine( warpAffineXform );
+
+      if ( warpAffineXform )
+	return warpAffineXform;
+
+      stream.Reset();
+      }
+    else
+      {
+      WarpXform* warpXform;
+      stream >> warpXform;
+      
+      if ( warpXform ) 
+	return Xform::SmartPtr( warpXform );
+      
+      stream.Reset();
+      }
+    }
+  
+  if ( polynomial )
+    {
+    PolynomialXform polyXform;
+    try 
+      {
+      stream >> polyXform;
+      return Xform::SmartPtr( new PolynomialXform( polyXform ) );
+      }
+    catch ( const cmtk::Exception& )
+      {
+      }
+    
+    stream.Reset();
+    }
+  
+  AffineXform affineXform;
+  try 
+    {
+    stream >> affineXform;
+    }
+  catch ( const cmtk::Exception& ex )
+    {
+    StdErr << "ERROR: " << ex.what() << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+  return Xform::SmartPtr( new AffineXform( affineXform ) );
+}
+
+bool
+XformIO::IsTypedStreamPath( const std::string& path )
+{
+  return Self::GetWriteFormat( path ) == FILEFORMAT_TYPEDSTREAM;
+}
+
+FileFormatID
+XformIO::GetWriteFormat( const std::string& path )
 {
   FileFormatID fileFormat = FILEFORMAT_TYPEDSTREAM;
 
@@ -139,14 +395,19 @@ XformIO::Write
       {
       fileFormat = FILEFORMAT_NRRD;
       }
-    else if ( suffix == ".nii")
+    else if ( (suffix == ".nii") || ((suffix == ".gz") && (path.length() > 7) && (path.compare( path.length() - 7, 7, ".nii.gz" ) == 0)) )
       {
       fileFormat = FILEFORMAT_NIFTI_SINGLEFILE;
       }
-    else if ( suffix == ".img" )
+    else if ( (suffix == ".img") || (suffix == ".hdr") || 
+	      ((suffix == ".gz") && (path.length() > 7) && ((path.compare( path.length() - 7, 7, ".img.gz" ) == 0) || (path.compare( path.length() - 7, 7, ".hdr.gz" ) == 0))) )
       {
       fileFormat = FILEFORMAT_NIFTI_DETACHED;
       }
+    else if ( suffix == ".xfb" )
+      {
+      fileFormat = FILEFORMAT_XFORM_BINARY;
+      }
     else
       {
       if ( (suffix == ".tfm") || (suffix == ".txt") )
@@ -155,32 +416,58 @@ XformIO::Write
 	}      
       }
     }
-  
+
+  return fileFormat;
+}
+
+bool
+XformIO::Write
+( const Xform* xform, const std::string& path, const bool binary )
+{
+  // all writers access the warp coefficients directly, so write a compact warp as the equivalent full warp
+  const CompactSplineWarpXform* compactXform = dynamic_cast<const CompactSplineWarpXform*>( xform );
+  if ( compactXform )
+    {
+    const SplineWarpXform::SmartPtr expanded = compactXform->GetExpanded();
+    return Self::Write( expanded.GetConstPtr(), path, binary );
+    }
+
+  const FileFormatID fileFormat = binary ? FILEFORMAT_XFORM_BINARY : Self::GetWriteFormat( path );
   const std::string absolutePath = FileUtils::GetAbsolutePath( path );
   
+  bool success = false;
   switch ( fileFormat )
     {
     case FILEFORMAT_NRRD:
 #ifdef CMTK_BUILD_NRRD
       WriteNrrd( xform, absolutePath );
+      success = true;
 #else
       StdErr << "ERROR: XformIO::Write -- Nrrd support not configured.\n";
 #endif
       break;
     case FILEFORMAT_NIFTI_DETACHED:
     case FILEFORMAT_NIFTI_SINGLEFILE:
-      Self::WriteNIFTI( xform, absolutePath );
+      success = Self::WriteNIFTI( xform, absolutePath );
+      break;
+    case FILEFORMAT_XFORM_BINARY:
+      success = Self::WriteBinary( xform, absolutePath );
       break;
     case FILEFORMAT_ITK_TFM:
     {
     const AffineXform* affineXform = dynamic_cast<const AffineXform*>( xform );
     if ( affineXform )
-      AffineXformITKIO::Write( path, *affineXform );
+      success = AffineXformITKIO::Write( path, *affineXform );
+    else
+      StdErr << "ERROR: only affine transformations can be written to ITK file " << path << "\n";
     break;
     }
     case FILEFORMAT_TYPEDSTREAM:
     {
-    ClassStreamOutput stream( absolutePath, ClassStreamOutput::MODE_WRITE );
+    // archives with a ".gz" suffix are written compressed; the stream appends the suffix itself
+    const bool compressed = (absolutePath.length() > 3) && (absolutePath.compare( absolutePath.length() - 3, 3, ".gz" ) == 0);
+    ClassStreamOutput stream( compressed ? absolutePath.substr( 0, absolutePath.length() - 3 ) : absolutePath, 
+			      compressed ? ClassStreamOutput::MODE_WRITE_ZLIB : ClassStreamOutput::MODE_WRITE );
     
     const AffineXform* affineXform = dynamic_cast<const AffineXform*>( xform );
     if ( affineXform )
@@ -193,12 +480,17 @@ XformIO::Write
     const SplineWarpXform* splineWarpXform = dynamic_cast<const SplineWarpXform*>( xform );
     if ( splineWarpXform )
       stream << *splineWarpXform;
+
+    // any failure to open or write the archive is reported when it is closed
+    success = (stream.Close() == ClassStreamOutput::CONDITION_OK);
     }
     break;
     default:
       // cannot really get here, but gcc doesn't know that
       break;
     }
+
+  return success;
 }
 
 } // namespace cmtk
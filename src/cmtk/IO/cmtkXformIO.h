@@ -37,6 +37,12 @@
 
 #include <Base/cmtkXform.h>
 
+#include <IO/cmtkFileFormat.h>
+
+#include <System/cmtkCompressedStream.h>
+
+#include <vector>
+
 namespace
 cmtk
 {
@@ -44,13 +50,44 @@ cmtk
 /** \addtogroup IO */
 //@{
 
+class ClassStreamInput;
+
 /** Utility class for one-stop transformation import.
  * When reading a transformation file using the Read() function, the file and transformation type
  * are automatically detected based on each file format's "magic number".
  *
  * When writing a transformation using the Write() function, the path or file name suffix determines
  * the output file format. Supported formats are: ITK Transformation file (".txt"; ".tfm"), Nrrd deformation
- * fields (".nrrd"; ".nhdr"), and legacy TypedStream (all other suffixes).
+ * fields (".nrrd"; ".nhdr"), NIfTI deformation fields (".nii"; ".nii.gz"; ".hdr" or ".img" for a detached header,
+ * optionally followed by ".gz" to compress both files),
+ * CMTK binary transformation (".xfb"), and legacy TypedStream (all other suffixes).
+ *
+ * NIfTI deformation fields are vector images with intent code NIFTI_INTENT_DISPVECT (NIFTI_INTENT_VECTOR is also
+ * accepted when reading), stored as 5D images with the three displacement components along the fifth dimension.
+ * The grid is placed according to the sform matrix, or the qform if there is no sform, which must be aligned with the
+ * coordinate axes; axes with negative direction are flipped. Displacements are used as stored, i.e., they must be
+ * given in the same world coordinate system as the grid. Uncompressed fields are read from a memory mapping of the file.
+ * Deformation fields are written as they are, whereas spline warps are first sampled on a grid with
+ * NiftiSamplesPerControlPoint samples per control point interval over their domain.
+ *
+ * The CMTK binary transformation format stores affine, polynomial, and spline warp transformations in a
+ * fixed 256 byte little-endian header, followed by a metadata string and the transformation coefficients as
+ * raw little-endian doubles aligned at a 64 byte boundary. All offsets are in bytes from the start of file:
+ *
+ * \code
+ *   0  char[8]    magic "CMTKXFRM"
+ *   8  uint32     format version (1)
+ *  12  uint32     transformation type (1 = affine, 2 = polynomial, 3 = spline warp)
+ *  16  uint32     flags (bit 0: log scale factors, bit 1: initial affine present, bit 2: initial affine log scale factors)
+ *  20  uint32     length of metadata string
+ *  24  int32[3]   control point grid dimensions (spline warp) or degree (polynomial, first element)
+ *  40  double[3]  domain size (spline warp)
+ *  64  double[3]  grid offset (spline warp) or center (polynomial)
+ *  88  uint64     number of coefficients
+ *  96  uint64     offset of coefficients
+ * 104  double[15] initial affine transformation parameters (spline warp), or affine parameters (affine)
+ * 256  char[]     metadata as "key=value" lines
+ * \endcode
  */
 class XformIO 
 {
@@ -61,20 +98,139 @@ public:
   /// Read transformation from filesystem.
   static Xform::SmartPtr Read( const std::string& path );
 
-  /// Write transformation to filesystem.
-  static void Write( const Xform* xform, const std::string& path );
+  /** Read transformation from the contents of a transformation file in memory.
+   * Supported formats are legacy TypedStream archives, ITK transformation files, and CMTK binary
+   * transformation files, each optionally gzip-compressed.
+   *\return The transformation, or a NULL pointer if the buffer does not hold a transformation in a supported format.
+   */
+  static Xform::SmartPtr Read( const void* data /*!< Pointer to the file contents. */, const size_t size /*!< Size of the file contents in bytes. */ );
+
+  /** Read transformation from filesystem for affine-only use.
+   * Spline warps in TypedStream archives, studylists, and CMTK binary transformation files are returned as their
+   * initial affine transformation, including the warp's metadata, without reading the control point coefficients.
+   * Other transformations are read completely, so the result must still be reduced to its affine component,
+   * e.g., using XformList::MakeAllAffine(). For large warps, this is much faster than Read().
+   */
+  static Xform::SmartPtr ReadAffine( const std::string& path );
+
+  /// Read transformation for affine-only use from the contents of a transformation file in memory.
+  static Xform::SmartPtr ReadAffine( const void* data /*!< Pointer to the file contents. */, const size_t size /*!< Size of the file contents in bytes. */ );
+
+  /** Write transformation to filesystem.
+   * A spline warp with compact coefficient storage is written as the equivalent full spline warp.
+   *\return True if the transformation was written successfully, false if the file could not be written or the
+   * file format does not support this transformation.
+   */
+  static bool Write( const Xform* xform /*!< The transformation to write. */,
+		     const std::string& path /*!< Output path. Unless a binary file is requested, the suffix determines the file format. */,
+		     const bool binary = false /*!< If set, write a CMTK binary transformation file regardless of the path suffix. This is much faster to write and read than a TypedStream archive. */ );
+
+  /// Check whether Write() stores a transformation at the given path as a legacy TypedStream archive.
+  static bool IsTypedStreamPath( const std::string& path );
+
+  /// Number of grid samples per control point interval when writing a spline warp as a NIfTI deformation field.
+  static const int NiftiSamplesPerControlPoint = 4;
 
 protected:
-#ifdef CMTK_BUILD_NRRD
-  /// Read deformation field from Nrrd image file.
+  /// Get the file format that Write() uses for a path, based on its suffix.
+  static FileFormatID GetWriteFormat( const std::string& path );
+
+  /** Read-only contents of a transformation file.
+   * Uncompressed files are accessed in place through the memory mapping of CompressedStream where supported;
+   * compressed files and platforms without mmap are read into a buffer.
+   */
+  class FileContents
+  {
+  public:
+    /// Constructor: map or read file.
+    FileContents( const std::string& path );
+
+    /// Pointer to file contents, or NULL if file could not be read.
+    const char* m_Data;
+
+    /// Size of file contents in bytes.
+    size_t m_Size;
+
+    /// Flag whether the file was decompressed while reading.
+    bool m_Decompressed;
+
+    /// Stream holding the memory mapping of the file contents, or a NULL pointer if the file was read into a buffer.
+    CompressedStream::SmartPtr m_MappedFile;
+
+  private:
+    /// Buffer for file contents, if file was read rather than mapped.
+    std::vector<char> m_Buffer;
+  };
+
+  /** Create deformation field from displacement vectors on a grid given by its image-to-world matrix.
+   * The grid must be aligned with the coordinate axes; axes pointing in negative direction are flipped. If the displacements
+   * are stored in a memory-mapped file exactly like the parameters of a deformation field, i.e., as interleaved, unscaled,
+   * native-endian values of type Types::Coordinate on unflipped axes, the field uses them in place rather than copying them.
+   *\return The deformation field, or a NULL pointer if the grid is not supported.
+   */
+  static Xform::SmartPtr MakeDeformationField( const int* dims /*!< Grid dimensions. */, 
+					       const double (*matrix)[4] /*!< Image-to-world matrix of the grid, 3 rows by 4 columns. */, 
+					       const char* data /*!< Pointer to the first displacement value. */, 
+					       const bool isDouble /*!< If set, values are double precision, otherwise single precision floating point. */, 
+					       const bool swapBytes /*!< If set, values are stored in non-native byte order. */, 
+					       const size_t componentStride /*!< Distance in values between the components of one displacement. */, 
+					       const size_t pixelStride /*!< Distance in values between the displacements of adjacent pixels. */, 
+					       const double slope /*!< Scale factor applied to stored values. */, 
+					       const double inter /*!< Offset added to scaled values. */, 
+					       const char* formatName /*!< Name of the file format, used in error messages. */, 
+					       const std::string& path /*!< Path of the file, used in error messages. */,
+					       const CompressedStream::SmartPtr& mappedFile = CompressedStream::SmartPtr::Null() /*!< Stream holding the memory mapping that the displacements are in, if any. */ );
+
+
+  /// Read transformation from filesystem, optionally for affine-only use.
+  static Xform::SmartPtr ReadPath( const std::string& path, const bool affineOnly );
+
+  /// Read transformation from the contents of a transformation file in memory, optionally for affine-only use.
+  static Xform::SmartPtr ReadMemory( const void* data, const size_t size, const bool affineOnly );
+
+  /** Read deformation field from Nrrd image file.
+   * The file must hold a 3D vector image with the vector axis first or last. Data may be raw or gzip-encoded, and may
+   * be stored in a separate data file referenced by a detached header.
+   */
   static Xform::SmartPtr ReadNrrd( const std::string& path );
 
+  /// Read deformation field from Nrrd file in memory.
+  static Xform::SmartPtr ReadNrrd( const char* data /*!< Pointer to the file contents. */, const size_t size /*!< Size of the file contents in bytes. */, 
+				   const std::string& path /*!< Path of the file, used in error messages and to locate detached data files. */,
+				   const CompressedStream::SmartPtr& mappedFile = CompressedStream::SmartPtr::Null() /*!< Stream holding the memory mapping of the file contents, if any. */ );
+
+#ifdef CMTK_BUILD_NRRD
   /// Write transformation to filesystem.
   static void WriteNrrd( const Xform* xform, const std::string& path );
 #endif // #ifdef CMTK_BUILD_NRRD
 
-  /// Write transformation to filesystem.
-  static void WriteNIFTI( const Xform* xform, const std::string& path );
+  /** Read deformation field from NIfTI image file.
+   * For a detached header, the image data is read from the file with suffix ".img" in place of ".hdr".
+   */
+  static Xform::SmartPtr ReadNIFTI( const std::string& path );
+
+  /// Read deformation field from NIfTI header and image data in memory.
+  static Xform::SmartPtr ReadNIFTI( const char* header /*!< Pointer to the NIfTI header. */, const size_t headerSize /*!< Size of the header data in bytes. */,
+				    const char* image /*!< Pointer to the image file contents, which are the same as the header for a single NIfTI file. */, 
+				    const size_t imageSize /*!< Size of the image file contents in bytes. */,
+				    const std::string& path /*!< Path of the file, used in error messages. */ );
+
+  /// Write deformation field or spline warp as NIfTI deformation field; return true on success.
+  static bool WriteNIFTI( const Xform* xform, const std::string& path );
+
+  /// Read transformation from CMTK binary transformation file.
+  static Xform::SmartPtr ReadBinary( const std::string& path, const bool affineOnly = false /*!< If set, read only the initial affine transformation of a spline warp. */ );
+
+  /// Read transformation from the contents of a CMTK binary transformation file in memory.
+  static Xform::SmartPtr ReadBinary( const char* data /*!< Pointer to the file contents. */, const size_t size /*!< Size of the file contents in bytes. */, 
+				     const std::string& path /*!< Path of the file, used in error messages. */,
+				     const bool affineOnly = false /*!< If set, read only the initial affine transformation of a spline warp. */ );
+
+  /// Read affine, polynomial, or spline warp transformation from an open TypedStream archive.
+  static Xform::SmartPtr ReadTypedStream( ClassStreamInput& stream, const bool affineOnly = false /*!< If set, read only the initial affine transformation of a spline warp. */ );
+
+  /// Write transformation to CMTK binary transformation file; return true on success.
+  static bool WriteBinary( const Xform* xform, const std::string& path );
 };
 
 //@}
@@ -0,0 +1,346 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkXformIO.h"
+
+#include <Base/cmtkAffineXform.h>
+#include <Base/cmtkPolynomialXform.h>
+#include <Base/cmtkSplineWarpXform.h>
+
+#include <System/cmtkConsole.h>
+#include <System/cmtkCompressedStream.h>
+#include <System/cmtkMemory.h>
+
+#include <IO/cmtkFileHeader.h>
+#include <IO/cmtkFileConstHeader.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+/// Binary transformation file layout constants.
+namespace XformBinary
+{
+/// Current format version.
+const unsigned int Version = 1;
+
+/// Size of the fixed header.
+const size_t HeaderSize = 256;
+
+/// Alignment of the coefficient block.
+const size_t Alignment = 64;
+
+/// Transformation type codes.
+typedef enum { TYPE_AFFINE = 1, TYPE_POLYNOMIAL = 2, TYPE_SPLINE = 3 } XformType;
+
+/// Header flags.
+const unsigned int FLAG_LOG_SCALE = 1;
+const unsigned int FLAG_INITIAL_AFFINE = 2;
+const unsigned int FLAG_INITIAL_LOG_SCALE = 4;
+
+/// Metadata keys that are preserved in binary files.
+const char* const MetaKeys[] = { META_SPACE, META_XFORM_FIXED_IMAGE_PATH, META_XFORM_MOVING_IMAGE_PATH, NULL };
+
+} // namespace XformBinary
+
+Xform::SmartPtr
+XformIO::ReadBinary( const std::string& path, const bool affineOnly )
+{
+  Self::FileContents contents( path );
+  if ( !contents.m_Data )
+    {
+    StdErr << "ERROR: could not read binary transformation file " << path << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  return Self::ReadBinary( contents.m_Data, contents.m_Size, path, affineOnly );
+}
+
+Xform::SmartPtr
+XformIO::ReadBinary( const char* data, const size_t size, const std::string& path, const bool affineOnly )
+{
+  if ( size < XformBinary::HeaderSize )
+    {
+    StdErr << "ERROR: binary transformation file " << path << " is truncated\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  FileConstHeader header( data, false /*isBigEndian*/ );
+  if ( ! header.CompareFieldStringN( 0, "CMTKXFRM", 8 ) || (header.GetField<unsigned int>( 8 ) > XformBinary::Version) )
+    {
+    StdErr << "ERROR: " << path << " is not a supported binary transformation file\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  const unsigned int type = header.GetField<unsigned int>( 12 );
+  const unsigned int flags = header.GetField<unsigned int>( 16 );
+  const unsigned int metaLength = header.GetField<unsigned int>( 20 );
+
+  int dims[3];
+  header.GetArray( dims, 24, 3 );
+
+  Types::Coordinate domain[3], offset[3], affineParameters[15];
+  header.GetArray( domain, 40, 3 );
+  header.GetArray( offset, 64, 3 );
+  header.GetArray( affineParameters, 104, 15 );
+
+  const size_t numberOfParameters = static_cast<size_t>( header.GetField<unsigned long long>( 88 ) );
+  const size_t parametersOffset = static_cast<size_t>( header.GetField<unsigned long long>( 96 ) );
+
+  if ( (XformBinary::HeaderSize + metaLength > size) || 
+       (parametersOffset > size) || (numberOfParameters > (size - parametersOffset) / sizeof( double )) )
+    {
+    StdErr << "ERROR: binary transformation file " << path << " is truncated\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // for affine-only use, a spline warp is represented by its initial affine transformation, so its
+  // coefficients need not be touched at all (for a mapped file, their pages are never even read).
+  const bool skipCoefficients = affineOnly && (type == XformBinary::TYPE_SPLINE);
+
+  // coefficients are stored as raw little-endian doubles, so on little-endian hosts this is a plain copy. The
+  // coefficients are copied rather than referenced because the file contents may be a temporary buffer, such as
+  // an inflated archive or an R raw vector, and because the transformation owns and may modify its coefficients.
+  CoordinateVector::SmartPtr parameters( new CoordinateVector( skipCoefficients ? 0 : numberOfParameters ) );
+  if ( ! skipCoefficients )
+    {
+    memcpy( parameters->Elements, data + parametersOffset, numberOfParameters * sizeof( double ) );
+#ifdef WORDS_BIGENDIAN
+    for ( size_t i = 0; i < numberOfParameters; ++i )
+      parameters->Elements[i] = Memory::ByteSwap( parameters->Elements[i] );
+#endif
+    }
+
+  Xform::SmartPtr xform;
+  switch ( type )
+    {
+    case XformBinary::TYPE_AFFINE:
+      xform = Xform::SmartPtr( new AffineXform( affineParameters, (flags & XformBinary::FLAG_LOG_SCALE) != 0 ) );
+      break;
+    case XformBinary::TYPE_POLYNOMIAL:
+    {
+    if ( (dims[0] < 0) || (dims[0] > 4) )
+      {
+      StdErr << "ERROR: unsupported polynomial degree " << dims[0] << " in binary transformation file " << path << "\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    PolynomialXform* polyXform = new PolynomialXform( dims[0] );
+    if ( polyXform->m_NumberOfParameters != numberOfParameters )
+      {
+      delete polyXform;
+      StdErr << "ERROR: inconsistent number of coefficients in binary transformation file " << path << "\n";
+      return Xform::SmartPtr( NULL );
+      }
+    polyXform->SetCenter( PolynomialXform::SpaceVectorType::FromPointer( offset ) );
+    memcpy( polyXform->m_Parameters, parameters->Elements, numberOfParameters * sizeof( Types::Coordinate ) );
+    xform = Xform::SmartPtr( polyXform );
+    break;
+    }
+    case XformBinary::TYPE_SPLINE:
+    {
+    // a cubic spline needs at least four control points per dimension; count coefficients in size_t, and stop
+    // as soon as the count exceeds the number stored, so the product cannot overflow.
+    size_t numberOfCoefficients = 3;
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      if ( (dims[dim] < 4) || (static_cast<size_t>( dims[dim] ) > numberOfParameters / numberOfCoefficients) )
+	{
+	StdErr << "ERROR: invalid control point grid dimensions in binary transformation file " << path << "\n";
+	return Xform::SmartPtr( NULL );
+	}
+      numberOfCoefficients *= dims[dim];
+      }
+
+    if ( numberOfCoefficients != numberOfParameters )
+      {
+      StdErr << "ERROR: inconsistent number of coefficients in binary transformation file " << path << "\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    AffineXform::SmartPtr initialXform;
+    if ( flags & XformBinary::FLAG_INITIAL_AFFINE )
+      initialXform = AffineXform::SmartPtr( new AffineXform( affineParameters, (flags & XformBinary::FLAG_INITIAL_LOG_SCALE) != 0 ) );
+
+    if ( skipCoefficients )
+      {
+      xform = initialXform ? initialXform : AffineXform::SmartPtr( new AffineXform );
+      break;
+      }
+    
+    SplineWarpXform* splineXform = new SplineWarpXform( SplineWarpXform::SpaceVectorType::FromPointer( domain ), SplineWarpXform::ControlPointIndexType::FromPointer( dims ), 
+							parameters, initialXform );
+    splineXform->m_Offset = SplineWarpXform::SpaceVectorType::FromPointer( offset );
+    xform = Xform::SmartPtr( splineXform );
+    break;
+    }
+    default:
+      StdErr << "ERROR: unknown transformation type " << type << " in binary transformation file " << path << "\n";
+      return Xform::SmartPtr( NULL );
+    }
+
+  // parse "key=value" metadata lines
+  const std::string meta( data + XformBinary::HeaderSize, metaLength );
+  for ( size_t from = 0; from < meta.size(); )
+    {
+    size_t to = meta.find( '\n', from );
+    if ( to == std::string::npos )
+      to = meta.size();
+    
+    const size_t equals = meta.find( '=', from );
+    if ( equals < to )
+      xform->SetMetaInfo( meta.substr( from, equals-from ), meta.substr( equals+1, to-equals-1 ) );
+    from = to + 1;
+    }
+  
+  return xform;
+}
+
+bool
+XformIO::WriteBinary( const Xform* xform, const std::string& path )
+{
+  char headerBuffer[XformBinary::HeaderSize];
+  memset( headerBuffer, 0, sizeof( headerBuffer ) );
+  FileHeader header( headerBuffer, false /*isBigEndian*/ );
+
+  memcpy( headerBuffer, "CMTKXFRM", 8 );
+  header.StoreField<unsigned int>( 8, XformBinary::Version );
+
+  unsigned int flags = 0;
+  const Types::Coordinate* coefficients = NULL;
+  size_t numberOfParameters = 0;
+
+  const AffineXform* affineXform = dynamic_cast<const AffineXform*>( xform );
+  const PolynomialXform* polyXform = dynamic_cast<const PolynomialXform*>( xform );
+  const SplineWarpXform* splineXform = dynamic_cast<const SplineWarpXform*>( xform );
+  if ( affineXform )
+    {
+    header.StoreField<unsigned int>( 12, XformBinary::TYPE_AFFINE );
+    if ( affineXform->GetUseLogScaleFactors() )
+      flags |= XformBinary::FLAG_LOG_SCALE;
+    for ( size_t i = 0; i < 15; ++i )
+      header.StoreField<double>( 104 + i * sizeof( double ), affineXform->m_Parameters[i] );
+    }
+  else if ( polyXform )
+    {
+    header.StoreField<unsigned int>( 12, XformBinary::TYPE_POLYNOMIAL );
+    header.StoreField<int>( 24, polyXform->Degree() );
+    for ( int dim = 0; dim < 3; ++dim )
+      header.StoreField<double>( 64 + dim * sizeof( double ), polyXform->Center()[dim] );
+    coefficients = polyXform->m_Parameters;
+    numberOfParameters = polyXform->m_NumberOfParameters;
+    }
+  else if ( splineXform )
+    {
+    header.StoreField<unsigned int>( 12, XformBinary::TYPE_SPLINE );
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      header.StoreField<int>( 24 + dim * sizeof( int ), splineXform->m_Dims[dim] );
+      header.StoreField<double>( 40 + dim * sizeof( double ), splineXform->m_Domain[dim] );
+      header.StoreField<double>( 64 + dim * sizeof( double ), splineXform->m_Offset[dim] );
+      }
+
+    const AffineXform* initialXform = splineXform->GetInitialAffineXform();
+    if ( initialXform )
+      {
+      flags |= XformBinary::FLAG_INITIAL_AFFINE;
+      if ( initialXform->GetUseLogScaleFactors() )
+	flags |= XformBinary::FLAG_INITIAL_LOG_SCALE;
+      for ( size_t i = 0; i < 15; ++i )
+	header.StoreField<double>( 104 + i * sizeof( double ), initialXform->m_Parameters[i] );
+      }
+
+    coefficients = splineXform->m_Parameters;
+    numberOfParameters = splineXform->m_NumberOfParameters;
+    }
+  else
+    {
+    StdErr << "ERROR: binary transformation files do not support this transformation type\n";
+    return false;
+    }
+
+  std::string meta;
+  for ( size_t key = 0; XformBinary::MetaKeys[key]; ++key )
+    {
+    if ( xform->MetaKeyExists( XformBinary::MetaKeys[key] ) )
+      meta += std::string( XformBinary::MetaKeys[key] ) + "=" + xform->GetMetaInfo( XformBinary::MetaKeys[key] ) + "\n";
+    }
+
+  const size_t parametersOffset = XformBinary::Alignment * ( (XformBinary::HeaderSize + meta.size() + XformBinary::Alignment - 1) / XformBinary::Alignment );
+
+  header.StoreField<unsigned int>( 16, flags );
+  header.StoreField<unsigned int>( 20, meta.size() );
+  header.StoreField<unsigned long long>( 88, numberOfParameters );
+  header.StoreField<unsigned long long>( 96, parametersOffset );
+
+  FILE* file = fopen( path.c_str(), "wb" );
+  if ( ! file )
+    {
+    StdErr << "ERROR: could not open file " << path << " for writing\n";
+    return false;
+    }
+
+  bool writeError = (fwrite( headerBuffer, 1, sizeof( headerBuffer ), file ) != sizeof( headerBuffer ));
+  writeError = writeError || (fwrite( meta.c_str(), 1, meta.size(), file ) != meta.size());
+
+  const std::vector<char> padding( parametersOffset - XformBinary::HeaderSize - meta.size(), 0 );
+  if ( ! padding.empty() )
+    writeError = writeError || (fwrite( &padding[0], 1, padding.size(), file ) != padding.size());
+
+#ifdef WORDS_BIGENDIAN
+  for ( size_t i = 0; (i < numberOfParameters) && !writeError; ++i )
+    {
+    const double value = Memory::ByteSwap( coefficients[i] );
+    writeError = (fwrite( &value, sizeof( value ), 1, file ) != 1);
+    }
+#else
+  if ( numberOfParameters )
+    writeError = writeError || (fwrite( coefficients, sizeof( *coefficients ), numberOfParameters, file ) != numberOfParameters);
+#endif
+
+  if ( (fclose( file ) != 0) || writeError )
+    {
+    StdErr << "ERROR: could not write binary transformation file " << path << "\n";
+    return false;
+    }
+
+  return true;
+}
+
+} // namespace cmtk
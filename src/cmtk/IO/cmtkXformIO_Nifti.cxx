@@ -0,0 +1,296 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkXformIO.h"
+
+#include <Base/cmtkDeformationField.h>
+#include <Base/cmtkSplineWarpXform.h>
+
+#include <System/cmtkConsole.h>
+#include <System/cmtkCompressedStream.h>
+
+#include <IO/cmtkNiftiHeader.h>
+#include <IO/nifti1.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <vector>
+
+namespace
+cmtk
+{
+
+namespace
+{
+
+/// Write a block of data to a file, through a gzip writer if there is one.
+bool
+WriteBlock( FILE *const file, CompressedStream::GzipWriter::SmartPtr& gzipWriter, const void* data, const size_t size )
+{
+  if ( gzipWriter )
+    return gzipWriter->Write( data, size );
+  
+  return (fwrite( data, 1, size, file ) == size);
+}
+
+} // namespace
+
+/** \addtogroup IO */
+//@{
+
+Xform::SmartPtr
+XformIO::ReadNIFTI( const std::string& path )
+{
+  Self::FileContents header( path );
+  if ( !header.m_Data )
+    {
+    StdErr << "ERROR: could not read NIfTI file " << path << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // single-file images hold the image data following the header; detached headers have their data in a separate ".img" file
+  if ( (header.m_Size < 348) || memcmp( header.m_Data + 344, "ni1", 4 ) )
+    return Self::ReadNIFTI( header.m_Data, header.m_Size, header.m_Data, header.m_Size, path );
+
+  std::string imagePath = CompressedStream::GetBaseName( path );
+  if ( (imagePath.length() > 4) && (imagePath.compare( imagePath.length() - 4, 4, ".hdr" ) == 0) )
+    imagePath.replace( imagePath.length() - 4, 4, ".img" );
+  else
+    imagePath += ".img";
+
+  Self::FileContents image( imagePath );
+  if ( !image.m_Data )
+    {
+    StdErr << "ERROR: could not read NIfTI image file " << imagePath << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  return Self::ReadNIFTI( header.m_Data, header.m_Size, image.m_Data, image.m_Size, path );
+}
+
+Xform::SmartPtr
+XformIO::ReadNIFTI( const char* headerData, const size_t headerSize, const char* image, const size_t imageSize, const std::string& path )
+{
+  if ( headerSize < NiftiHeader::HeaderSize )
+    {
+    StdErr << "ERROR: NIfTI file " << path << " is truncated\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  NiftiHeader header( headerData );
+  if ( !header.IsValid() )
+    {
+    StdErr << "ERROR: " << path << " does not have a valid NIfTI header\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  short dim[8];
+  header.GetArray( dim, 40, 8 );
+
+  const short intentCode = header.GetField<short>( 68 );
+  const bool isVectorImage = ((dim[0] == 5) && (dim[4] == 1) && (dim[5] == 3)) || ((dim[0] == 4) && (dim[4] == 3));
+  if ( ((intentCode != NIFTI_INTENT_DISPVECT) && (intentCode != NIFTI_INTENT_VECTOR)) || !isVectorImage )
+    {
+    StdErr << "ERROR: " << path << " is not a NIfTI deformation field (vector image with intent code " << NIFTI_INTENT_DISPVECT << ")\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  const int dims[3] = { dim[1], dim[2], dim[3] };
+
+  const short dataType = header.GetField<short>( 70 );
+  size_t bytesPerValue = 0;
+  switch ( dataType )
+    {
+    case NIFTI_TYPE_FLOAT32:
+      bytesPerValue = 4;
+      break;
+    case NIFTI_TYPE_FLOAT64:
+      bytesPerValue = 8;
+      break;
+    default:
+      StdErr << "ERROR: NIfTI deformation field " << path << " has unsupported data type " << dataType << "; only 32 and 64 bit floating point fields are supported\n";
+      return Xform::SmartPtr( NULL );
+    }
+
+  const size_t nPixels = static_cast<size_t>( dims[0] ) * dims[1] * dims[2];
+  const size_t imageOffset = static_cast<size_t>( header.GetField<float>( 108 ) );
+  if ( (imageOffset > imageSize) || (imageSize - imageOffset < 3 * nPixels * bytesPerValue) )
+    {
+    StdErr << "ERROR: NIfTI deformation field " << path << " is truncated\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  double matrix[3][4];
+  header.GetIndexToWorldMatrix( matrix );
+
+  double slope, inter;
+  header.GetScaling( slope, inter );
+
+  // the displacement components are stored one after another, each as a complete 3D image
+  return Self::MakeDeformationField( dims, matrix, image + imageOffset, (dataType == NIFTI_TYPE_FLOAT64), header.IsSwapped(), nPixels, 1, slope, inter, "NIfTI", path );
+}
+
+bool
+XformIO::WriteNIFTI( const Xform* xform, const std::string& path )
+{
+  const DeformationField* dfield = dynamic_cast<const DeformationField*>( xform );
+
+  DeformationField::SmartPtr sampledField;
+  if ( ! dfield )
+    {
+    const SplineWarpXform* splineXform = dynamic_cast<const SplineWarpXform*>( xform );
+    if ( ! splineXform )
+      {
+      StdErr << "ERROR: only deformation fields and spline warps can be written to NIfTI file " << path << "\n";
+      return false;
+      }
+
+    // sample the spline warp over its domain, i.e., the region between the outermost control points
+    FixedVector<3,Types::Coordinate> domain;
+    DataGrid::IndexType dims;
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      domain[dim] = splineXform->m_Spacing[dim] * (splineXform->m_Dims[dim] - 3);
+      dims[dim] = 1 + Self::NiftiSamplesPerControlPoint * (splineXform->m_Dims[dim] - 3);
+      }
+    
+    sampledField = DeformationField::SmartPtr( new DeformationField( domain, dims, splineXform->GetDomainOrigin().begin() ) );
+    sampledField->SampleXform( *splineXform );
+    dfield = sampledField;
+    }
+
+  // files with a ".gz" suffix are compressed in parallel blocks; for detached images, both files are compressed
+  const bool compressed = (path.length() > 3) && (path.compare( path.length() - 3, 3, ".gz" ) == 0);
+  const std::string gzSuffix = compressed ? ".gz" : "";
+  const std::string basePath = path.substr( 0, path.length() - gzSuffix.length() );
+
+  // detached header and image files share the path up to the suffix
+  const size_t period = basePath.rfind( '.' );
+  const std::string suffix = (period != std::string::npos) ? basePath.substr( period ) : std::string( "" );
+  const bool detached = (suffix == ".hdr") || (suffix == ".img");
+  const std::string headerPath = detached ? basePath.substr( 0, period ) + ".hdr" + gzSuffix : path;
+  const std::string imagePath = detached ? basePath.substr( 0, period ) + ".img" + gzSuffix : path;
+
+  nifti_1_header header;
+  memset( &header, 0, sizeof( header ) );
+  header.sizeof_hdr = 348;
+  header.dim[0] = 5;
+  for ( int dim = 0; dim < 3; ++dim )
+    header.dim[1+dim] = dfield->m_Dims[dim];
+  header.dim[4] = 1;
+  header.dim[5] = 3;
+  header.dim[6] = header.dim[7] = 1;
+
+  header.intent_code = NIFTI_INTENT_DISPVECT;
+  header.datatype = NIFTI_TYPE_FLOAT64;
+  header.bitpix = 8 * sizeof( double );
+  header.vox_offset = detached ? 0 : 352;
+  header.scl_slope = 1;
+  
+  header.pixdim[0] = 1; // qfac
+  for ( int dim = 0; dim < 3; ++dim )
+    header.pixdim[1+dim] = dfield->m_Spacing[dim];
+  header.pixdim[4] = header.pixdim[5] = header.pixdim[6] = header.pixdim[7] = 1;
+
+  // the grid is aligned with the coordinate axes, so the qform rotation is the identity
+  header.qform_code = header.sform_code = NIFTI_XFORM_SCANNER_ANAT;
+  header.qoffset_x = header.srow_x[3] = dfield->m_Offset[0];
+  header.qoffset_y = header.srow_y[3] = dfield->m_Offset[1];
+  header.qoffset_z = header.srow_z[3] = dfield->m_Offset[2];
+  header.srow_x[0] = dfield->m_Spacing[0];
+  header.srow_y[1] = dfield->m_Spacing[1];
+  header.srow_z[2] = dfield->m_Spacing[2];
+
+  strncpy( header.descrip, "CMTK deformation field", sizeof( header.descrip ) );
+  memcpy( header.magic, detached ? "ni1" : "n+1", 4 );
+
+  FILE* headerFile = fopen( headerPath.c_str(), "wb" );
+  if ( ! headerFile )
+    {
+    StdErr << "ERROR: could not open NIfTI file " << headerPath << " for writing\n";
+    return false;
+    }
+
+  CompressedStream::GzipWriter::SmartPtr gzipWriter( compressed ? new CompressedStream::GzipWriter( headerFile ) : NULL );
+  bool writeError = !WriteBlock( headerFile, gzipWriter, &header, sizeof( header ) );
+
+  FILE* imageFile = headerFile;
+  if ( detached )
+    {
+    if ( gzipWriter )
+      writeError = !gzipWriter->Close() || writeError;
+    writeError = (fclose( headerFile ) != 0) || writeError;
+
+    imageFile = fopen( imagePath.c_str(), "wb" );
+    if ( ! imageFile )
+      {
+      StdErr << "ERROR: could not open NIfTI image file " << imagePath << " for writing\n";
+      return false;
+      }
+    gzipWriter = CompressedStream::GzipWriter::SmartPtr( compressed ? new CompressedStream::GzipWriter( imageFile ) : NULL );
+    }
+  else
+    {
+    // empty header extension
+    const char extension[4] = { 0, 0, 0, 0 };
+    writeError = writeError || !WriteBlock( imageFile, gzipWriter, extension, sizeof( extension ) );
+    }
+
+  // the displacement components are stored one after another, each as a complete 3D image; write slice by slice
+  const size_t sliceSize = static_cast<size_t>( dfield->m_Dims[0] ) * dfield->m_Dims[1];
+  std::vector<double> slice( sliceSize );
+  for ( int component = 0; (component < 3) && !writeError; ++component )
+    {
+    for ( int z = 0; (z < dfield->m_Dims[2]) && !writeError; ++z )
+      {
+      const Types::Coordinate* coeff = dfield->m_Parameters + z * sliceSize * 3 + component;
+      for ( size_t i = 0; i < sliceSize; ++i, coeff += 3 )
+	slice[i] = *coeff;
+      
+      writeError = !WriteBlock( imageFile, gzipWriter, &slice[0], sliceSize * sizeof( double ) );
+      }
+    }
+
+  if ( gzipWriter )
+    writeError = !gzipWriter->Close() || writeError;
+
+  if ( (fclose( imageFile ) != 0) || writeError )
+    {
+    StdErr << "ERROR: could not write NIfTI file " << imagePath << "\n";
+    return false;
+    }
+
+  return true;
+}
+
+} // namespace cmtk
@@ -0,0 +1,441 @@
+/*
+//
+//  Copyright 1997-2010 Torsten Rohlfing
+//
+//  Copyright 2004-2014 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkXformIO.h"
+
+#include <System/cmtkConsole.h>
+#include <System/cmtkCompressedStream.h>
+#include <System/cmtkSmartPtr.h>
+
+#include <Base/cmtkAnatomicalOrientationBase.h>
+#include <Base/cmtkMetaInformationObject.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <limits>
+#include <map>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace
+cmtk
+{
+
+/** \addtogroup IO */
+//@{
+
+namespace
+{
+/// Split the value of a Nrrd header field into whitespace-separated items; vectors in parentheses are kept in one piece.
+std::vector<std::string>
+SplitNrrdValues( const std::string& value )
+{
+  std::vector<std::string> items;
+  size_t position = 0;
+  while ( position < value.length() )
+    {
+    if ( isspace( value[position] ) )
+      {
+      ++position;
+      continue;
+      }
+
+    size_t end = position;
+    if ( value[position] == '(' )
+      {
+      end = value.find( ')', position );
+      end = (end == std::string::npos) ? value.length() : end + 1;
+      }
+    else
+      {
+      while ( (end < value.length()) && !isspace( value[end] ) )
+	++end;
+      }
+
+    items.push_back( value.substr( position, end - position ) );
+    position = end;
+    }
+  return items;
+}
+
+/// Parse a Nrrd vector of the form "(x,y,z)".
+bool
+ParseNrrdVector( const std::string& item, double* v, const int n )
+{
+  if ( item.empty() || (item[0] != '(') )
+    return false;
+
+  const char* position = item.c_str() + 1;
+  for ( int i = 0; i < n; ++i )
+    {
+    char* end;
+    v[i] = strtod( position, &end );
+    if ( end == position )
+      return false;
+
+    while ( isspace( *end ) )
+      ++end;
+    if ( *end != ((i+1 < n) ? ',' : ')') )
+      return false;
+    position = end + 1;
+    }
+  return true;
+}
+} // namespace
+
+Xform::SmartPtr 
+XformIO::ReadNrrd( const std::string& path )
+{
+  Self::FileContents contents( path );
+  if ( !contents.m_Data )
+    {
+    StdErr << "ERROR: could not read Nrrd file " << path << "\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  return Self::ReadNrrd( contents.m_Data, contents.m_Size, path, contents.m_MappedFile );
+}
+
+Xform::SmartPtr 
+XformIO::ReadNrrd( const char* data, const size_t size, const std::string& path, const CompressedStream::SmartPtr& mappedFile )
+{
+  if ( (size < 8) || memcmp( data, "NRRD000", 7 ) )
+    {
+    StdErr << "ERROR: " << path << " is not a Nrrd file\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // Header fields follow the magic line, one per line, up to an empty line or the end of a detached header. Field
+  // names are stored without spaces, so that old spellings such as "datafile" and "lineskip" are also recognized.
+  std::map<std::string,std::string> fields;
+  size_t position = 0;
+  bool endOfHeader = false;
+  bool magicLine = true;
+  while ( (position < size) && !endOfHeader )
+    {
+    const char* line = data + position;
+    const char* eol = static_cast<const char*>( memchr( line, '\n', size - position ) );
+    const size_t length = eol ? eol - line : size - position;
+    position += eol ? length + 1 : length;
+
+    // trailing whitespace, including the carriage return of DOS line ends, is not part of the field value
+    std::string text( line, length );
+    while ( !text.empty() && isspace( text[text.length()-1] ) )
+      text.erase( text.length()-1 );
+
+    if ( magicLine )
+      {
+      magicLine = false;
+      }
+    else if ( text.empty() )
+      {
+      endOfHeader = true;
+      }
+    else if ( (text[0] != '#') && (text.find( ":=" ) == std::string::npos) ) // skip comments and key/value pairs
+      {
+      const size_t colon = text.find( ": " );
+      if ( colon == std::string::npos )
+	{
+	StdErr << "ERROR: Nrrd file " << path << " has malformed header line '" << text << "'\n";
+	return Xform::SmartPtr( NULL );
+	}
+
+      std::string field;
+      for ( size_t i = 0; i < colon; ++i )
+	{
+	if ( !isspace( text[i] ) )
+	  field += text[i];
+	}
+      fields[field] = text.substr( colon + 2 );
+      }
+    }
+
+  // a deformation field is a 4D image of 3D vectors
+  if ( atoi( fields["dimension"].c_str() ) != 4 )
+    {
+    StdErr << "ERROR: Nrrd file " << path << " is not a deformation field (four-dimensional vector image)\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  const std::vector<std::string> sizes = SplitNrrdValues( fields["sizes"] );
+  int axisSize[4];
+  for ( int axis = 0; axis < 4; ++axis )
+    {
+    axisSize[axis] = (axis < static_cast<int>( sizes.size() )) ? atoi( sizes[axis].c_str() ) : 0;
+    if ( axisSize[axis] <= 0 )
+      {
+      StdErr << "ERROR: Nrrd file " << path << " has invalid sizes '" << fields["sizes"] << "'\n";
+      return Xform::SmartPtr( NULL );
+      }
+    }
+
+  // Displacements are used as stored, in the world coordinates of the grid, so the space is recorded rather than
+  // converted, as for ITK transformations. Spaces without a fixed anatomical orientation are rejected.
+  const std::string& space = fields["space"];
+  const char* orientationSpace = NULL;
+  if ( (space == "right-anterior-superior") || (space == "RAS") || (space == "3D-right-handed") )
+    orientationSpace = AnatomicalOrientationBase::ORIENTATION_STANDARD;
+  else if ( (space == "left-posterior-superior") || (space == "LPS") || (space == "3D-left-handed") )
+    orientationSpace = AnatomicalOrientationBase::SPACE_ITK;
+  else if ( (space == "left-anterior-superior") || (space == "LAS") )
+    orientationSpace = "LAS";
+  else if ( !space.empty() )
+    {
+    StdErr << "ERROR: Nrrd deformation field " << path << " has unsupported space '" << space << "'\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  const std::string& type = fields["type"];
+  bool isDouble = true;
+  if ( type == "float" )
+    isDouble = false;
+  else if ( type != "double" )
+    {
+    StdErr << "ERROR: Nrrd deformation field " << path << " has unsupported type '" << type << "'; only float and double fields are supported\n";
+    return Xform::SmartPtr( NULL );
+    }
+  const size_t bytesPerValue = isDouble ? sizeof( double ) : sizeof( float );
+
+  // The vector axis is the one whose kind is not a spatial domain, or whose space direction is "none"; without
+  // either of these fields, it is the first axis, which is where Teem and ITK store it.
+  const std::vector<std::string> kinds = SplitNrrdValues( fields["kinds"] );
+  const std::vector<std::string> directions = SplitNrrdValues( fields["spacedirections"] );
+
+  int vectorAxis = 0;
+  if ( kinds.size() == 4 )
+    {
+    vectorAxis = -1;
+    for ( int axis = 0; axis < 4; ++axis )
+      {
+      if ( (kinds[axis] != "domain") && (kinds[axis] != "space") && (kinds[axis] != "time") )
+	vectorAxis = (vectorAxis < 0) ? axis : 4;
+      }
+    }
+  else if ( directions.size() == 4 )
+    {
+    vectorAxis = -1;
+    for ( int axis = 0; axis < 4; ++axis )
+      {
+      if ( directions[axis] == "none" )
+	vectorAxis = (vectorAxis < 0) ? axis : 4;
+      }
+    }
+
+  if ( ((vectorAxis != 0) && (vectorAxis != 3)) || (axisSize[vectorAxis] != 3) )
+    {
+    StdErr << "ERROR: Nrrd file " << path << " is not a deformation field (vector axis of size 3 first or last)\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  int dims[3];
+  int spaceAxis[3];
+  for ( int dim = 0, axis = 0; axis < 4; ++axis )
+    {
+    if ( axis != vectorAxis )
+      {
+      spaceAxis[dim] = axis;
+      dims[dim++] = axisSize[axis];
+      }
+    }
+
+  // image-to-world matrix, from space directions and origin if given, otherwise from the old-style spacings and axis minima
+  double matrix[3][4];
+  memset( matrix, 0, sizeof( matrix ) );
+  if ( directions.size() == 4 )
+    {
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      double direction[3];
+      if ( !ParseNrrdVector( directions[spaceAxis[dim]], direction, 3 ) )
+	{
+	StdErr << "ERROR: Nrrd deformation field " << path << " has invalid space direction '" << directions[spaceAxis[dim]] << "'; only three-dimensional spaces are supported\n";
+	return Xform::SmartPtr( NULL );
+	}
+      for ( int row = 0; row < 3; ++row )
+	matrix[row][dim] = direction[row];
+      }
+
+    double origin[3] = { 0, 0, 0 };
+    if ( !fields["spaceorigin"].empty() && !ParseNrrdVector( fields["spaceorigin"], origin, 3 ) )
+      {
+      StdErr << "ERROR: Nrrd deformation field " << path << " has invalid space origin '" << fields["spaceorigin"] << "'\n";
+      return Xform::SmartPtr( NULL );
+      }
+    for ( int row = 0; row < 3; ++row )
+      matrix[row][3] = origin[row];
+    }
+  else
+    {
+    const std::vector<std::string> spacings = SplitNrrdValues( fields["spacings"] );
+    const std::vector<std::string> axisMins = SplitNrrdValues( fields["axismins"] );
+    for ( int dim = 0; dim < 3; ++dim )
+      {
+      matrix[dim][dim] = (spacings.size() == 4) ? atof( spacings[spaceAxis[dim]].c_str() ) : 1.0;
+      matrix[dim][3] = (axisMins.size() == 4) ? atof( axisMins[spaceAxis[dim]].c_str() ) : 0.0;
+      }
+    }
+
+  const std::string& encoding = fields["encoding"];
+  const bool gzipEncoding = (encoding == "gzip") || (encoding == "gz");
+  if ( (encoding != "raw") && !gzipEncoding )
+    {
+    StdErr << "ERROR: Nrrd deformation field " << path << " has unsupported encoding '" << encoding << "'; only raw and gzip encodings are supported\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // the data follows the header in the same file, or is in a separate file named relative to the header's directory
+  const char* encodedData = data + position;
+  size_t encodedSize = size - position;
+  CompressedStream::SmartPtr dataMapping = mappedFile;
+  bool decompressed = false;
+
+  std::string dataFileName = fields["datafile"];
+  SmartPointer<Self::FileContents> dataFile;
+  if ( !dataFileName.empty() )
+    {
+    if ( (dataFileName.find( ' ' ) != std::string::npos) || (dataFileName == "LIST") )
+      {
+      StdErr << "ERROR: Nrrd deformation field " << path << " has data in multiple files, which is not supported\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    if ( (dataFileName[0] != CMTK_PATH_SEPARATOR) && (dataFileName[0] != '/') )
+      {
+      const size_t separator = path.find_last_of( "/" CMTK_PATH_SEPARATOR_STR );
+      if ( separator != std::string::npos )
+	dataFileName = path.substr( 0, separator + 1 ) + dataFileName;
+      }
+
+    dataFile = SmartPointer<Self::FileContents>( new Self::FileContents( dataFileName ) );
+    if ( !dataFile->m_Data )
+      {
+      StdErr << "ERROR: could not read data file " << dataFileName << " of Nrrd deformation field " << path << "\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    encodedData = dataFile->m_Data;
+    encodedSize = dataFile->m_Size;
+    dataMapping = dataFile->m_MappedFile;
+    decompressed = dataFile->m_Decompressed;
+    }
+  else if ( !endOfHeader )
+    {
+    StdErr << "ERROR: Nrrd file " << path << " has neither attached data nor a data file\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // skip lines and bytes before the data, as requested by the header
+  for ( int line = atoi( fields["lineskip"].c_str() ); (line > 0) && encodedSize; --line )
+    {
+    const char* eol = static_cast<const char*>( memchr( encodedData, '\n', encodedSize ) );
+    const size_t skip = eol ? (eol - encodedData) + 1 : encodedSize;
+    encodedData += skip;
+    encodedSize -= skip;
+    }
+
+  // count pixels in size_t, making sure that the data size in bytes does not overflow
+  size_t nPixels = 1;
+  for ( int dim = 0; dim < 3; ++dim )
+    {
+    if ( static_cast<size_t>( dims[dim] ) > std::numeric_limits<size_t>::max() / (3 * bytesPerValue * nPixels) )
+      {
+      StdErr << "ERROR: Nrrd deformation field " << path << " is too large\n";
+      return Xform::SmartPtr( NULL );
+      }
+    nPixels *= dims[dim];
+    }
+  const size_t dataSize = 3 * nPixels * bytesPerValue;
+  const int byteSkip = atoi( fields["byteskip"].c_str() );
+  if ( byteSkip < 0 )
+    {
+    // a byte skip of -1 means that the data is at the end of the file, which is only defined for raw data
+    if ( gzipEncoding || (encodedSize < dataSize) )
+      {
+      StdErr << "ERROR: Nrrd deformation field " << path << " has invalid byte skip for its encoding or size\n";
+      return Xform::SmartPtr( NULL );
+      }
+    else
+      {
+      encodedData += encodedSize - dataSize;
+      encodedSize = dataSize;
+      }
+    }
+  else
+    {
+    const size_t skip = std::min<size_t>( byteSkip, encodedSize );
+    encodedData += skip;
+    encodedSize -= skip;
+    }
+
+  // gzip-encoded data is decompressed in memory, unless the data file was already decompressed when it was read
+  std::vector<char> inflated;
+  if ( gzipEncoding && !decompressed )
+    {
+    if ( !CompressedStream::InflateGzip( encodedData, encodedSize, inflated ) )
+      {
+      StdErr << "ERROR: could not decompress data of Nrrd deformation field " << path << "\n";
+      return Xform::SmartPtr( NULL );
+      }
+
+    encodedData = inflated.empty() ? NULL : &inflated[0];
+    encodedSize = inflated.size();
+    dataMapping = CompressedStream::SmartPtr::Null();
+    }
+
+  if ( encodedSize < dataSize )
+    {
+    StdErr << "ERROR: Nrrd deformation field " << path << " is truncated\n";
+    return Xform::SmartPtr( NULL );
+    }
+
+  // the header gives the byte order of the data; without it, the data is in native byte order
+  const std::string& endian = fields["endian"];
+#ifdef WORDS_BIGENDIAN
+  const bool swapBytes = (endian == "little");
+#else
+  const bool swapBytes = (endian == "big");
+#endif
+
+  const size_t componentStride = (vectorAxis == 0) ? 1 : nPixels;
+  const size_t pixelStride = (vectorAxis == 0) ? 3 : 1;
+  Xform::SmartPtr dfield = Self::MakeDeformationField( dims, matrix, encodedData, isDouble, swapBytes, componentStride, pixelStride, 1.0, 0.0, "Nrrd", path, dataMapping );
+  if ( dfield && orientationSpace )
+    {
+    dfield->SetMetaInfo( META_SPACE, orientationSpace );
+    dfield->SetMetaInfo( META_SPACE_ORIGINAL, orientationSpace );
+    }
+
+  return dfield;
+}
+
+} // namespace cmtk
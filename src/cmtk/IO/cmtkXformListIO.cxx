@@ -35,49 +35,138 @@
 #include <IO/cmtkXformIO.h>
 
 #include <System/cmtkExitException.h>
+#include <System/cmtkThreadPool.h>
 
 #include <Base/cmtkPolynomial.h>
+#include <Base/cmtkSplineWarpXform.h>
+#include <Base/cmtkCompactSplineWarpXform.h>
 
 cmtk::XformList
-cmtk::XformListIO::MakeFromStringList( const std::vector<std::string>& stringList )
+cmtk::XformListIO::MakeFromStringList( const std::vector<std::string>& stringList, const bool affineOnly )
 {
-  XformList xformList;
-  for ( std::vector<std::string>::const_iterator it = stringList.begin(); it != stringList.end(); ++it )
+  return Self::MakeFromList( std::vector<Self::Entry>( stringList.begin(), stringList.end() ), affineOnly );
+}
+
+cmtk::XformList
+cmtk::XformListIO::MakeFromList( const std::vector<Self::Entry>& list, const bool affineOnly, const bool compact )
+{
+  return Self::MakeFromLists( std::vector< std::vector<Self::Entry> >( 1, list ), affineOnly, compact )[0];
+}
+
+std::vector<cmtk::XformList>
+cmtk::XformListIO::MakeFromLists( const std::vector< std::vector<Self::Entry> >& lists, const bool affineOnly, const bool compact )
+{
+  // collect the transformations of all lists, so they can all be read at once
+  std::vector<Self::ReadThreadInfo> infos;
+  std::vector< std::vector<bool> > inverse( lists.size() );
+  for ( size_t listIdx = 0; listIdx < lists.size(); ++listIdx )
     {
-    const bool inverse = (*it == "-i" ) || (*it == "--inverse" );
-    if ( inverse ) 
+    const std::vector<Self::Entry>& list = lists[listIdx];
+    for ( std::vector<Self::Entry>::const_iterator it = list.begin(); it != list.end(); ++it )
       {
-      ++it;
-      if ( it == stringList.end() )
+      const bool inverseNext = !it->m_Data && ((it->m_Path == "-i" ) || (it->m_Path == "--inverse" ));
+      if ( inverseNext ) 
 	{
-	StdErr << "ERROR: '--inverse' / '-i' must be followed by at least one more transformation\n";
-	throw ExitException( 1 );
+	++it;
+	if ( it == list.end() )
+	  {
+	  StdErr << "ERROR: '--inverse' / '-i' must be followed by at least one more transformation\n";
+	  throw ExitException( 1 );
+	  }
 	}
+      
+      Self::ReadThreadInfo info;
+      info.m_Entry = &(*it);
+      info.m_AffineOnly = affineOnly;
+      info.m_Compact = compact;
+      infos.push_back( info );
+      
+      inverse[listIdx].push_back( inverseNext );
       }
-    
-    try
+    }
+
+  Self::ReadTransformations( infos );
+
+  // assemble lists in order, reporting the first failure
+  std::vector<XformList> xformLists( lists.size() );
+  std::vector<Self::ReadThreadInfo>::const_iterator info = infos.begin();
+  for ( size_t listIdx = 0; listIdx < lists.size(); ++listIdx )
+    {
+    for ( size_t idx = 0; idx < inverse[listIdx].size(); ++idx, ++info )
       {
-      Xform::SmartPtr xform( XformIO::Read( it->c_str() ) );
-      if ( ! xform ) 
+      const std::string& path = info->m_Entry->m_Path;
+      try
 	{
-	StdErr << "ERROR: could not read target-to-reference transformation from " << *it << "\n";
+	if ( info->m_Exception )
+	  std::rethrow_exception( info->m_Exception );
+	
+	if ( ! info->m_Xform ) 
+	  {
+	  StdErr << "ERROR: could not read target-to-reference transformation from " << path << "\n";
+	  throw ExitException( 1 );
+	  }
+	
+	xformLists[listIdx].Add( info->m_Xform, inverse[listIdx][idx] );
+	}
+      catch ( const AffineXform::MatrixType::SingularMatrixException& )
+	{
+	StdErr << "ERROR: singular matrix encountered reading transformation from " << path << "\n";
+	throw ExitException( 1 );
+	}
+      catch ( const PolynomialHelper::DegreeUnsupported& ex )
+	{
+	StdErr << "ERROR: polynomial degree unsupported in " << path << "\n";
+	StdErr << ex.what() << "\n";
 	throw ExitException( 1 );
 	}
-
-      xformList.Add( xform, inverse );
-      }
-    catch ( const AffineXform::MatrixType::SingularMatrixException& )
-      {
-      StdErr << "ERROR: singular matrix encountered reading transformation from " << *it << "\n";
-      throw ExitException( 1 );
       }
-    catch ( const PolynomialHelper::DegreeUnsupported& ex )
+    }
+  
+  return xformLists;
+}
+
+void
+cmtk::XformListIO::ReadTransformations( std::vector<Self::ReadThreadInfo>& infos )
+{
+  if ( infos.empty() )
+    return;
+
+  ThreadPool& threadPool = ThreadPool::GetGlobalThreadPool();
+  if ( (infos.size() > 1) && (threadPool.GetNumberOfThreads() > 1) )
+    {
+    threadPool.Run( Self::ReadThread, infos );
+    }
+  else
+    {
+    for ( size_t idx = 0; idx < infos.size(); ++idx )
+      Self::ReadThread( &infos[idx], idx, infos.size(), 0, 1 );
+    }
+}
+
+void
+cmtk::XformListIO::ReadThread( void *const args, const size_t, const size_t, const size_t, const size_t )
+{
+  Self::ReadThreadInfo* info = static_cast<Self::ReadThreadInfo*>( args );
+  const Self::Entry& entry = *(info->m_Entry);
+
+  // exceptions must not escape a pooled thread, so keep them for the calling thread
+  try
+    {
+    if ( info->m_AffineOnly )
+      info->m_Xform = entry.m_Data ? XformIO::ReadAffine( entry.m_Data, entry.m_Size ) : XformIO::ReadAffine( entry.m_Path );
+    else
+      info->m_Xform = entry.m_Data ? XformIO::Read( entry.m_Data, entry.m_Size ) : XformIO::Read( entry.m_Path );
+
+    // convert right away, so that at most one full-precision warp per thread is held at any time
+    if ( info->m_Compact )
       {
-      StdErr << "ERROR: polynomial degree unsupported in " << *it << "\n";
-      StdErr << ex.what() << "\n";
-      throw ExitException( 1 );
+      const SplineWarpXform* splineXform = dynamic_cast<const SplineWarpXform*>( info->m_Xform.GetConstPtr() );
+      if ( splineXform )
+	info->m_Xform = Xform::SmartPtr( new CompactSplineWarpXform( *splineXform ) );
       }
     }
-  
-  return xformList;
+  catch ( ... )
+    {
+    info->m_Exception = std::current_exception();
+    }
 }
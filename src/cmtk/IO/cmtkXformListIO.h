@@ -37,6 +37,7 @@
 
 #include <Base/cmtkXformList.h>
 
+#include <exception>
 #include <vector>
 #include <string>
 
@@ -59,7 +60,74 @@ public:
    *\return An XformList object with concatenated Xform (and derived) objects, each of which
    * may be optionally inverted.
    */
-  static XformList MakeFromStringList( const std::vector<std::string>& stringList /*!< List of transformation paths. If an entry is "--inverse" or "-i", then the next following transformation is marked to be applied inverse.*/ );
+  static XformList MakeFromStringList( const std::vector<std::string>& stringList /*!< List of transformation paths. If an entry is "--inverse" or "-i", then the next following transformation is marked to be applied inverse.*/,
+				       const bool affineOnly = false /*!< If set, transformations are read for affine-only use via XformIO::ReadAffine(). */ );
+
+  /// Entry in a list of transformations: either a path, or the contents of a transformation file in memory.
+  class Entry
+  {
+  public:
+    /// Constructor for a transformation path, or an "--inverse" / "-i" flag.
+    Entry( const std::string& path ) : m_Path( path ), m_Data( NULL ), m_Size( 0 ) {}
+
+    /// Constructor for the contents of a transformation file in memory.
+    Entry( const void* data, const size_t size, const std::string& name ) : m_Path( name ), m_Data( data ), m_Size( size ) {}
+
+    /// Transformation path or flag, or for transformations in memory, a name used in error messages.
+    std::string m_Path;
+
+    /// Pointer to transformation file contents in memory, or NULL if this entry is a path.
+    const void* m_Data;
+
+    /// Size of the transformation file contents in bytes.
+    size_t m_Size;
+  };
+
+  /** Create transformation list from a list of paths and in-memory transformation files.
+   *\return An XformList object with concatenated Xform (and derived) objects, each of which
+   * may be optionally inverted.
+   */
+  static XformList MakeFromList( const std::vector<Self::Entry>& list /*!< List of transformations. If an entry is the path "--inverse" or "-i", then the next following transformation is marked to be applied inverse.*/,
+				 const bool affineOnly = false /*!< If set, transformations are read for affine-only use via XformIO::ReadAffine(). */,
+				 const bool compact = false /*!< If set, spline warps are converted to CompactSplineWarpXform right after reading. */ );
+
+  /** Create several independent transformation lists at once, e.g., one for each subject in a study.
+   * All transformations of all lists are read concurrently, so this is faster than creating each list in turn.
+   *\return One XformList object for each list of transformations, in the same order.
+   */
+  static std::vector<XformList> MakeFromLists( const std::vector< std::vector<Self::Entry> >& lists /*!< Lists of transformations, each as for MakeFromList(). */,
+					       const bool affineOnly = false /*!< If set, transformations are read for affine-only use via XformIO::ReadAffine(). */,
+					       const bool compact = false /*!< If set, spline warps are converted to CompactSplineWarpXform right after reading. */ );
+
+private:
+  /// Parameters and results for reading one transformation.
+  class ReadThreadInfo
+  {
+  public:
+    /// The transformation to read.
+    const Self::Entry* m_Entry;
+
+    /// Flag: read for affine-only use.
+    bool m_AffineOnly;
+
+    /// Flag: convert spline warps to compact coefficient storage.
+    bool m_Compact;
+
+    /// The transformation that was read, or a NULL pointer if reading failed.
+    Xform::SmartPtr m_Xform;
+
+    /// Exception thrown while reading the transformation, if any. This is re-thrown on the calling thread.
+    std::exception_ptr m_Exception;
+  };
+
+  /** Read transformations.
+   * If there is more than one transformation, they are read concurrently on the global thread pool. A single
+   * transformation is read on the calling thread, which leaves the thread pool to parallelize reading it.
+   */
+  static void ReadTransformations( std::vector<Self::ReadThreadInfo>& infos );
+
+  /// Thread function to read one transformation.
+  static void ReadThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t threadIdx, const size_t threadCnt );
 };
 
 //@}
@@ -66,6 +66,7 @@ CompressedStream::ArchiveLookup[] = {
   {".bz2",  "bzip2 -cd %s > %s"},
   {".lzma", "xz -cd %s > %s"},
   {".xz",   "xz -cd %s > %s"},
+  {".zst",  "zstd -cd %s > %s"},
 #else
   {".Z",    "gunzip -c %s"},
   {".gz",   "gzip -cd %s"},
@@ -73,15 +74,16 @@ CompressedStream::ArchiveLookup[] = {
   {".bz2",  "bzip2 -cd %s"},
   {".lzma", "xz -cd %s"},
   {".xz",   "xz -cd %s"},
+  {".zst",  "zstd -cd %s"},
 #endif
   { NULL,   NULL} 
 };
 
-CompressedStream::CompressedStream ( const std::string& filename ) 
+CompressedStream::CompressedStream ( const std::string& filename, const bool readOnly ) 
   : m_Reader( NULL ),
     m_Compressed( false )
 {
-  this->Open( MountPoints::Translate( filename ) );
+  this->Open( MountPoints::Translate( filename ), readOnly );
 }
 
 CompressedStream::~CompressedStream () 
@@ -90,7 +92,7 @@ CompressedStream::~CompressedStream ()
 }
 
 bool
-CompressedStream::Open ( const std::string& filename ) 
+CompressedStream::Open ( const std::string& filename, const bool readOnly ) 
 {
   this->Close();
 
@@ -114,7 +116,19 @@ CompressedStream::Open ( const std::string& filename )
     {
     if ( !this->m_Compressed )
       {
+#ifdef HAVE_SYS_MMAN_H
+      // map uncompressed files into memory; use stdio if that fails, e.g., for empty files or special files
+      try
+	{
+	this->m_Reader = ReaderBase::SmartPtr( new Self::Mmap( filename, readOnly ) );
+	}
+      catch (...)
+	{
+	this->m_Reader = ReaderBase::SmartPtr( new Self::File( filename ) );
+	}
+#else
       this->m_Reader = ReaderBase::SmartPtr( new Self::File( filename ) );
+#endif
       }
     }
   catch (...)
@@ -172,7 +186,14 @@ CompressedStream::OpenDecompressionPipe
     {
     if ( !strcmp( compressedSuffix, ".gz" ) ) 
       {
-      this->m_Reader = ReaderBase::SmartPtr( new Self::Zlib( fname ) );
+      try
+	{
+	this->m_Reader = ReaderBase::SmartPtr( new Self::ZlibIndexed( fname ) );
+	}
+      catch ( ... )
+	{
+	this->m_Reader = ReaderBase::SmartPtr( new Self::Zlib( fname ) );
+	}
       }
 #ifdef CMTK_USE_BZIP2
     else if ( !strcmp( compressedSuffix, ".bz2" ) ) 
@@ -185,6 +206,12 @@ CompressedStream::OpenDecompressionPipe
       {
       this->m_Reader = ReaderBase::SmartPtr( new Self::LZMA( fname ) );
       }
+#endif
+#ifdef CMTK_USE_ZSTD
+    else if ( !strcmp( compressedSuffix, ".zst" ) ) 
+      {
+      this->m_Reader = ReaderBase::SmartPtr( new Self::Zstd( fname ) );
+      }
 #endif
     else
       {
@@ -52,11 +52,16 @@
 #  include <lzmadec.h>
 #endif
 
+#ifdef CMTK_USE_ZSTD
+#  include <zstd.h>
+#endif
+
 #ifdef HAVE_SYS_STAT_H
 #  include <sys/stat.h>
 #endif
 
 #include <string>
+#include <vector>
 
 #if defined(_WIN32)
 #define CMTK_FILE_MODE "rb"
@@ -79,6 +84,9 @@ class CompressedStream :
 public:
   /// This class.
   typedef CompressedStream Self;
+
+  /// Smart pointer to this class.
+  typedef SmartPointer<Self> SmartPtr;
   
   /// Type for stat() buffer
 #ifdef CMTK_USE_STAT64
@@ -91,7 +99,7 @@ public:
   CompressedStream() : m_Reader( NULL ), m_Compressed( false ) {};
   
   /// Create stream from filename.
-  CompressedStream ( const std::string& filename );
+  CompressedStream ( const std::string& filename, const bool readOnly = false /*!< Map uncompressed files read-only rather than copy-on-write. */ );
   
   /// Dispose stream object.
   ~CompressedStream ();
@@ -109,7 +117,7 @@ public:
   }
   
   /// Open new stream from filename.
-  bool Open( const std::string& filename );
+  bool Open( const std::string& filename, const bool readOnly = false /*!< Map uncompressed files read-only rather than copy-on-write. */ );
   
   /// Close current file stream.
   void Close();
@@ -158,6 +166,26 @@ public:
     return this->m_Reader->Feof();
   }
 
+  /** Get the complete contents of a memory-mapped file.
+   * This view is available for uncompressed files on platforms that support memory mapping. It is followed
+   * by a NULL character, so text can be parsed in place with C string functions. The view is independent of
+   * the read position and remains valid until the stream is closed. Unless the stream was opened read-only,
+   * the file is mapped copy-on-write, so modifying the contents through a non-const pointer, e.g., when they
+   * are used as transformation parameters in place, does not affect the file. Read-only mappings must not be
+   * modified at all.
+   *\return Pointer to the file contents, or NULL if the stream does not read from a memory-mapped file.
+   */
+  const char* GetData() const
+  {
+    return this->m_Reader ? this->m_Reader->GetData() : NULL;
+  }
+
+  /// Get size in bytes of the memory-mapped file contents returned by GetData(), or zero if there are none.
+  size_t GetDataSize() const
+  {
+    return this->m_Reader ? this->m_Reader->GetDataSize() : 0;
+  }
+
   /** Return base name of a path without compression suffix.
    */
   static std::string GetBaseName( const std::string& path );
@@ -170,6 +198,141 @@ public:
    */
   static int Stat( const std::string& path, Self::StatType *const buf = NULL );
 
+  /** Decompress a complete gzip file image in memory.
+   * The output is sized in advance from the ISIZE field of the gzip trailer and inflated in a single call,
+   * using libdeflate if the package was configured with it (CMTK_USE_LIBDEFLATE), and zlib otherwise.
+   * Files with more than one gzip member are supported.
+   *\return True if the data was decompressed successfully; false if it is not gzip data or is damaged.
+   */
+  static bool InflateGzip( const void* data /*!< Compressed file contents. */, 
+			   const size_t size /*!< Size of the compressed data in bytes. */, 
+			   std::vector<char>& output /*!< Decompressed data; resized to the decompressed size. */ );
+
+  /** Writer for gzip files that compresses blocks of data in parallel.
+   * Data is collected into blocks of a fixed size, which are compressed independently on the global thread pool
+   * in the manner of "pigz". Each block is primed with the last 32 kB of data preceding it, so compression is
+   * nearly as good as for a single stream. The compressed blocks are concatenated into a single standard gzip
+   * member, which can be read by any gzip decompressor.
+   */
+  class GzipWriter :
+    /// Make class uncopyable via inheritance.
+    private CannotBeCopied
+  {
+  public:
+    /// This class.
+    typedef GzipWriter Self;
+
+    /// Smart pointer to this class.
+    typedef SmartPointer<Self> SmartPtr;
+
+    /// Constructor using the default compression level and block size.
+    GzipWriter( FILE *const file /*!< Open file to write to. This is not closed by the writer. */ );
+
+    /// Constructor with explicit compression level and block size.
+    GzipWriter( FILE *const file /*!< Open file to write to. This is not closed by the writer. */,
+		const int level /*!< Compression level from 0 to 9, or Z_DEFAULT_COMPRESSION. */,
+		const size_t blockSize /*!< Number of uncompressed bytes compressed independently by each task. */ );
+
+    /// Destructor: finish the gzip stream if Close() has not been called.
+    ~GzipWriter();
+
+    /** Write block of data.
+     *\return True if successful, false if compressing or writing failed, now or earlier.
+     */
+    bool Write( const void* data, const size_t size );
+
+    /** Compress all remaining data and write the gzip trailer.
+     *\return True if the complete stream was written successfully.
+     */
+    bool Close();
+
+    /** Set default compression level and block size for all writers created subsequently.
+     * The initial defaults are Z_DEFAULT_COMPRESSION and 128 kB.
+     */
+    static void SetDefaultParameters( const int level, const size_t blockSize );
+
+  private:
+    /// Size of the deflate history, which is the most data that each block can refer back to.
+    static const size_t DictionarySize = 32768;
+
+    /// Default compression level.
+    static int m_DefaultLevel;
+
+    /// Default block size.
+    static size_t m_DefaultBlockSize;
+
+    /// The file written to.
+    FILE* m_File;
+
+    /// Compression level.
+    int m_Level;
+
+    /// Block size.
+    size_t m_BlockSize;
+
+    /// Uncompressed data not yet compressed, preceded by up to DictionarySize bytes of data that have been.
+    std::vector<char> m_Input;
+
+    /// Number of bytes at the start of m_Input that have already been compressed.
+    size_t m_DictionaryLength;
+
+    /// CRC32 of all data compressed so far.
+    unsigned long m_CRC;
+
+    /// Number of uncompressed bytes compressed so far.
+    size_t m_TotalIn;
+
+    /// Flag for a failure to compress or write.
+    bool m_Failed;
+
+    /// Flag for a closed stream.
+    bool m_Closed;
+
+    /// Parameters and results for a block compression task.
+    class BlockTask
+    {
+    public:
+      /// Pointer to the start of the preset dictionary for this block.
+      const char* m_Dictionary;
+
+      /// Length of the preset dictionary.
+      size_t m_DictionaryLength;
+
+      /// Pointer to the uncompressed data of this block.
+      const char* m_Data;
+
+      /// Length of the uncompressed data.
+      size_t m_Size;
+
+      /// Compression level.
+      int m_Level;
+
+      /// Flag for the final block of the stream.
+      bool m_Last;
+
+      /// Compressed data.
+      std::vector<char> m_Output;
+
+      /// CRC32 of the uncompressed data.
+      unsigned long m_CRC;
+
+      /// Flag for successful compression.
+      bool m_Success;
+    };
+
+    /// Compress a block of data in a thread pool task.
+    static void CompressBlockThread( void *const args, const size_t taskIdx, const size_t taskCnt, const size_t threadIdx, const size_t threadCnt );
+
+    /// Write the gzip header.
+    void WriteHeader();
+
+    /** Compress and write the first given number of bytes following the dictionary in the input buffer.
+     * The data is split into blocks, which are compressed in parallel. If this is the final data of the stream,
+     * the last block is terminated accordingly.
+     */
+    void CompressInput( const size_t size, const bool last );
+  };
+
 private:
   /** Open decompressing pipe.
    * A suffix is appended to the desired filename, unless the name has
@@ -249,6 +412,18 @@ private:
     /// Return 1 if and only if end of file reached.
     virtual bool Feof () const = 0;
 
+    /// Get the complete contents of a memory-mapped file; the default implementation returns NULL.
+    virtual const char* GetData() const
+    {
+      return NULL;
+    }
+
+    /// Get size of the memory-mapped file contents; the default implementation returns zero.
+    virtual size_t GetDataSize() const
+    {
+      return 0;
+    }
+
   private:
     /// Block size for fake seek() operation.
     static const size_t SeekBlockSize = 8192;
@@ -308,6 +483,83 @@ private:
     FILE* m_File;    
   };
 
+#ifdef HAVE_SYS_MMAN_H
+  /** Class for reader engine on a memory-mapped uncompressed file.
+   * The whole file is mapped copy-on-write when the engine is created, and all reading, seeking, and
+   * single-character access is served from memory. A zero-filled page is mapped behind the file, so
+   * that the contents are always followed by a NULL character.
+   */
+  class Mmap
+    : public ReaderBase
+  {
+  public:
+    /// This class.
+    typedef Mmap Self;
+    
+    /// Smart pointer to this class.
+    typedef SmartPointer<Self> SmartPtr;
+
+    /** Map file into memory.
+     * An exception is thrown if the file cannot be opened or mapped, or if it is empty.
+     */
+    Mmap( const std::string& filename, const bool readOnly /*!< Map read-only rather than copy-on-write. */ );
+    
+    /// Virtual destructor.
+    virtual ~Mmap();
+
+    /// Close current file stream.
+    virtual void Close();
+    
+    /// Reset read pointer to beginning of stream.
+    virtual void Rewind();
+    
+    /** Set filepointer.
+      *\param offset Offset the file pointer is set to, depending on the value of
+      * whence.
+      *\param whence File pointer set mode as defined for fseek.
+      *\return 0 if successful, -1 if the new position would be before the beginning of the file.
+      */
+    virtual int Seek ( const long int offset, int whence );
+    
+    /// Read block of data.
+    virtual size_t Read ( void *data, size_t size, size_t count );
+    
+    /// Read a single character from the stream.
+    virtual bool Get ( char &c);
+    
+    /// Return number of bytes read from stream.
+    virtual int Tell () const;
+    
+    /// Return 1 if and only if end of file reached.
+    virtual bool Feof () const;
+
+    /// Get the complete file contents.
+    virtual const char* GetData() const
+    {
+      return this->m_Data;
+    }
+
+    /// Get size of the file contents.
+    virtual size_t GetDataSize() const
+    {
+      return this->m_Size;
+    }
+
+  private:
+    /// Start of the mapped file contents.
+    const char* m_Data;
+
+    /// Size of the file in bytes.
+    size_t m_Size;
+
+    /// Length of the complete mapping, including the zero-filled page(s) following the file.
+    size_t m_MappedLength;
+
+    /// Flag for an attempt to read past the end of the file.
+    bool m_Feof;
+  };
+#endif // #ifdef HAVE_SYS_MMAN_H
+
   /// Class for reader engine using pipe.
   class Pipe
     : public ReaderBase
@@ -444,6 +696,238 @@ private:
   };
 #endif // #ifdef CMTK_USE_LZMA
 
+  /** Class for zlib-based reader engine with random access to gzip files.
+   * While the file is decompressed, this engine records checkpoints at deflate block boundaries
+   * roughly every CheckpointSpan bytes of output, each with the 32kB of output preceding it (in the
+   * style of zlib's "zran" example). Seeking backward, or forward past the decompressed part of the
+   * file, then resumes decompression from the nearest checkpoint rather than from the start of the file.
+   *
+   * Reads of at least 32kB are decompressed directly into the caller's buffer. No checkpoints are recorded
+   * for a read that ends exactly at the end of the data as given by the gzip trailer, i.e., for a single read
+   * of the remainder of the file.
+   */
+  class ZlibIndexed
+    : public ReaderBase
+  {
+  public:
+    /// This class.
+    typedef ZlibIndexed Self;
+    
+    /// Smart pointer to this class.
+    typedef SmartPointer<Self> SmartPtr;
+
+    /// Distance between checkpoints in bytes of decompressed output.
+    static const size_t CheckpointSpan = 1 << 20;
+
+    /** Open new stream from filename.
+     * An exception is thrown if the file cannot be opened or does not start with the gzip magic number.
+     */
+    ZlibIndexed( const std::string& filename );
+    
+    /// Virtual destructor.
+    virtual ~ZlibIndexed();
+
+    /// Close current file stream.
+    virtual void Close();
+    
+    /// Reset read pointer to beginning of stream.
+    virtual void Rewind();
+    
+    /** Set filepointer.
+     * Only SEEK_SET and SEEK_CUR are supported.
+     *\return The new position in the decompressed stream, or -1 if seeking failed.
+     */
+    virtual int Seek ( const long int offset, int whence );
+    
+    /// Read block of data.
+    virtual size_t Read ( void *data, size_t size, size_t count );
+    
+    /// Read a single character from the stream.
+    virtual bool Get ( char &c);
+    
+    /// Return number of bytes read from stream.
+    virtual int Tell () const;
+    
+    /// Return 1 if and only if end of file reached.
+    virtual bool Feof () const;
+
+    /// Return the number of checkpoints recorded so far.
+    size_t GetNumberOfCheckpoints() const
+    {
+      return this->m_Checkpoints.size();
+    }
+
+  private:
+    /// Size of the deflate history window.
+    static const size_t WindowSize = 32768;
+
+    /// Size of the input buffer.
+    static const size_t InputChunkSize = 65536;
+
+    /// Checkpoint for resuming decompression.
+    class Checkpoint
+    {
+    public:
+      /// Offset in the decompressed output.
+      size_t m_Output;
+
+      /// Offset in the compressed input of the first complete byte following the checkpoint.
+      long int m_Input;
+
+      /// Number of bits of the byte preceding m_Input that belong to the data following the checkpoint.
+      int m_Bits;
+
+      /// The 32kB of output preceding the checkpoint.
+      std::vector<unsigned char> m_Window;
+    };
+
+    /// Compressed file pointer.
+    FILE* m_File;
+
+    /// zlib stream.
+    z_stream m_Stream;
+
+    /// Buffer for compressed data read from the file.
+    std::vector<unsigned char> m_InputBuffer;
+
+    /// Offset in the compressed file of the end of the input buffer contents.
+    long int m_InputOffset;
+
+    /// Circular buffer for the most recent decompressed output.
+    std::vector<unsigned char> m_Window;
+
+    /// Position in m_Window where the next decompressed output goes.
+    size_t m_WindowPosition;
+
+    /// Position in m_Window of output not yet returned by Read() or Get().
+    size_t m_PendingPosition;
+
+    /// Number of bytes of output not yet returned by Read() or Get().
+    size_t m_Pending;
+
+    /// Total offset in the decompressed output of the end of m_Window contents.
+    size_t m_Output;
+
+    /// Flag: the stream is currently decompressing raw deflate data, i.e., after resuming from a checkpoint.
+    bool m_Raw;
+
+    /// Flag for end of compressed data or decompression error.
+    bool m_EndOfInput;
+
+    /// Recorded checkpoints, in order of increasing output offset.
+    std::vector<Self::Checkpoint> m_Checkpoints;
+
+    /// Uncompressed size modulo 2^32 from the trailer of the (last member of the) gzip file.
+    size_t m_TrailerSize;
+
+    /// Flag: m_TrailerSize could be read.
+    bool m_HasTrailerSize;
+
+    /// Read more compressed data if the input buffer is empty.
+    bool FillInput();
+
+    /** Decompress up to one deflate block into a buffer.
+     *\return Number of bytes decompressed.
+     */
+    size_t Inflate( unsigned char *const output /*!< Output buffer. */, const size_t available /*!< Size of the output buffer. */, 
+		    bool& blockBoundary /*!< Set if decompression stopped at a deflate block boundary where a checkpoint can be recorded. */ );
+
+    /** Decompress more data into the window.
+     * This must only be called when there is no pending output.
+     *\return True if any data was decompressed; false at the end of the compressed data, or after an error.
+     */
+    bool Decompress();
+
+    /** Decompress data directly into a caller's buffer.
+     * This must only be called when there is no pending output. Afterwards, the window holds the end of the data.
+     *\return Number of bytes decompressed, which is less than requested only at the end of the compressed data, or after an error.
+     */
+    size_t DecompressDirect( unsigned char *const data, const size_t size );
+
+    /** Record a checkpoint at the current position if the last one is at least CheckpointSpan bytes back.
+     * The history preceding the checkpoint is taken from the window, followed by the given recent output that
+     * has not been added to the window.
+     */
+    void RecordCheckpoint( const unsigned char* recent, const size_t nRecent );
+
+    /// Append output that was decompressed directly into a caller's buffer to the window.
+    void AppendToWindow( const unsigned char* data, const size_t size );
+
+    /// Restart decompression at a checkpoint.
+    bool Resume( const Self::Checkpoint& checkpoint );
+
+    /// Discard decompressed output until the read position reaches the given offset.
+    bool SkipTo( const size_t position );
+  };
+
+#ifdef CMTK_USE_ZSTD
+  /// Class for zstd-based reader engine.
+  class Zstd
+    : public ReaderBase
+  {
+  public:
+    /// This class.
+    typedef Zstd Self;
+    
+    /// Smart pointer to this class.
+    typedef SmartPointer<Self> SmartPtr;
+
+    /// Open new stream from filename.
+    Zstd( const std::string& filename );
+    
+    /// Virtual destructor.
+    virtual ~Zstd();
+
+    /// Close current file stream.
+    virtual void Close();
+    
+    /// Reset read pointer to beginning of stream.
+    virtual void Rewind();
+    
+    /// Read block of data.
+    virtual size_t Read ( void *data, size_t size, size_t count );
+    
+    /// Read a single character from the stream.
+    virtual bool Get ( char &c);
+    
+    /// Return number of bytes read from stream.
+    virtual int Tell () const;
+    
+    /// Return 1 if and only if end of file reached.
+    virtual bool Feof () const;
+
+  private:
+    /// Compressed file pointer.
+    FILE* m_File;
+
+    /// zstd decompression stream.
+    ZSTD_DStream* m_DStream;
+
+    /// Buffer for compressed data read from the file.
+    std::vector<char> m_InputBuffer;
+
+    /// Position and size of the compressed data in the input buffer.
+    ZSTD_inBuffer m_Input;
+
+    /// Buffer for decompressed data not yet returned by Read() or Get().
+    std::vector<char> m_OutputBuffer;
+
+    /// Position of the next byte to return from the output buffer.
+    size_t m_OutputPosition;
+
+    /// Number of valid bytes in the output buffer.
+    size_t m_OutputSize;
+
+    /// Flag for end of compressed data or decompression error.
+    bool m_EndOfInput;
+
+    /** Decompress data into an output buffer.
+     *\return True if any data was decompressed; false at the end of the compressed data, or after an error.
+     */
+    bool Decompress( ZSTD_outBuffer& output );
+  };
+#endif // #ifdef CMTK_USE_ZSTD
+
   /// The low-level reader object.
   ReaderBase::SmartPtr m_Reader;
 
@@ -0,0 +1,233 @@
+/*
+//
+//  Copyright 1997-2009 Torsten Rohlfing
+//
+//  Copyright 2004-2011 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkCompressedStream.h"
+
+#include <System/cmtkThreadPool.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup System */
+//@{
+
+int CompressedStream::GzipWriter::m_DefaultLevel = Z_DEFAULT_COMPRESSION;
+
+size_t CompressedStream::GzipWriter::m_DefaultBlockSize = 128 << 10;
+
+CompressedStream::GzipWriter::GzipWriter( FILE *const file )
+  : m_File( file ),
+    m_Level( Self::m_DefaultLevel ),
+    m_BlockSize( Self::m_DefaultBlockSize ),
+    m_DictionaryLength( 0 ),
+    m_CRC( crc32( 0L, Z_NULL, 0 ) ),
+    m_TotalIn( 0 ),
+    m_Failed( false ),
+    m_Closed( false )
+{
+  this->WriteHeader();
+}
+
+CompressedStream::GzipWriter::GzipWriter( FILE *const file, const int level, const size_t blockSize )
+  : m_File( file ),
+    m_Level( level ),
+    m_BlockSize( blockSize ),
+    m_DictionaryLength( 0 ),
+    m_CRC( crc32( 0L, Z_NULL, 0 ) ),
+    m_TotalIn( 0 ),
+    m_Failed( false ),
+    m_Closed( false )
+{
+  // zlib counts input in unsigned ints, and tiny blocks would only waste compression
+  this->m_BlockSize = std::max<size_t>( Self::DictionarySize, std::min<size_t>( this->m_BlockSize, 1 << 30 ) );
+  this->WriteHeader();
+}
+
+CompressedStream::GzipWriter::~GzipWriter()
+{
+  if ( !this->m_Closed )
+    this->Close();
+}
+
+void
+CompressedStream::GzipWriter::SetDefaultParameters( const int level, const size_t blockSize )
+{
+  Self::m_DefaultLevel = level;
+  Self::m_DefaultBlockSize = std::max<size_t>( Self::DictionarySize, std::min<size_t>( blockSize, 1 << 30 ) );
+}
+
+void
+CompressedStream::GzipWriter::WriteHeader()
+{
+  // no file name or time stamp; the "extra flags" byte tells the compression level, the last byte the operating system (3 = Unix)
+  const unsigned char header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 
+				     static_cast<unsigned char>( (this->m_Level == 9) ? 2 : ((this->m_Level == 1) ? 4 : 0) ), 3 };
+  this->m_Failed = (fwrite( header, 1, sizeof( header ), this->m_File ) != sizeof( header ));
+}
+
+bool
+CompressedStream::GzipWriter::Write( const void* data, const size_t size )
+{
+  if ( this->m_Closed || this->m_Failed )
+    return false;
+
+  // each batch of blocks keeps all threads of the pool busy
+  const size_t batchSize = this->m_BlockSize * ThreadPool::GetGlobalThreadPool().GetNumberOfThreads();
+
+  const char* from = static_cast<const char*>( data );
+  for ( size_t remaining = size; remaining && !this->m_Failed; )
+    {
+    const size_t pending = this->m_Input.size() - this->m_DictionaryLength;
+    const size_t chunk = std::min( remaining, batchSize - pending );
+    this->m_Input.insert( this->m_Input.end(), from, from + chunk );
+    from += chunk;
+    remaining -= chunk;
+
+    if ( pending + chunk == batchSize )
+      this->CompressInput( batchSize, false /*last*/ );
+    }
+
+  return !this->m_Failed;
+}
+
+bool
+CompressedStream::GzipWriter::Close()
+{
+  if ( this->m_Closed )
+    return !this->m_Failed;
+  this->m_Closed = true;
+
+  if ( !this->m_Failed )
+    this->CompressInput( this->m_Input.size() - this->m_DictionaryLength, true /*last*/ );
+  
+  if ( !this->m_Failed )
+    {
+    // trailer: CRC32 and size modulo 2^32 of the uncompressed data, both little endian
+    unsigned char trailer[8];
+    for ( int byte = 0; byte < 4; ++byte )
+      {
+      trailer[byte] = static_cast<unsigned char>( (this->m_CRC >> (8*byte)) & 0xff );
+      trailer[4+byte] = static_cast<unsigned char>( (this->m_TotalIn >> (8*byte)) & 0xff );
+      }
+    this->m_Failed = (fwrite( trailer, 1, sizeof( trailer ), this->m_File ) != sizeof( trailer ));
+    }
+
+  this->m_Input.clear();
+  this->m_DictionaryLength = 0;
+  return !this->m_Failed;
+}
+
+void
+CompressedStream::GzipWriter::CompressInput( const size_t size, const bool last )
+{
+  if ( !size && !last )
+    return;
+
+  // the final block may be empty, but it must be there to terminate the deflate stream
+  const size_t numberOfBlocks = std::max<size_t>( 1, (size + this->m_BlockSize - 1) / this->m_BlockSize );
+
+  const char* input = this->m_Input.empty() ? NULL : &this->m_Input[0];
+  std::vector<Self::BlockTask> tasks( numberOfBlocks );
+  for ( size_t block = 0; block < numberOfBlocks; ++block )
+    {
+    const size_t from = this->m_DictionaryLength + block * this->m_BlockSize;
+    tasks[block].m_DictionaryLength = std::min<size_t>( from, Self::DictionarySize );
+    tasks[block].m_Dictionary = input + from - tasks[block].m_DictionaryLength;
+    tasks[block].m_Data = input + from;
+    tasks[block].m_Size = std::min<size_t>( this->m_BlockSize, size - block * this->m_BlockSize );
+    tasks[block].m_Level = this->m_Level;
+    tasks[block].m_Last = last && (block == numberOfBlocks - 1);
+    }
+
+  ThreadPool::GetGlobalThreadPool().Run( Self::CompressBlockThread, tasks );
+
+  for ( size_t block = 0; (block < numberOfBlocks) && !this->m_Failed; ++block )
+    {
+    const Self::BlockTask& task = tasks[block];
+    this->m_Failed = !task.m_Success || (fwrite( &task.m_Output[0], 1, task.m_Output.size(), this->m_File ) != task.m_Output.size());
+    this->m_CRC = crc32_combine( this->m_CRC, task.m_CRC, task.m_Size );
+    this->m_TotalIn += task.m_Size;
+    }
+
+  // keep the end of the compressed data as the dictionary for the next block
+  const size_t consumed = this->m_DictionaryLength + size;
+  const size_t keep = std::min<size_t>( consumed, Self::DictionarySize );
+  this->m_Input.erase( this->m_Input.begin(), this->m_Input.begin() + (consumed - keep) );
+  this->m_DictionaryLength = keep;
+}
+
+void
+CompressedStream::GzipWriter::CompressBlockThread( void *const args, const size_t, const size_t, const size_t, const size_t )
+{
+  Self::BlockTask* task = static_cast<Self::BlockTask*>( args );
+  task->m_Success = false;
+  task->m_CRC = crc32( crc32( 0L, Z_NULL, 0 ), reinterpret_cast<const Bytef*>( task->m_Data ), static_cast<uInt>( task->m_Size ) );
+
+  // raw deflate data without zlib header, which becomes part of a single gzip member
+  z_stream stream;
+  memset( &stream, 0, sizeof( stream ) );
+  if ( deflateInit2( &stream, task->m_Level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    return;
+
+  if ( task->m_DictionaryLength )
+    deflateSetDictionary( &stream, reinterpret_cast<const Bytef*>( task->m_Dictionary ), static_cast<uInt>( task->m_DictionaryLength ) );
+
+  // all but the last block end with a sync flush, which aligns them to a byte boundary without terminating the stream
+  const int flush = task->m_Last ? Z_FINISH : Z_SYNC_FLUSH;
+  task->m_Output.resize( deflateBound( &stream, task->m_Size ) + 16 );
+
+  stream.next_in = reinterpret_cast<Bytef*>( const_cast<char*>( task->m_Data ) );
+  stream.avail_in = static_cast<uInt>( task->m_Size );
+
+  int result = Z_OK;
+  do
+    {
+    if ( stream.total_out == task->m_Output.size() )
+      task->m_Output.resize( 2 * task->m_Output.size() );
+
+    stream.next_out = reinterpret_cast<Bytef*>( &task->m_Output[stream.total_out] );
+    stream.avail_out = static_cast<uInt>( task->m_Output.size() - stream.total_out );
+    result = deflate( &stream, flush );
+    }
+  while ( (result == Z_OK) && (stream.avail_out == 0) );
+
+  task->m_Output.resize( stream.total_out );
+  task->m_Success = task->m_Last ? (result == Z_STREAM_END) : ((result == Z_OK) || (result == Z_BUF_ERROR)) && !stream.avail_in;
+  deflateEnd( &stream );
+}
+
+} // namespace cmtk
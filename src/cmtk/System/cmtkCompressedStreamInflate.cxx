@@ -0,0 +1,144 @@
+/*
+//
+//  Copyright 1997-2009 Torsten Rohlfing
+//
+//  Copyright 2004-2011 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include "cmtkCompressedStream.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
+#ifdef CMTK_USE_LIBDEFLATE
+#  include <libdeflate.h>
+#endif
+
+namespace
+cmtk
+{
+
+/** \addtogroup System */
+//@{
+
+bool
+CompressedStream::InflateGzip( const void* data, const size_t size, std::vector<char>& output )
+{
+  const unsigned char* input = static_cast<const unsigned char*>( data );
+
+  // smallest possible gzip member: 10 bytes header, 2 bytes empty deflate stream, 8 bytes trailer
+  if ( (size < 20) || (input[0] != 0x1f) || (input[1] != 0x8b) )
+    return false;
+
+  // The trailer holds the uncompressed size modulo 2^32. For the usual single-member file of less than
+  // 4 GB, this is exactly the size of the output.
+  const size_t expectedSize = 
+    static_cast<size_t>( input[size-4] ) | (static_cast<size_t>( input[size-3] ) << 8) | 
+    (static_cast<size_t>( input[size-2] ) << 16) | (static_cast<size_t>( input[size-1] ) << 24);
+
+  // deflate cannot compress by more than a factor of about 1032, so a larger announced size is not trusted
+  const bool plausibleSize = (expectedSize / 1032 <= size);
+
+#ifdef CMTK_USE_LIBDEFLATE
+  struct libdeflate_decompressor* decompressor = plausibleSize ? libdeflate_alloc_decompressor() : NULL;
+  if ( decompressor )
+    {
+    // one spare byte, so that callers can terminate text without reallocating
+    output.reserve( expectedSize + 1 );
+    output.resize( std::max<size_t>( expectedSize, 1 ) );
+
+    size_t consumed = 0, produced = 0;
+    const enum libdeflate_result result = libdeflate_gzip_decompress_ex( decompressor, input, size, &output[0], output.size(), &consumed, &produced );
+    libdeflate_free_decompressor( decompressor );
+    
+    // anything but a single member that fills exactly the announced size is left to zlib
+    if ( (result == LIBDEFLATE_SUCCESS) && (consumed == size) && (produced == expectedSize) )
+      {
+      output.resize( produced );
+      return true;
+      }
+    }
+#endif // #ifdef CMTK_USE_LIBDEFLATE
+  
+  z_stream stream;
+  memset( &stream, 0, sizeof( stream ) );
+  if ( inflateInit2( &stream, 15 + 16 /* gzip format only */ ) != Z_OK )
+    return false;
+
+  const size_t initialSize = plausibleSize ? expectedSize : 4 * size;
+  output.reserve( initialSize + 1 );
+  output.resize( std::max<size_t>( initialSize, 1 ) );
+
+  size_t consumed = 0, produced = 0;
+  bool success = false;
+  while ( true )
+    {
+    if ( produced == output.size() )
+      output.resize( 2 * output.size() );
+
+    // zlib counts with 32-bit integers, so feed large buffers in pieces
+    stream.next_in = const_cast<Bytef*>( input + consumed );
+    stream.avail_in = static_cast<uInt>( std::min<size_t>( size - consumed, std::numeric_limits<uInt>::max() ) );
+    stream.next_out = reinterpret_cast<Bytef*>( &output[produced] );
+    stream.avail_out = static_cast<uInt>( std::min<size_t>( output.size() - produced, std::numeric_limits<uInt>::max() ) );
+
+    const uInt availIn = stream.avail_in;
+    const uInt availOut = stream.avail_out;
+    const int result = inflate( &stream, Z_NO_FLUSH );
+    consumed += availIn - stream.avail_in;
+    produced += availOut - stream.avail_out;
+
+    if ( result == Z_STREAM_END )
+      {
+      // another member follows if the remaining input starts with a gzip header; anything else is
+      // ignored as trailing garbage, as gzread() does.
+      if ( (size - consumed >= 2) && (input[consumed] == 0x1f) && (input[consumed+1] == 0x8b) )
+	{
+	if ( inflateReset( &stream ) != Z_OK )
+	  break;
+	continue;
+	}
+
+      success = true;
+      break;
+      }
+
+    // a buffer error with room left for output means the input is truncated
+    if ( ((result != Z_OK) && (result != Z_BUF_ERROR)) || ((result == Z_BUF_ERROR) && (produced < output.size()) && (consumed == size)) )
+      break;
+    }
+
+  inflateEnd( &stream );
+  output.resize( success ? produced : 0 );
+
+  return success;
+}
+
+} // namespace cmtk
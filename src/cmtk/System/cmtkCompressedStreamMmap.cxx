@@ -0,0 +1,203 @@
+/*
+//
+//  Copyright 1997-2009 Torsten Rohlfing
+//
+//  Copyright 2004-2011 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include <System/cmtkCompressedStream.h>
+
+#ifdef HAVE_SYS_MMAN_H
+
+#include <string.h>
+
+#ifdef HAVE_SYS_TYPES_H
+#  include <sys/types.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+
+#include <sys/mman.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup System */
+//@{
+
+CompressedStream::Mmap::Mmap( const std::string& filename, const bool readOnly )
+  : m_Data( NULL ),
+    m_Size( 0 ),
+    m_MappedLength( 0 ),
+    m_Feof( false )
+{
+  const int fd = open( filename.c_str(), O_RDONLY );
+  if ( fd < 0 )
+    {
+    throw 0;
+    }
+
+  struct stat buf;
+  if ( fstat( fd, &buf ) || ((buf.st_mode & S_IFREG) != S_IFREG) || (buf.st_size <= 0) )
+    {
+    close( fd );
+    throw 0;
+    }
+  this->m_Size = buf.st_size;
+
+  // Reserve address space for the file plus at least one byte, rounded up to whole pages, as an anonymous
+  // zero-filled mapping. The file is then mapped over the beginning of it, which leaves a NULL character
+  // following the contents even if the file size is a multiple of the page size.
+  const size_t pageSize = sysconf( _SC_PAGESIZE );
+  this->m_MappedLength = ((this->m_Size / pageSize) + 1) * pageSize;
+
+  void* reserved = mmap( NULL, this->m_MappedLength, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0 );
+  if ( reserved == MAP_FAILED )
+    {
+    close( fd );
+    throw 0;
+    }
+
+  void* mapped = mmap( reserved, this->m_Size, readOnly ? PROT_READ : PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 );
+  close( fd );
+  if ( mapped == MAP_FAILED )
+    {
+    munmap( reserved, this->m_MappedLength );
+    throw 0;
+    }
+
+  this->m_Data = static_cast<const char*>( mapped );
+}
+
+CompressedStream::Mmap::~Mmap()
+{
+  this->Close();
+}
+
+void 
+CompressedStream::Mmap::Close()
+{
+  if ( this->m_Data )
+    {
+    munmap( const_cast<char*>( this->m_Data ), this->m_MappedLength );
+    this->m_Data = NULL;
+    this->m_Size = this->m_MappedLength = 0;
+    }
+}
+
+void
+CompressedStream::Mmap::Rewind () 
+{
+  this->m_Feof = false;
+  this->CompressedStream::ReaderBase::Rewind();
+}
+
+int
+CompressedStream::Mmap::Seek ( const long int offset, int whence ) 
+{
+  long int position = offset;
+  switch ( whence )
+    {
+    case SEEK_SET:
+      break;
+    case SEEK_CUR:
+      position += this->m_BytesRead;
+      break;
+    case SEEK_END:
+      position += this->m_Size;
+      break;
+    default:
+      return -1;
+    }
+
+  if ( position < 0 )
+    return -1;
+  
+  // as with fseek(), the position may be past the end of the file, in which case subsequent reads return no data
+  this->m_BytesRead = position;
+  this->m_Feof = false;
+  return 0;
+}
+
+size_t
+CompressedStream::Mmap::Read( void *data, size_t size, size_t count ) 
+{
+  if ( !size || !count )
+    return 0;
+
+  const size_t available = (this->m_BytesRead < this->m_Size) ? this->m_Size - this->m_BytesRead : 0;
+  size_t itemsRead = count;
+  if ( itemsRead > available / size )
+    {
+    itemsRead = available / size;
+    this->m_Feof = true;
+    }
+
+  if ( itemsRead )
+    {
+    memcpy( data, this->m_Data + this->m_BytesRead, itemsRead * size );
+    this->m_BytesRead += itemsRead * size;
+    }
+  return itemsRead;
+}
+
+bool
+CompressedStream::Mmap::Get ( char &c)
+{
+  if ( this->m_BytesRead < this->m_Size ) 
+    {
+    c = this->m_Data[this->m_BytesRead++];
+    return true;
+    }
+
+  this->m_Feof = true;
+  return false;
+}
+
+int
+CompressedStream::Mmap::Tell () const 
+{
+  return this->m_BytesRead;
+}
+
+bool
+CompressedStream::Mmap::Feof () const 
+{
+  return this->m_Feof;
+}
+
+} // namespace cmtk
+
+#endif // #ifdef HAVE_SYS_MMAN_H
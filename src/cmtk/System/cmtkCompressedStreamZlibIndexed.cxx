@@ -0,0 +1,432 @@
+/*
+//
+//  Copyright 1997-2009 Torsten Rohlfing
+//
+//  Copyright 2004-2011 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include <System/cmtkCompressedStream.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup System */
+//@{
+
+CompressedStream::ZlibIndexed::ZlibIndexed( const std::string& filename )
+  : m_File( NULL ),
+    m_InputBuffer( Self::InputChunkSize ),
+    m_InputOffset( 0 ),
+    m_Window( Self::WindowSize ),
+    m_WindowPosition( 0 ),
+    m_PendingPosition( 0 ),
+    m_Pending( 0 ),
+    m_Output( 0 ),
+    m_Raw( false ),
+    m_EndOfInput( false ),
+    m_TrailerSize( 0 ),
+    m_HasTrailerSize( false )
+{
+  this->m_File = fopen( filename.c_str(), "rb" );
+  if ( !this->m_File ) 
+    {
+    throw 0;
+    }
+
+  // only actual gzip files are handled here; anything else is left to the plain Zlib engine
+  unsigned char magic[2];
+  if ( (fread( magic, 1, 2, this->m_File ) != 2) || (magic[0] != 0x1f) || (magic[1] != 0x8b) )
+    {
+    fclose( this->m_File );
+    throw 0;
+    }
+
+  // the gzip trailer holds the size of the (last member's) uncompressed data modulo 2^32
+  unsigned char trailer[4];
+  if ( !fseek( this->m_File, -4, SEEK_END ) && (fread( trailer, 1, 4, this->m_File ) == 4) )
+    {
+    this->m_TrailerSize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | (static_cast<size_t>( trailer[3] ) << 24);
+    this->m_HasTrailerSize = true;
+    }
+  rewind( this->m_File );
+
+  memset( &this->m_Stream, 0, sizeof( this->m_Stream ) );
+  if ( inflateInit2( &this->m_Stream, 15 + 32 ) != Z_OK )
+    {
+    fclose( this->m_File );
+    throw 0;
+    }
+}
+
+CompressedStream::ZlibIndexed::~ZlibIndexed()
+{
+  this->Close();
+}
+
+void 
+CompressedStream::ZlibIndexed::Close()
+{
+  if ( this->m_File )
+    {
+    inflateEnd( &this->m_Stream );
+    fclose( this->m_File );
+    this->m_File = NULL;
+    }
+}
+
+void
+CompressedStream::ZlibIndexed::Rewind () 
+{
+  rewind( this->m_File );
+  inflateReset2( &this->m_Stream, 15 + 32 );
+  this->m_Stream.avail_in = 0;
+  this->m_InputOffset = 0;
+
+  this->m_WindowPosition = this->m_PendingPosition = this->m_Pending = 0;
+  this->m_Output = 0;
+  this->m_Raw = false;
+  this->m_EndOfInput = false;
+
+  this->CompressedStream::ReaderBase::Rewind();
+}
+
+bool
+CompressedStream::ZlibIndexed::FillInput()
+{
+  if ( this->m_Stream.avail_in )
+    return true;
+
+  const size_t bytesRead = fread( &this->m_InputBuffer[0], 1, this->m_InputBuffer.size(), this->m_File );
+  this->m_Stream.next_in = &this->m_InputBuffer[0];
+  this->m_Stream.avail_in = bytesRead;
+  this->m_InputOffset += bytesRead;
+
+  return (bytesRead != 0);
+}
+
+size_t
+CompressedStream::ZlibIndexed::Inflate( unsigned char *const output, const size_t available, bool& blockBoundary )
+{
+  blockBoundary = false;
+  if ( ! this->FillInput() )
+    {
+    this->m_EndOfInput = true;
+    return 0;
+    }
+
+  this->m_Stream.next_out = output;
+  this->m_Stream.avail_out = available;
+
+  const int result = inflate( &this->m_Stream, Z_BLOCK );
+
+  const size_t produced = available - this->m_Stream.avail_out;
+  this->m_Output += produced;
+
+  if ( result == Z_STREAM_END )
+    {
+    // Another gzip member may follow. In raw mode, i.e., after resuming from a checkpoint, zlib does
+    // not consume the member's trailer, so skip it here.
+    if ( this->m_Raw )
+      {
+      for ( int i = 0; (i < 8) && this->FillInput(); ++i )
+	{
+	++this->m_Stream.next_in;
+	--this->m_Stream.avail_in;
+	}
+      }
+    inflateReset2( &this->m_Stream, 15 + 32 );
+    this->m_Raw = false;
+    }
+  else if ( (result != Z_OK) && (result != Z_BUF_ERROR) )
+    {
+    // damaged data, or trailing garbage after the last member
+    this->m_EndOfInput = true;
+    }
+  else
+    {
+    // at a deflate block boundary other than after the last block
+    blockBoundary = (this->m_Stream.data_type & 128) && !(this->m_Stream.data_type & 64);
+    }
+
+  return produced;
+}
+
+bool
+CompressedStream::ZlibIndexed::Decompress()
+{
+  if ( this->m_WindowPosition == Self::WindowSize )
+    this->m_WindowPosition = 0;
+  this->m_PendingPosition = this->m_WindowPosition;
+
+  while ( !this->m_EndOfInput && !this->m_Pending )
+    {
+    bool blockBoundary;
+    const size_t produced = this->Inflate( &this->m_Window[this->m_WindowPosition], Self::WindowSize - this->m_WindowPosition, blockBoundary );
+    this->m_WindowPosition += produced;
+    this->m_Pending += produced;
+
+    if ( blockBoundary )
+      this->RecordCheckpoint( NULL, 0 );
+
+    if ( this->m_WindowPosition == Self::WindowSize )
+      break;
+    }
+
+  return (this->m_Pending != 0);
+}
+
+size_t
+CompressedStream::ZlibIndexed::DecompressDirect( unsigned char *const data, const size_t size )
+{
+  // A read that ends exactly where the trailer says the data end covers the rest of the file in one go, so its
+  // caller does not need to seek back into it, and the checkpoints would only cost memory and copying.
+  const bool checkpoints = !this->m_HasTrailerSize || (((this->m_Output + size) & 0xffffffff) != this->m_TrailerSize);
+
+  size_t produced = 0;
+  while ( !this->m_EndOfInput && (produced < size) )
+    {
+    bool blockBoundary;
+    produced += this->Inflate( data + produced, size - produced, blockBoundary );
+
+    if ( blockBoundary && checkpoints )
+      this->RecordCheckpoint( data, produced );
+    }
+
+  this->AppendToWindow( data, produced );
+  return produced;
+}
+
+void
+CompressedStream::ZlibIndexed::RecordCheckpoint( const unsigned char* recent, const size_t nRecent )
+{
+  const size_t nextCheckpoint = this->m_Checkpoints.empty() ? Self::CheckpointSpan : this->m_Checkpoints.back().m_Output + Self::CheckpointSpan;
+  if ( this->m_Output < nextCheckpoint )
+    return;
+
+  Self::Checkpoint checkpoint;
+  checkpoint.m_Output = this->m_Output;
+  checkpoint.m_Input = this->m_InputOffset - this->m_Stream.avail_in;
+  checkpoint.m_Bits = this->m_Stream.data_type & 7;
+  checkpoint.m_Window.reserve( Self::WindowSize );
+
+  // the oldest part of the history comes from the window, in order from its oldest byte
+  if ( nRecent < Self::WindowSize )
+    {
+    const size_t fromWindow = Self::WindowSize - nRecent;
+    const size_t from = (this->m_WindowPosition + nRecent) % Self::WindowSize;
+    if ( from + fromWindow <= Self::WindowSize )
+      {
+      checkpoint.m_Window.insert( checkpoint.m_Window.end(), this->m_Window.begin() + from, this->m_Window.begin() + from + fromWindow );
+      }
+    else
+      {
+      checkpoint.m_Window.insert( checkpoint.m_Window.end(), this->m_Window.begin() + from, this->m_Window.end() );
+      checkpoint.m_Window.insert( checkpoint.m_Window.end(), this->m_Window.begin(), this->m_Window.begin() + (from + fromWindow - Self::WindowSize) );
+      }
+    checkpoint.m_Window.insert( checkpoint.m_Window.end(), recent, recent + nRecent );
+    }
+  else
+    {
+    checkpoint.m_Window.insert( checkpoint.m_Window.end(), recent + nRecent - Self::WindowSize, recent + nRecent );
+    }
+
+  this->m_Checkpoints.push_back( checkpoint );
+}
+
+void
+CompressedStream::ZlibIndexed::AppendToWindow( const unsigned char* data, const size_t size )
+{
+  if ( size >= Self::WindowSize )
+    {
+    memcpy( &this->m_Window[0], data + size - Self::WindowSize, Self::WindowSize );
+    this->m_WindowPosition = Self::WindowSize;
+    return;
+    }
+
+  if ( this->m_WindowPosition == Self::WindowSize )
+    this->m_WindowPosition = 0;
+
+  const size_t first = std::min( size, Self::WindowSize - this->m_WindowPosition );
+  memcpy( &this->m_Window[this->m_WindowPosition], data, first );
+  memcpy( &this->m_Window[0], data + first, size - first );
+  this->m_WindowPosition = (size > first) ? (size - first) : (this->m_WindowPosition + first);
+}
+
+bool
+CompressedStream::ZlibIndexed::Resume( const Self::Checkpoint& checkpoint )
+{
+  this->m_InputOffset = checkpoint.m_Input - (checkpoint.m_Bits ? 1 : 0);
+  if ( fseek( this->m_File, this->m_InputOffset, SEEK_SET ) )
+    return false;
+
+  inflateReset2( &this->m_Stream, -15 );
+  this->m_Stream.avail_in = 0;
+  this->m_Raw = true;
+
+  if ( checkpoint.m_Bits )
+    {
+    const int c = getc( this->m_File );
+    if ( c == EOF )
+      return false;
+    ++this->m_InputOffset;
+    inflatePrime( &this->m_Stream, checkpoint.m_Bits, c >> (8 - checkpoint.m_Bits) );
+    }
+  inflateSetDictionary( &this->m_Stream, &checkpoint.m_Window[0], Self::WindowSize );
+
+  // the window continues with the checkpoint's history, so that later checkpoints can be recorded
+  this->m_Window = checkpoint.m_Window;
+  this->m_WindowPosition = Self::WindowSize;
+  this->m_PendingPosition = this->m_Pending = 0;
+  this->m_Output = this->m_BytesRead = checkpoint.m_Output;
+  this->m_EndOfInput = false;
+
+  return true;
+}
+
+bool
+CompressedStream::ZlibIndexed::SkipTo( const size_t position )
+{
+  while ( this->m_BytesRead < position )
+    {
+    if ( this->m_Pending )
+      {
+      const size_t n = std::min( this->m_Pending, position - this->m_BytesRead );
+      this->m_PendingPosition += n;
+      this->m_Pending -= n;
+      this->m_BytesRead += n;
+      }
+    else
+      {
+      if ( ! this->Decompress() )
+	return false;
+      }
+    }
+  return true;
+}
+
+int
+CompressedStream::ZlibIndexed::Seek ( const long int offset, int whence ) 
+{
+  long int target = offset;
+  if ( whence == SEEK_CUR )
+    target += this->m_BytesRead;
+  else if ( whence != SEEK_SET )
+    return -1;
+
+  if ( target < 0 )
+    return -1;
+
+  // find the last checkpoint at or before the target position
+  const Self::Checkpoint* checkpoint = NULL;
+  for ( size_t i = 0; (i < this->m_Checkpoints.size()) && (this->m_Checkpoints[i].m_Output <= static_cast<size_t>( target )); ++i )
+    checkpoint = &this->m_Checkpoints[i];
+
+  if ( static_cast<size_t>( target ) < this->m_BytesRead )
+    {
+    if ( checkpoint )
+      {
+      if ( ! this->Resume( *checkpoint ) )
+	return -1;
+      }
+    else
+      {
+      this->Rewind();
+      }
+    }
+  else if ( checkpoint && (checkpoint->m_Output > this->m_Output) )
+    {
+    if ( ! this->Resume( *checkpoint ) )
+      return -1;
+    }
+
+  if ( ! this->SkipTo( target ) )
+    return -1;
+
+  return this->m_BytesRead;
+}
+
+size_t
+CompressedStream::ZlibIndexed::Read( void *data, size_t size, size_t count ) 
+{
+  unsigned char* dest = static_cast<unsigned char*>( data );
+  const size_t total = size * count;
+
+  size_t result = 0;
+  while ( result < total )
+    {
+    if ( this->m_Pending )
+      {
+      const size_t n = std::min( total - result, this->m_Pending );
+      memcpy( dest + result, &this->m_Window[this->m_PendingPosition], n );
+      this->m_PendingPosition += n;
+      this->m_Pending -= n;
+      result += n;
+      }
+    else if ( total - result >= Self::WindowSize )
+      {
+      // large reads are decompressed straight into the caller's buffer rather than through the window
+      const size_t n = this->DecompressDirect( dest + result, total - result );
+      if ( ! n )
+	break;
+      result += n;
+      }
+    else
+      {
+      if ( ! this->Decompress() )
+	break;
+      }
+    }
+
+  this->m_BytesRead += result;
+  return result / size;
+}
+
+bool
+CompressedStream::ZlibIndexed::Get ( char &c)
+{
+  return (this->Read( &c, sizeof( char ), 1 ) == 1);
+}
+
+int
+CompressedStream::ZlibIndexed::Tell () const 
+{
+  return this->m_BytesRead;
+}
+
+bool
+CompressedStream::ZlibIndexed::Feof () const 
+{
+  return this->m_EndOfInput && !this->m_Pending;
+}
+
+} // namespace cmtk
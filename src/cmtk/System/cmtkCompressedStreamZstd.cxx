@@ -0,0 +1,191 @@
+/*
+//
+//  Copyright 1997-2009 Torsten Rohlfing
+//
+//  Copyright 2004-2011 SRI International
+//
+//  This file is part of the Computational Morphometry Toolkit.
+//
+//  http://www.nitrc.org/projects/cmtk/
+//
+//  The Computational Morphometry Toolkit is free software: you can
+//  redistribute it and/or modify it under the terms of the GNU General Public
+//  License as published by the Free Software Foundation, either version 3 of
+//  the License, or (at your option) any later version.
+//
+//  The Computational Morphometry Toolkit is distributed in the hope that it
+//  will be useful, but WITHOUT ANY WARRANTY; without even the implied
+//  warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License along
+//  with the Computational Morphometry Toolkit.  If not, see
+//  <http://www.gnu.org/licenses/>.
+//
+//  $Revision$
+//
+//  $LastChangedDate$
+//
+//  $LastChangedBy$
+//
+*/
+
+#include <System/cmtkCompressedStream.h>
+
+#ifdef CMTK_USE_ZSTD
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace
+cmtk
+{
+
+/** \addtogroup System */
+//@{
+
+CompressedStream::Zstd::Zstd( const std::string& filename )
+  : m_File( NULL ),
+    m_DStream( NULL ),
+    m_InputBuffer( ZSTD_DStreamInSize() ),
+    m_OutputBuffer( ZSTD_DStreamOutSize() ),
+    m_OutputPosition( 0 ),
+    m_OutputSize( 0 ),
+    m_EndOfInput( false )
+{
+  this->m_File = fopen( filename.c_str(), "rb" );
+  if ( !this->m_File ) 
+    {
+    throw 0;
+    }
+
+  this->m_DStream = ZSTD_createDStream();
+  if ( !this->m_DStream )
+    {
+    fclose( this->m_File );
+    throw 0;
+    }
+  ZSTD_initDStream( this->m_DStream );
+
+  this->m_Input.src = &this->m_InputBuffer[0];
+  this->m_Input.size = this->m_Input.pos = 0;
+}
+
+CompressedStream::Zstd::~Zstd()
+{
+  this->Close();
+}
+
+void 
+CompressedStream::Zstd::Close()
+{
+  if ( this->m_DStream )
+    {
+    ZSTD_freeDStream( this->m_DStream );
+    this->m_DStream = NULL;
+    }
+
+  if ( this->m_File )
+    {
+    fclose( this->m_File );
+    this->m_File = NULL;
+    }
+}
+
+void
+CompressedStream::Zstd::Rewind () 
+{
+  rewind( this->m_File );
+  ZSTD_initDStream( this->m_DStream );
+
+  this->m_Input.size = this->m_Input.pos = 0;
+  this->m_OutputPosition = this->m_OutputSize = 0;
+  this->m_EndOfInput = false;
+
+  this->CompressedStream::ReaderBase::Rewind();
+}
+
+bool
+CompressedStream::Zstd::Decompress( ZSTD_outBuffer& output )
+{
+  while ( !this->m_EndOfInput && (output.pos == 0) )
+    {
+    if ( this->m_Input.pos == this->m_Input.size )
+      {
+      this->m_Input.size = fread( &this->m_InputBuffer[0], 1, this->m_InputBuffer.size(), this->m_File );
+      this->m_Input.pos = 0;
+
+      // at the end of the file, the decoder may still hold output from earlier input
+      this->m_EndOfInput = (this->m_Input.size == 0);
+      }
+
+    if ( ZSTD_isError( ZSTD_decompressStream( this->m_DStream, &output, &this->m_Input ) ) )
+      {
+      this->m_EndOfInput = true;
+      return false;
+      }
+    }
+
+  return (output.pos != 0);
+}
+
+size_t
+CompressedStream::Zstd::Read( void *data, size_t size, size_t count ) 
+{
+  char* dest = static_cast<char*>( data );
+  const size_t total = size * count;
+
+  size_t result = 0;
+  while ( result < total )
+    {
+    if ( this->m_OutputPosition < this->m_OutputSize )
+      {
+      const size_t n = std::min( total - result, this->m_OutputSize - this->m_OutputPosition );
+      memcpy( dest + result, &this->m_OutputBuffer[this->m_OutputPosition], n );
+      this->m_OutputPosition += n;
+      result += n;
+      }
+    else if ( total - result >= this->m_OutputBuffer.size() )
+      {
+      // large reads are decompressed directly into the destination
+      ZSTD_outBuffer output = { dest + result, total - result, 0 };
+      if ( ! this->Decompress( output ) )
+	break;
+      result += output.pos;
+      }
+    else
+      {
+      ZSTD_outBuffer output = { &this->m_OutputBuffer[0], this->m_OutputBuffer.size(), 0 };
+      if ( ! this->Decompress( output ) )
+	break;
+      this->m_OutputPosition = 0;
+      this->m_OutputSize = output.pos;
+      }
+    }
+
+  this->m_BytesRead += result;
+  return result / size;
+}
+
+bool
+CompressedStream::Zstd::Get ( char &c)
+{
+  return (this->Read( &c, sizeof( char ), 1 ) == 1);
+}
+
+int
+CompressedStream::Zstd::Tell () const 
+{
+  return this->m_BytesRead;
+}
+
+bool
+CompressedStream::Zstd::Feof () const 
+{
+  return this->m_EndOfInput && (this->m_OutputPosition == this->m_OutputSize);
+}
+
+} // namespace cmtk
+
+#endif // #ifdef CMTK_USE_ZSTD
@@ -55,6 +55,7 @@
 #endif
 
 #include <iostream>
+#include <vector>
 
 namespace 
 cmtk
@@ -85,23 +86,15 @@ int
 RecursiveMkPrefixDir
 ( const std::string& filename, const int permissions )
 {
-  char prefix[PATH_MAX];
-  for ( unsigned i=0; filename[i]; ++i ) 
+  std::string prefix;
+  prefix.reserve( filename.length() );
+  for ( size_t i=0; i < filename.length(); ++i ) 
     {
     if ( (filename[i] == CMTK_PATH_SEPARATOR) || (filename[i] == '/') ) 
       {
-      prefix[i+1] = 0;
-      if ( i ) // do not delete single "/" or "\"
-	prefix[i] = 0;
-      else
-	prefix[i] = CMTK_PATH_SEPARATOR;
+      // do not delete single "/" or "\"
+      const std::string directory = i ? prefix : std::string( 1, CMTK_PATH_SEPARATOR );
       
-#ifdef _WIN32
-      if ( (i > 0) && (prefix[i-1] == ':') )
-	{
-	prefix[i] = '\\';
-	}
-#endif
 #ifdef _WIN32
       int result = 0;
       // NOTE(fschulze@vrvis.at): prevent to call mkdir on drive letters
@@ -114,17 +107,17 @@ RecursiveMkPrefixDir
       const bool isDrive = (i == 2) && (prefix[1] == ':');
       if (!isDrive)
 	{
-        result = mkdir( prefix );
+        result = mkdir( directory.c_str() );
 	}
 #else
-      const int result = mkdir( prefix, permissions );
+      const int result = mkdir( directory.c_str(), permissions );
 #endif
       if ( result && errno != EEXIST && errno != EISDIR ) 
 	{
 	return result;
 	}
       }
-    prefix[i] = filename[i];
+    prefix.push_back( filename[i] );
     }
   return 0;
 }
@@ -133,22 +126,39 @@ std::string
 GetAbsolutePath( const std::string& relPath )
 {
 #ifdef _MSC_VER
-  char absPath[PATH_MAX];
-  GetFullPathName( relPath.c_str(), PATH_MAX, absPath, NULL );
-  return std::string( absPath );
+  std::vector<char> absPath( PATH_MAX );
+  const DWORD length = GetFullPathName( relPath.c_str(), absPath.size(), &absPath[0], NULL );
+  if ( length >= absPath.size() )
+    {
+    // buffer was too small; the return value is the required size including the terminating null
+    absPath.resize( length );
+    GetFullPathName( relPath.c_str(), absPath.size(), &absPath[0], NULL );
+    }
+  return std::string( &absPath[0] );
 #else
-  if ( relPath[0] == CMTK_PATH_SEPARATOR )
+  if ( !relPath.empty() && (relPath[0] == CMTK_PATH_SEPARATOR) )
     {
     return relPath;
     }
   else
     {
-    char absPath[PATH_MAX];
-    if ( getcwd( absPath, PATH_MAX ) == NULL ) absPath[0] = '\0';
-    if ( absPath[ strlen( absPath )-1 ] != CMTK_PATH_SEPARATOR )
-      strcat( absPath, CMTK_PATH_SEPARATOR_STR );
+    // grow the buffer until the working directory fits, so that deep directories are not truncated
+    std::vector<char> cwd( PATH_MAX );
+    while ( getcwd( &cwd[0], cwd.size() ) == NULL )
+      {
+      if ( errno != ERANGE )
+	{
+	cwd[0] = '\0';
+	break;
+	}
+      cwd.resize( 2 * cwd.size() );
+      }
+
+    std::string absPath( &cwd[0] );
+    if ( absPath.empty() || (absPath[absPath.length()-1] != CMTK_PATH_SEPARATOR) )
+      absPath.push_back( CMTK_PATH_SEPARATOR );
     
-    return std::string( absPath ) + relPath;
+    return absPath + relPath;
     }
 #endif
 }
@@ -161,7 +171,7 @@ Basename( const std::string& path, const std::string& suffix )
   // if given, and if present, remove suffix
   if ( ! suffix.empty() && (basename.length() >= suffix.length() ) )
     {
-    if ( basename.compare( basename.length() - suffix.length(), suffix.length(), suffix ) )
+    if ( basename.compare( basename.length() - suffix.length(), suffix.length(), suffix ) == 0 )
       {
       basename = basename.substr( 0, basename.length() - suffix.length() );
       }
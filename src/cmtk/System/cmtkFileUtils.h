@@ -45,6 +45,8 @@ cmtk
 //@{
 
 /** Utility functions for file and directory access.
+ * None of these functions use static storage or limit the length of paths, so they may be called
+ * concurrently from multiple threads.
  */
 namespace FileUtils
 {
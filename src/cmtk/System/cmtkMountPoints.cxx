@@ -32,9 +32,11 @@
 
 #include "cmtkMountPoints.h"
 
+#include <System/cmtkMutexLock.h>
+#include <System/cmtkSmartConstPtr.h>
+
 #include <stdlib.h>
-#include <string.h>
-#include <limits.h>
+#include <vector>
 
 namespace
 cmtk
@@ -43,6 +45,63 @@ cmtk
 /** \addtogroup System */
 //@{
 
+namespace
+{
+
+/// One substitution rule from the mount points variable.
+struct MountPointRule
+{
+  /// The string to search for, without a leading '^'.
+  std::string m_Pattern;
+
+  /// The string that replaces the pattern.
+  std::string m_Replacement;
+
+  /// Flag: only substitute the pattern at the beginning of a path.
+  bool m_PrefixOnly;
+};
+
+/// Table of substitution rules in the order in which they are applied.
+typedef std::vector<MountPointRule> MountPointRuleTable;
+
+/// Parse a comma-separated list of "search=replace" rules.
+MountPointRuleTable*
+ParseMountPoints( const std::string& definition )
+{
+  MountPointRuleTable* table = new MountPointRuleTable;
+
+  size_t ruleStart = 0;
+  while ( ruleStart < definition.length() )
+    {
+    size_t ruleEnd = definition.find( ',', ruleStart );
+    if ( ruleEnd == std::string::npos )
+      ruleEnd = definition.length();
+
+    // rules without an equation sign, or with an empty pattern, cannot be applied
+    const size_t delim = definition.find( '=', ruleStart );
+    if ( (delim != std::string::npos) && (delim < ruleEnd) )
+      {
+      MountPointRule rule;
+      rule.m_Pattern = definition.substr( ruleStart, delim - ruleStart );
+      rule.m_Replacement = definition.substr( delim + 1, ruleEnd - delim - 1 );
+
+      // check for beginning-of-line token
+      rule.m_PrefixOnly = ! rule.m_Pattern.empty() && (rule.m_Pattern[0] == '^');
+      if ( rule.m_PrefixOnly )
+	rule.m_Pattern.erase( 0, 1 );
+
+      if ( ! rule.m_Pattern.empty() )
+	table->push_back( rule );
+      }
+
+    ruleStart = ruleEnd + 1;
+    }
+
+  return table;
+}
+
+} // anonymous namespace
+
 std::string
 MountPoints::Translate( const std::string& path )
 {
@@ -57,59 +116,41 @@ MountPoints::Translate( const std::string& path )
       return path;
     }
 
-  std::string buffer = path;
+  // The rules are parsed only when the variable changes. Each call holds its own reference to the table,
+  // so the table can be replaced while other threads are still applying it.
+  static MutexLock cacheLock;
+  static std::string cachedDefinition;
+  static SmartConstPointer<MountPointRuleTable> cachedTable( new MountPointRuleTable );
 
-  const char *nextRule = mountpoints;
-  while ( nextRule ) 
+  cacheLock.Lock();
+  if ( cachedDefinition != mountpoints )
     {
-    // find the equation sign between pattern and replacement
-    const char* delim = strchr( nextRule, '=' );
-    if ( delim ) 
-      {
-      const int cplen = delim - nextRule;
-      const std::string pattern = std::string( nextRule ).substr( 0, cplen );
-      std::string replacement = std::string( delim+1 );
+    cachedDefinition = mountpoints;
+    cachedTable = SmartConstPointer<MountPointRuleTable>( ParseMountPoints( cachedDefinition ) );
+    }
+  const SmartConstPointer<MountPointRuleTable> table = cachedTable;
+  cacheLock.Unlock();
 
-      // see if there's another replacement rule following
-      nextRule = strchr( delim, ',' );
-      if ( nextRule ) 
-	{
-	/// if there is, remove it from the replacement string
-	const int cplenNext = nextRule - delim - 1;
-	replacement = replacement.substr( 0, cplenNext );
-	nextRule++;
-	} 
-      else
-	{
-	nextRule = NULL;
-	}
-      
-      // check for beginning-of-line token
-      bool checkPrefixOnly = false;
-      if ( pattern[0] == '^' ) 
+  std::string buffer = path;
+  for ( MountPointRuleTable::const_iterator it = table->begin(); it != table->end(); ++it )
+    {
+    if ( it->m_PrefixOnly ) 
+      {
+      // Check if rule applies to given path.
+      if ( path.compare( 0, it->m_Pattern.length(), it->m_Pattern ) == 0 ) 
 	{
-	checkPrefixOnly = true;
+	// Yes, it does: Substitute prefix accordingly.
+	buffer.replace( 0, it->m_Pattern.length(), it->m_Replacement );
 	}
-      
-      if ( checkPrefixOnly ) 
-	{
-	// Check if rule applies to given path.
-	if ( path.substr( 0, pattern.length() - 1 ) == pattern.substr( 1 ) ) 
-	  {
-	  // Yes, it does: Substitute prefix accordingly and return pointer
-	  // to buffer containing modified path.
-	  buffer = buffer.replace( 0, pattern.length() - 1, replacement );
-	  }
-	} 
-      else
+      } 
+    else
+      {
+      // Substitute non-prefix occurences as well
+      size_t found = buffer.find( it->m_Pattern );
+      while ( found != std::string::npos )
 	{
-	// Substitute non-prefix occurences as well
-	size_t found = buffer.find( pattern );
-	while ( found != std::string::npos )
-	  {
-	  buffer = buffer.replace( found, pattern.length(), replacement );
-	  found = buffer.find( pattern, found + replacement.length() ); // search after replaced string to avoid infinite recursive replacement
-	  }
+	buffer.replace( found, it->m_Pattern.length(), it->m_Replacement );
+	found = buffer.find( it->m_Pattern, found + it->m_Replacement.length() ); // search after replaced string to avoid infinite recursive replacement
 	}
       }
     }
@@ -80,19 +80,12 @@ class MountPoints
 public:
   /** Perform directory substitutions.
    *\param path The original path before substitions.
-   *\return A pointer to a static buffer holding the path after all substitions
-   * have been done. The buffer is guaranteed to remain unchanged until and 
-   * only until the next time Translate() is called.
-   *\todo There is really no reason why we parse the environment variable every time a
-   * substitution is (potentially) performed. Instead, it should be parsed once and then
-   * simply re-applied.
+   *\return The path after all substitions have been done. The substitution rules
+   * are parsed once and cached until the environment variable changes. This function
+   * may be called concurrently from multiple threads.
    *\see CMTK_MOUNTPOINTSVAR
    */
   static std::string Translate ( const std::string& path );
-
-private:
-  /// Static buffer holding paths after pattern substitution.
-  static char Buffer[PATH_MAX];
 };
 
 //@}
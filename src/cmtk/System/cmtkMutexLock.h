@@ -97,6 +97,22 @@ public:
 #endif
   }
 
+  /** Try to lock without waiting.
+   *\return True if the lock was acquired, false if it is held by another thread.
+   */
+  bool TryLock()
+  {
+#if defined(CMTK_USE_PTHREADS)
+    return !pthread_mutex_trylock( &this->m_MutexLock );
+#else
+#ifdef _MSC_VER
+    return TryEnterCriticalSection( &this->m_MutexObject ) != 0;
+#else
+    return true;
+#endif
+#endif
+  }
+
   /// Unlock.
   void Unlock() 
   {
@@ -51,6 +51,9 @@ namespace
 cmtk
 {
 
+/// Flag that is set for threads started by a thread pool.
+static thread_local bool ThreadPoolThreadsIsPooledThread = false;
+
 ThreadPoolThreads::ThreadPoolThreads( const size_t nThreads )
   : m_NumberOfTasks( 0 ),
     m_NextTaskIndex( 0 ),
@@ -173,6 +176,8 @@ ThreadPoolThreads::ThreadFunction( const size_t threadIdx )
 #endif
 
 #ifdef CMTK_USE_SMP
+  ThreadPoolThreadsIsPooledThread = true;
+
   // wait for task waiting
   this->m_TaskWaitingSemaphore.Wait();
   while ( this->m_ContinueThreads )
@@ -195,6 +200,12 @@ ThreadPoolThreads::ThreadFunction( const size_t threadIdx )
 #endif // #ifdef CMTK_USE_SMP
 }
 
+bool
+ThreadPoolThreads::IsPooledThread()
+{
+  return ThreadPoolThreadsIsPooledThread;
+}
+
 ThreadPoolThreads& 
 ThreadPoolThreads::GetGlobalThreadPool()
 {
@@ -144,12 +144,20 @@ public:
     return this->m_NumberOfThreads;
   }
 
-  /// Run actual worker functions through running threads.
+  /** Run actual worker functions through running threads.
+   * If this is called from a task that is itself running on a pooled thread, the tasks are run sequentially
+   * on the calling thread instead, because the pool's threads may all be busy with tasks that are waiting
+   * for this call to complete. The same happens if another thread of the application is currently running
+   * tasks on this pool, so this function can safely be called from several threads at once.
+   */
   template<class TParam> 
   void Run( Self::TaskFunction taskFunction /*!< Pointer to task function.*/,
 	    std::vector<TParam>& taskParameters /*!< Vector of task parameter blocks, one per task.*/,
 	    const size_t numberOfTasksOverride = 0 /*!< This can be used to run a smaller number of tasks than taskParameters.size(), which is useful to allow re-use of larger, allocated vector.*/ );
 
+  /// Test whether the calling thread is a pooled thread of any thread pool.
+  static bool IsPooledThread();
+
   /** Get reference to global thread pool.
    * This is shared by all functions in the process and allows re-use of the same "physical" threads 
    * for all types of computations. The thread pool itself is a local static instance within this
@@ -193,6 +201,9 @@ private:
   /// Lock to ensure exclusive access to the task index counter.
   MutexLock m_NextTaskIndexLock;
 
+  /// Lock held by the thread that is currently running tasks on this pool.
+  MutexLock m_RunLock;
+
   /// The current task function.
   Self::TaskFunction m_TaskFunction;
 
@@ -44,17 +44,30 @@ void
 cmtk::ThreadPoolThreads::Run
 ( const Self::TaskFunction taskFunction, std::vector<TParam>& taskParameters, const size_t numberOfTasksOverride )
 {
-  if ( ! this->m_ThreadsRunning )
-    {
-    this->StartThreads();
-    }
-
   const size_t numberOfTasks = numberOfTasksOverride ? numberOfTasksOverride : taskParameters.size();
   if ( ! numberOfTasks )
     {
     Rf_error("ERROR: trying to run zero tasks on thread pool. Did you forget to resize the parameter vector?");
     }
 
+#ifdef CMTK_USE_SMP
+  // a task running on a pooled thread must not wait for other pooled threads, and the tasks of another application
+  // thread that is using the pool must not be replaced, so in both cases run the tasks right here.
+  if ( Self::IsPooledThread() || ! this->m_RunLock.TryLock() )
+    {
+    for ( size_t idx = 0; idx < numberOfTasks; ++idx )
+      {
+      taskFunction( &taskParameters[idx], idx, numberOfTasks, 0, 1 );
+      }
+    return;
+    }
+#endif
+
+  if ( ! this->m_ThreadsRunning )
+    {
+    this->StartThreads();
+    }
+
 #ifdef _OPENMP
   // if OpenMP is also used in CMTK, reduce the number of OMP threads by the number of threads/tasks that we're about to run in parallel.
   const int nThreadsOMP = std::max<int>( 1, 1+Threads::GetNumberOfThreads() - std::min<int>( numberOfTasks, this->m_NumberOfThreads ) );
@@ -82,6 +95,8 @@ cmtk::ThreadPoolThreads::Run
     {
     this->m_ThreadWaitingSemaphore.Wait();
     }
+
+  this->m_RunLock.Unlock();
 #else
   // without SMP, just run everything sequentially.
   for ( size_t idx = 0; idx < numberOfTasks; ++idx )
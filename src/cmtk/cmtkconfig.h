@@ -73,6 +73,7 @@
 #define HAVE_SYS_IOCTL_H 1
 #define HAVE_SYS_TIMES_H 1
 #define HAVE_SYS_UTSNAME_H 1
+#define HAVE_SYS_MMAN_H 1
 #define HAVE_TERMIOS_H 1
 #endif
 
@@ -0,0 +1,119 @@
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <string>
+
+using namespace Rcpp;
+
+#include <cmtkconfig.h>
+#include <Base/cmtkXform.h>
+#include <Base/cmtkSplineWarpXform.h>
+#include <IO/cmtkXformIO.h>
+#include <IO/cmtkGroupwiseRegistrationArchive.h>
+
+//' convert a CMTK registration to another file format
+//'
+//' @details The output format is determined by the suffix of \code{output}.
+//'   The suffix \verb{.xfb} selects the CMTK binary transformation format,
+//'   which stores coefficients as raw binary data and loads much faster than
+//'   the text-based \verb{.list} directories written by CMTK registration
+//'   tools. The suffixes \verb{.nii} and \verb{.nii.gz} write a NIfTI
+//'   displacement field, which can be read by other software. Warp
+//'   registrations are sampled for this on a grid with four points per control
+//'   point interval, so the field closely approximates, but does not exactly
+//'   reproduce, the original warp. All other suffixes write a legacy CMTK
+//'   TypedStream file, which is gzip-compressed if \code{output} ends in
+//'   \verb{.gz}, e.g. \verb{registration.gz} inside a \verb{.list} directory.
+//'   Compressed files, including \verb{.nii.gz}, are compressed in parallel
+//'   blocks. Binary registrations and NIfTI displacement fields can be used
+//'   anywhere a registration path is accepted, e.g. by
+//'   \code{\link{streamxform}}.
+//'
+//'   If \code{bbox} is given, a warp registration is cropped to the control
+//'   points that support the given region before it is written. The cropped
+//'   warp gives the same results as the original inside the region, and
+//'   points outside its (slightly larger) domain are not transformed. This
+//'   reduces the size of warps for data that only cover part of the
+//'   reference space. Cropped warps, like other warps whose domain does not
+//'   start at the coordinate origin (e.g. some ITK B-spline transforms), are
+//'   read back correctly from any format by cmtkr, but upstream CMTK tools
+//'   and nat ignore the grid origin stored in legacy TypedStream files, so a
+//'   warning is given when writing such a warp in that format.
+//'
+//'   If \code{subject} is given, \code{reg} is read as a groupwise
+//'   registration archive, which holds a template grid and one transformation
+//'   per subject, and only the transformation of the given subject is read
+//'   and written to \code{output}.
+//' @param reg Path to a single registration, e.g. a \verb{.list} directory.
+//' @param output Path of the registration file to write.
+//' @param bbox Optional bounding box of the region to keep, given as a 2x3
+//'   matrix with the minimum and maximum of the x, y and z coordinates in its
+//'   rows (e.g. as returned by \code{nat::boundingbox}), or as the equivalent
+//'   vector \code{c(xmin, xmax, ymin, ymax, zmin, zmax)}.
+//' @param subject Optional (1-based) index of the subject whose
+//'   transformation is taken from the groupwise registration archive
+//'   \code{reg}.
+//' @return The path \code{output}, invisibly.
+//' @export
+//' @examples
+//' reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+//' xfb=tempfile(fileext=".xfb")
+//' convertreg(reg, xfb)
+//' m=matrix(rnorm(30,mean = 50), ncol=3)
+//' all.equal(streamxform(m, xfb), streamxform(m, reg))
+//' unlink(xfb)
+// [[Rcpp::export(invisible = true)]]
+std::string convertreg(std::string reg, std::string output,
+  RObject bbox = R_NilValue, RObject subject = R_NilValue) {
+  cmtk::Xform::SmartConstPtr xform;
+  if (subject.isNULL()) {
+    xform = cmtk::XformIO::Read(reg);
+  } else {
+    const int idx = as<int>(subject);
+    cmtk::GroupwiseRegistrationArchive archive(reg);
+    if (!archive.IsValid()) {
+      Rcpp::stop("Unable to read groupwise registration: " + reg);
+    }
+    if (idx < 1 || static_cast<size_t>(idx) > archive.GetNumberOfSubjects()) {
+      Rcpp::stop("subject must be between 1 and " +
+        std::to_string(archive.GetNumberOfSubjects()) + ": " + reg);
+    }
+    xform = archive.GetXform(idx - 1);
+  }
+  if (!xform) {
+    Rcpp::stop("Unable to read registration: " + reg);
+  }
+  if (!bbox.isNULL()) {
+    NumericVector bb(bbox);
+    if (bb.size() != 6) {
+      Rcpp::stop("bbox must be a 2x3 matrix or a vector of 6 coordinates");
+    }
+    cmtk::SplineWarpXform::SmartConstPtr warp =
+      cmtk::SplineWarpXform::SmartConstPtr::DynamicCastFrom(xform);
+    if (!warp) {
+      Rcpp::stop("bbox can only be used with warp registrations: " + reg);
+    }
+    cmtk::Xform::SpaceVectorType from, to;
+    for (int dim = 0; dim < 3; dim++) {
+      from[dim] = std::min(bb[2*dim], bb[2*dim+1]);
+      to[dim] = std::max(bb[2*dim], bb[2*dim+1]);
+    }
+    xform = warp->GetCropped(cmtk::UniformVolume::CoordinateRegionType(from, to));
+    if (!xform) {
+      Rcpp::stop("bbox does not overlap the domain of registration: " + reg);
+    }
+  }
+  // upstream CMTK and nat ignore the stored grid origin of TypedStream warps
+  cmtk::SplineWarpXform::SmartConstPtr warp =
+    cmtk::SplineWarpXform::SmartConstPtr::DynamicCastFrom(xform);
+  if (warp && !warp->HasZeroDomainOrigin() &&
+      cmtk::XformIO::IsTypedStreamPath(output)) {
+    Rcpp::warning("The domain of this warp does not start at the origin, "
+      "which other CMTK tools ignore when reading %s. Use an .xfb file "
+      "to share it.", output);
+  }
+  if (!cmtk::XformIO::Write(xform, output)) {
+    Rcpp::stop("Unable to write registration: " + output);
+  }
+  return output;
+}
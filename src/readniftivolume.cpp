@@ -0,0 +1,44 @@
+#include <Rcpp.h>
+
+#include <string>
+
+using namespace Rcpp;
+
+#include <cmtkconfig.h>
+#include <Base/cmtkUniformVolume.h>
+#include <IO/cmtkVolumeFromFile.h>
+#include <System/cmtkCompressedStream.h>
+
+//' read the first 3D volume of a NIfTI image
+//'
+//' @details Single-file images (\verb{.nii}, \verb{.nii.gz}) and detached
+//'   header and image pairs (given by the \verb{.hdr} or \verb{.hdr.gz} path)
+//'   are read. Uncompressed native-endian voxel data are used directly from a
+//'   read-only file mapping; all other images are read into memory.
+//' @param path Path of the image.
+//' @return A 3D numeric array of voxel values with a \code{spacing}
+//'   attribute holding the voxel size.
+//' @noRd
+// [[Rcpp::export]]
+NumericVector readniftivolume(std::string path) {
+  const std::string base = cmtk::CompressedStream::GetBaseName(path);
+  const bool detached = (base.length() > 4) &&
+    (base.compare(base.length() - 4, 4, ".hdr") == 0);
+  cmtk::UniformVolume::SmartPtr volume =
+    cmtk::VolumeFromFile::ReadNifti(path, detached);
+  if (!volume || !volume->GetData()) {
+    Rcpp::stop("Unable to read NIfTI image: " + path);
+  }
+
+  const cmtk::TypedArray& data = *(volume->GetData());
+  NumericVector values(data.GetDataSize());
+  for (size_t i = 0; i < data.GetDataSize(); i++) {
+    cmtk::Types::DataItem value;
+    values[i] = data.Get(value, i) ? value : NA_REAL;
+  }
+  values.attr("dim") = IntegerVector::create(volume->m_Dims[0],
+    volume->m_Dims[1], volume->m_Dims[2]);
+  values.attr("spacing") = NumericVector::create(volume->m_Delta[0],
+    volume->m_Delta[1], volume->m_Delta[2]);
+  return values;
+}
@@ -1,5 +1,10 @@
 #include <Rcpp.h>
 
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 using namespace Rcpp;
 
 #include <cmtkconfig.h>
@@ -8,18 +13,103 @@ using namespace Rcpp;
 #include <IO/cmtkXformIO.h>
 #include <IO/cmtkXformListIO.h>
 
+// Append registrations given as a character vector of paths and flags, or as a
+// raw vector with the contents of a registration file, to a transformation list.
+// Raw vectors are referenced rather than copied, so must outlive the entries.
+static void appendRegistrations(std::vector<cmtk::XformListIO::Entry>& entries,
+  SEXP reg, R_xlen_t position) {
+  if (TYPEOF(reg) == STRSXP) {
+    std::vector<std::string> regvec = Rcpp::as<std::vector<std::string> >(reg);
+    entries.insert(entries.end(), regvec.begin(), regvec.end());
+  } else if (TYPEOF(reg) == RAWSXP) {
+    RawVector raw(reg);
+    std::ostringstream name;
+    name << "raw vector (reglist element " << position << ")";
+    entries.push_back(cmtk::XformListIO::Entry(RAW(raw), raw.size(), name.str()));
+  } else {
+    Rcpp::stop("reglist must be a character vector, a raw vector, or a list of these");
+  }
+}
+
+// Collect the registrations given to streamxform() into a transformation list.
+static std::vector<cmtk::XformListIO::Entry> collectRegistrations(RObject reglist) {
+  std::vector<cmtk::XformListIO::Entry> entries;
+  if (TYPEOF(reglist) == VECSXP) {
+    List regs(reglist);
+    for (R_xlen_t i = 0; i < regs.size(); i++) {
+      appendRegistrations(entries, regs[i], i + 1);
+    }
+  } else {
+    appendRegistrations(entries, reglist, 1);
+  }
+  return entries;
+}
+
+// Read registrations and transform points in place. This does not use the R
+// API, so it can run on any thread.
+static void transformPoints(const std::vector<cmtk::XformListIO::Entry>& entries,
+  std::vector<cmtk::Xform::SpaceVectorType>& xyz, bool* valid,
+  double inversionTolerance, bool affineonly, bool compact) {
+  // for affine-only use, warp coefficients are not even read
+  cmtk::XformList xformList = cmtk::XformListIO::MakeFromList(entries, affineonly,
+    compact);
+  xformList.SetEpsilon( cmtk::Types::Coordinate(inversionTolerance) );
+
+  if (affineonly) {
+    xformList = xformList.MakeAllAffine();
+  } else {
+    xformList.PrecomputeInverses(xyz.size());
+  }
+
+  if (!xyz.empty()) {
+    xformList.ApplyInPlace( &xyz[0], valid, xyz.size() );
+  }
+}
+
 //' transform 3D points using one or more CMTK registrations
 //'
 //' @details To transform points from sample to reference space, you will need
 //'   to use the inverse transformation. This can be achieved by preceding the
 //'   registration with a \verb{--inverse} flag. When multiple registrations are
 //'   being used the are ordered from sample to reference brain.
+//'
+//'   Registrations can also be given as raw vectors holding the contents of a
+//'   registration file, e.g. the \verb{registration} file inside a \verb{.list}
+//'   directory, a CMTK binary \verb{.xfb} file, or an ITK \verb{.tfm} file,
+//'   optionally gzip-compressed. These are read directly from memory without
+//'   writing temporary files. To mix paths, flags and raw vectors, pass them as
+//'   a list, e.g. \code{list("--inverse", rawreg, reg)}.
+//'
+//'   Dense displacement fields stored as NIfTI vector images (\verb{.nii} or
+//'   \verb{.nii.gz} files with intent code \verb{NIFTI_INTENT_DISPVECT}), e.g.
+//'   as written by \code{\link{convertreg}} or other registration software,
+//'   can be used like any other registration. Displacements must be given in
+//'   the same world coordinates as the grid defined by the image header.
+//'
+//'   Vector images in NRRD format (\verb{.nrrd} files, or \verb{.nhdr} headers
+//'   with a separate data file) holding \verb{float} or \verb{double}
+//'   displacements with raw or gzip encoding are read in the same way.
+//'   Uncompressed \verb{double} fields with the vector axis first are used
+//'   directly from the file without copying.
+//'
+//'   ITK transform files (\verb{.tfm}) may hold affine transforms, a
+//'   B-spline transform (\verb{BSplineTransform} or
+//'   \verb{BSplineDeformableTransform}), or a composite transform in which
+//'   any affine transforms are applied after a single B-spline transform.
+//'   These are read into an equivalent CMTK warp, with coordinates taken as
+//'   they are in the file.
 //' @param points an Nx3 matrix of 3D points
-//' @param reglist A character vector specifying registrations. See details.
+//' @param reglist A character vector specifying registrations, a raw vector
+//'   holding the contents of a single registration file, or a list of these.
+//'   See details.
 //' @param inversionTolerance the precision of the numerical inversion when
 //'   transforming in the inverse direction.
 //' @param affineonly Whether to apply only the affine portion of transforms
 //'   default \code{FALSE}.
+//' @param compact Whether to hold warp coefficients in a compact 16 bit
+//'   representation, which needs a quarter of the memory. This changes
+//'   transformed coordinates by much less than a micron for typical warps.
+//'   Default \code{FALSE}.
 //' @return An Nx3 numeric matrix with the same dimensions as \code{points}
 //'   containing transformed coordinates. Rows for points that cannot be
 //'   transformed are returned as \code{NA_real_}.
@@ -33,37 +123,42 @@ using namespace Rcpp;
 //' # from sample to reference
 //' streamxform(m, c("--inverse", reg))
 //'
+//' # from the contents of a registration file held in memory
+//' regfile=file.path(reg, "registration.gz")
+//' rawreg=readBin(regfile, what="raw", n=file.size(regfile))
+//' streamxform(m, rawreg)
+//' streamxform(m, list("--inverse", rawreg))
+//'
 //' \dontrun{
 //' # concatenating 3 registrations to map S -> B1 -> B2 -> T
 //' # the first two registrations are inverted, the last is not.
 //' streamxform(m, c("--inverse", StoB1, "--inverse", B1toB2, TtoB2))
 //' }
 // [[Rcpp::export]]
-NumericMatrix streamxform(NumericMatrix points, CharacterVector reglist,
-  double inversionTolerance=1e-8, bool affineonly = false) {
-  std::vector<std::string> regvec = Rcpp::as<std::vector<std::string> >(reglist);
-  cmtk::XformList xformList = cmtk::XformListIO::MakeFromStringList(regvec);
+NumericMatrix streamxform(NumericMatrix points, RObject reglist,
+  double inversionTolerance=1e-8, bool affineonly = false,
+  bool compact = false) {
+  std::vector<cmtk::XformListIO::Entry> entries = collectRegistrations(reglist);
 
   int nrow = points.nrow();
   int ncol = points.ncol();
   NumericMatrix pointst(nrow, ncol);
 
-  cmtk::Xform::SpaceVectorType xyz;
-
-  xformList.SetEpsilon( cmtk::Types::Coordinate(inversionTolerance) );
-
-  if (affineonly) {
-    xformList = xformList.MakeAllAffine();
-  }
-
+  std::vector<cmtk::Xform::SpaceVectorType> xyz(nrow);
+  std::unique_ptr<bool[]> valid(new bool[nrow]);
   for (int j = 0; j < nrow; j++) {
     for (int i = 0; i < ncol; i++) {
-      xyz[i]=points(j,i);
+      xyz[j][i]=points(j,i);
     }
-    const bool valid = xformList.ApplyInPlace( xyz );
+  }
+
+  transformPoints(entries, xyz, valid.get(), inversionTolerance, affineonly,
+    compact);
+
+  for (int j = 0; j < nrow; j++) {
     for (int i = 0; i < ncol; i++) {
-      if(valid){
-        pointst(j,i)=xyz[i];
+      if(valid[j]){
+        pointst(j,i)=xyz[j][i];
       } else {
         pointst(j,i)=NA_REAL;
       }
@@ -71,3 +166,64 @@ NumericMatrix streamxform(NumericMatrix points, CharacterVector reglist,
   }
   return pointst;
 }
+
+//' transform 3D points on several threads at once
+//'
+//' @details Each thread reads the registrations and transforms all points by
+//'   itself, as independent threads of an application sharing the library
+//'   would. This is used to test that reading and transforming are thread-safe.
+//' @param threads Number of threads.
+//' @inheritParams streamxform
+//' @return A list with one matrix per thread, each as returned by
+//'   \code{streamxform}.
+//' @noRd
+// [[Rcpp::export]]
+List streamxformconcurrent(NumericMatrix points, RObject reglist, int threads,
+  double inversionTolerance=1e-8) {
+  std::vector<cmtk::XformListIO::Entry> entries = collectRegistrations(reglist);
+
+  const int nrow = points.nrow();
+  std::vector<cmtk::Xform::SpaceVectorType> xyz(nrow);
+  for (int j = 0; j < nrow; j++) {
+    for (int i = 0; i < 3; i++) {
+      xyz[j][i]=points(j,i);
+    }
+  }
+
+  // worker threads must not call the R API, so results are converted afterwards
+  std::vector< std::vector<cmtk::Xform::SpaceVectorType> > results(threads, xyz);
+  std::vector< std::unique_ptr<bool[]> > valid(threads);
+  for (int t = 0; t < threads; t++) {
+    valid[t].reset(new bool[nrow]);
+  }
+  std::vector<char> failed(threads, 0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.push_back(std::thread([&, t]() {
+      try {
+        transformPoints(entries, results[t], valid[t].get(),
+          inversionTolerance, false, false);
+      } catch (...) {
+        failed[t] = 1;
+      }
+    }));
+  }
+  for (size_t t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+
+  List out(threads);
+  for (int t = 0; t < threads; t++) {
+    if (failed[t]) {
+      Rcpp::stop("Unable to transform points on thread %d", t + 1);
+    }
+    NumericMatrix pointst(nrow, 3);
+    for (int j = 0; j < nrow; j++) {
+      for (int i = 0; i < 3; i++) {
+        pointst(j,i) = valid[t][j] ? results[t][j][i] : NA_REAL;
+      }
+    }
+    out[t] = pointst;
+  }
+  return out;
+}
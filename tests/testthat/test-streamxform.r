@@ -21,3 +21,417 @@ test_that("compare with nat",{
   expect_equal(streamxform(m, reg, affineonly = TRUE),
                nat::xform(m, reg, direction='forward', transformtype='affine'))
 })
+
+test_that("binary registrations give identical results",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(xfb))
+  expect_equal(convertreg(reg, xfb), xfb)
+  expect_true(file.exists(xfb))
+
+  m=matrix(rnorm(300,mean = 50), ncol=3)
+  expect_identical(streamxform(m, xfb), streamxform(m, reg))
+  expect_identical(streamxform(m, c("--inverse", xfb)),
+                   streamxform(m, c("--inverse", reg)))
+  expect_identical(streamxform(m, xfb, affineonly = TRUE),
+                   streamxform(m, reg, affineonly = TRUE))
+})
+
+test_that("registrations can be read from raw vectors",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  regfile=file.path(reg, "registration.gz")
+  rawreg=readBin(regfile, what="raw", n=file.size(regfile))
+
+  m=matrix(rnorm(300,mean = 50), ncol=3)
+  expect_identical(streamxform(m, rawreg), streamxform(m, reg))
+  expect_identical(streamxform(m, list("--inverse", rawreg)),
+                   streamxform(m, c("--inverse", reg)))
+
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(xfb))
+  convertreg(reg, xfb)
+  rawxfb=readBin(xfb, what="raw", n=file.size(xfb))
+  expect_identical(streamxform(m, list(rawxfb, "--inverse", reg)),
+                   streamxform(m, c(xfb, "--inverse", reg)))
+
+  expect_error(streamxform(m, 1))
+})
+
+test_that("warps can be exported and read as NIfTI displacement fields",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  nii=tempfile(fileext=".nii.gz")
+  nii2=tempfile(fileext=".nii")
+  on.exit(unlink(c(nii, nii2)))
+  expect_equal(convertreg(reg, nii), nii)
+  expect_true(file.exists(nii))
+
+  # the displacement field approximates the spline warp
+  m=matrix(rnorm(300,mean = 50), ncol=3)
+  expect_equal(streamxform(m, nii), streamxform(m, reg), tolerance=1e-2)
+  expect_equal(streamxform(streamxform(m, nii), c("--inverse", nii)), m,
+               tolerance=1e-4, info="round trip test")
+
+  # displacement fields are written as they are
+  convertreg(nii, nii2)
+  expect_identical(streamxform(m, nii2), streamxform(m, nii))
+
+  # displacement fields have no affine component
+  expect_equal(streamxform(m, nii, affineonly=TRUE), m)
+})
+
+test_that("NIfTI displacement fields can be written as compressed header and image pairs",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  nii=tempfile(fileext=".nii")
+  base=tempfile()
+  on.exit(unlink(c(nii, paste0(base, c(".hdr.gz", ".img.gz")))))
+  convertreg(reg, nii)
+  expect_equal(convertreg(reg, paste0(base, ".hdr.gz")), paste0(base, ".hdr.gz"))
+  expect_true(all(file.exists(paste0(base, c(".hdr.gz", ".img.gz")))))
+
+  m=matrix(rnorm(300,mean = 50), ncol=3)
+  expect_identical(streamxform(m, paste0(base, ".hdr.gz")), streamxform(m, nii))
+})
+
+test_that("NRRD displacement fields can be read",{
+  nrrd=tempfile(fileext=".nrrd")
+  nhdr=tempfile(fileext=".nhdr")
+  rawgz=sub("\\.nhdr$", ".raw.gz", nhdr)
+  on.exit(unlink(c(nrrd, nhdr, rawgz)))
+
+  # constant displacement on a 3x3x3 grid, vector axis first
+  header=c("NRRD0004", "type: double", "dimension: 4", "sizes: 3 3 3 3",
+           "kinds: vector domain domain domain", "endian: little",
+           "space dimension: 3",
+           "space directions: none (10,0,0) (0,10,0) (0,0,10)",
+           "space origin: (0,0,0)")
+  disp=rep(c(1, 2, 3), 27)
+
+  con=file(nrrd, open="wb")
+  writeLines(c(header, "encoding: raw", ""), con, sep="\n")
+  writeBin(disp, con, size=8, endian="little")
+  close(con)
+
+  writeLines(c(header, "encoding: gzip", paste("data file:", basename(rawgz))),
+             nhdr, sep="\n")
+  con=gzfile(rawgz, open="wb")
+  writeBin(disp, con, size=8, endian="little")
+  close(con)
+
+  m=matrix(c(5, 10, 15, 12, 8, 4), ncol=3, byrow=TRUE)
+  expected=sweep(m, 2, c(1, 2, 3), "+")
+  expect_equal(streamxform(m, nrrd), expected)
+  expect_equal(streamxform(m, nhdr), expected)
+  rawnrrd=readBin(nrrd, what="raw", n=file.size(nrrd))
+  expect_equal(streamxform(m, rawnrrd), expected)
+
+  # anatomical spaces are accepted and displacements used as stored; invalid
+  # sizes and spaces without anatomical orientation are rejected
+  withheader=function(...) {
+    h=header
+    for (field in list(...)) {
+      key=sub(":.*", ":", field)
+      # a named space replaces the space dimension
+      drop=startsWith(h, key) | (key == "space:" & startsWith(h, "space dimension:"))
+      h=c(h[!drop], field)
+    }
+    con=rawConnection(raw(), open="wb")
+    writeLines(c(h, "encoding: raw", ""), con, sep="\n")
+    writeBin(disp, con, size=8, endian="little")
+    on.exit(close(con))
+    rawConnectionValue(con)
+  }
+  expect_equal(streamxform(m, withheader("space: left-posterior-superior")), expected)
+  expect_equal(streamxform(m, withheader("space: RAS")), expected)
+  expect_error(streamxform(m, withheader("space: scanner-xyz")))
+  expect_error(streamxform(m, withheader("sizes: 3 3 0 3")))
+  expect_error(streamxform(m, withheader("sizes: 3 3 -3 3")))
+})
+
+test_that("ITK B-spline transforms can be read",{
+  tfm=tempfile(fileext=".tfm")
+  composite=tempfile(fileext=".tfm")
+  on.exit(unlink(c(tfm, composite)))
+
+  # constant displacement on a 5x5x5 control point grid with domain [0,20]^3
+  bspline=c("Transform: BSplineTransform_double_3_3",
+            paste("Parameters:", paste(rep(c(1, 2, 3), each=125), collapse=" ")),
+            "FixedParameters: 5 5 5 -10 -10 -10 10 10 10 1 0 0 0 1 0 0 0 1")
+  writeLines(c("#Insight Transform File V1.0", "#Transform 0", bspline), tfm)
+
+  # the affine transformation is applied after the B-spline
+  writeLines(c("#Insight Transform File V1.0", "#Transform 0",
+               "Transform: CompositeTransform_double_3", "#Transform 1",
+               "Transform: AffineTransform_double_3_3",
+               "Parameters: 1 0 0 0 1 0 0 0 1 5 0 0",
+               "FixedParameters: 0 0 0", "#Transform 2", bspline), composite)
+
+  m=matrix(c(5, 10, 15, 12, 8, 4), ncol=3, byrow=TRUE)
+  expect_equal(streamxform(m, tfm), sweep(m, 2, c(1, 2, 3), "+"))
+  expect_equal(streamxform(m, composite), sweep(m, 2, c(6, 2, 3), "+"))
+  expect_equal(streamxform(streamxform(m, composite), c("--inverse", composite)),
+               m, tolerance=1e-6)
+  rawtfm=readBin(tfm, what="raw", n=file.size(tfm))
+  expect_equal(streamxform(m, rawtfm), streamxform(m, tfm))
+})
+
+test_that("registrations can be written gzip-compressed",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  listdir=tempfile(fileext=".list")
+  on.exit(unlink(listdir, recursive=TRUE))
+  dir.create(listdir)
+  file.copy(file.path(reg, "studylist"), listdir)
+  gz=file.path(listdir, "registration.gz")
+  expect_equal(convertreg(reg, gz), gz)
+  expect_true(file.exists(gz))
+  expect_false(file.exists(file.path(listdir, "registration")))
+
+  # the result is a standard gzip file
+  expect_match(readLines(gz, n=1), "TYPEDSTREAM")
+
+  m=matrix(rnorm(300,mean = 50), ncol=3)
+  expect_identical(streamxform(m, listdir), streamxform(m, reg))
+})
+
+test_that("warps can be cropped to a bounding box",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(xfb))
+  bbox=matrix(c(100, 50, 20, 300, 200, 80), nrow=2, byrow=TRUE)
+  expect_equal(convertreg(reg, xfb, bbox=bbox), xfb)
+
+  # inside the bounding box, the cropped warp gives the same results
+  m=cbind(runif(100, 100, 300), runif(100, 50, 200), runif(100, 20, 80))
+  expect_equal(streamxform(m, xfb), streamxform(m, reg))
+  expect_equal(streamxform(m, c("--inverse", xfb)),
+               streamxform(m, c("--inverse", reg)))
+
+  # points outside the cropped domain are not transformed
+  expect_true(all(is.na(streamxform(matrix(c(500, 300, 100), ncol=3), xfb))))
+
+  expect_error(convertreg(reg, xfb, bbox=c(1000, 2000, 0, 10, 0, 10)))
+  expect_error(convertreg(reg, xfb, bbox=1:3))
+})
+
+test_that("warps with compact coefficients give nearly the same results",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  m=cbind(runif(2000, 20, 500), runif(2000, 20, 250), runif(2000, 5, 100))
+  full=streamxform(m, reg)
+  compact=streamxform(m, reg, compact=TRUE)
+  expect_equal(is.na(compact), is.na(full))
+  expect_equal(compact, full, tolerance=1e-3, scale=1)
+
+  valid=!is.na(full[,1])
+  expect_equal(streamxform(full[valid,], c("--inverse", reg), compact=TRUE),
+               m[valid,], tolerance=1e-3, scale=1)
+
+  expect_equal(streamxform(m, reg, affineonly=TRUE, compact=TRUE),
+               streamxform(m, reg, affineonly=TRUE))
+})
+
+test_that("warps with a grid origin off the control point lattice round trip exactly",{
+  tfm=tempfile(fileext=".tfm")
+  xfb=tempfile(fileext=".xfb")
+  xform=tempfile(fileext=".xform")
+  cropped=tempfile(fileext=".xform")
+  on.exit(unlink(c(tfm, xfb, xform, cropped)))
+
+  # varying displacements on a 5x5x5 control point grid starting at x=-10.3
+  set.seed(42)
+  writeLines(c("#Insight Transform File V1.0", "#Transform 0",
+    "Transform: BSplineTransform_double_3_3",
+    paste("Parameters:", paste(round(rnorm(375), 3), collapse=" ")),
+    "FixedParameters: 5 5 5 -10.3 -10 -10 10 10 10 1 0 0 0 1 0 0 0 1"), tfm)
+  m=rbind(c(5, 7, 3), c(12, 8, 4), c(1.5, 18, 9))
+  convertreg(tfm, xfb)
+  expect_equal(streamxform(m, xfb), streamxform(m, tfm))
+
+  # other CMTK readers would ignore the origin of the legacy format
+  expect_warning(convertreg(tfm, xform), "origin")
+  expect_equal(streamxform(m, xform), streamxform(m, tfm))
+
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  bbox=matrix(c(100, 50, 20, 300, 200, 80), nrow=2, byrow=TRUE)
+  expect_warning(convertreg(reg, cropped, bbox=bbox), "origin")
+  m=cbind(runif(20, 100, 300), runif(20, 50, 200), runif(20, 20, 80))
+  expect_equal(streamxform(m, cropped), streamxform(m, reg))
+
+  # warps whose domain starts at zero are written without a warning
+  expect_warning(convertreg(reg, xform), NA)
+})
+
+test_that("large batches are inverted through deformation fields consistently",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  nii=tempfile(fileext=".nii")
+  on.exit(unlink(nii))
+  convertreg(reg, nii)
+
+  # streamxform precomputes the inverse field for batches with more points than
+  # the field has grid locations, smaller ones invert every point from scratch
+  m=cbind(runif(3000, 50, 450), runif(3000, 20, 270), runif(3000, 10, 90))
+  chunks=split(seq_len(nrow(m)), rep(1:6, each=500))
+  small=do.call(rbind, lapply(chunks, function(i)
+    streamxform(m[i, , drop=FALSE], c("--inverse", nii))))
+  expect_equal(streamxform(m, c("--inverse", nii)), small, tolerance=1e-6)
+})
+
+test_that("write errors and invalid binary registrations are reported",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  nodir=file.path(tempfile(), "nodir")
+  expect_error(convertreg(reg, file.path(nodir, "reg.xfb")))
+  expect_error(convertreg(reg, file.path(nodir, "reg.nii")))
+
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(xfb))
+  convertreg(reg, xfb)
+  raw=readBin(xfb, what="raw", n=file.size(xfb))
+  m=matrix(rnorm(30, mean=50), ncol=3)
+
+  # control point grid dimensions are three 32 bit integers at byte offset 24
+  setdims=function(dims) {
+    r=raw
+    r[25:36]=writeBin(as.integer(dims), raw(), size=4, endian="little")
+    r
+  }
+  expect_equal(streamxform(m, setdims(c(10, 7, 4))), streamxform(m, reg))
+  expect_error(streamxform(m, setdims(c(-10, -7, 4))))
+  expect_error(streamxform(m, setdims(c(2, 35, 4))))
+  expect_error(streamxform(m, setdims(c(1e9, 1e9, 1e9))))
+})
+
+test_that("errors while writing registration archives are reported",{
+  skip_if_not(file.exists("/dev/full"))
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  # writes to /dev/full fail with ENOSPC, but only once the buffer is flushed
+  expect_error(convertreg(reg, "/dev/full"))
+})
+
+test_that("registrations loaded together in one list match applying them one by one",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  xfb=tempfile(fileext=".xfb")
+  nii=tempfile(fileext=".nii")
+  on.exit(unlink(c(xfb, nii)))
+  convertreg(reg, xfb)
+  convertreg(reg, nii)
+
+  # all registrations in a list are read concurrently
+  m=cbind(runif(100, 100, 300), runif(100, 50, 200), runif(100, 20, 80))
+  regs=list(reg, c("--inverse", xfb), nii, c("--inverse", reg))
+  sequential=Reduce(function(p, r) streamxform(p, r), regs, m)
+  expect_equal(streamxform(m, unlist(regs)), sequential)
+})
+
+test_that("subject transformations can be extracted from groupwise registration archives",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  gw=tempfile(fileext=".xforms")
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(c(gw, xfb)))
+
+  # build an archive with an affine and two warp subjects from the
+  # top-level sections of the bundled registration
+  lines=readLines(gzfile(file.path(reg, "registration.gz")))
+  starts=grep("^\t[a-z_]+ \\{$", lines)
+  ends=grep("^\t\\}$", lines)
+  affine=lines[starts[1]:ends[1]]
+  warp=lines[starts[2]:ends[2]]
+  writeLines(c("! TYPEDSTREAM 1.1", "", "template {", "\tdims 10 7 4",
+    "\tsize 563.934217 326.387675 107", "\torigin 0 0 0", "}",
+    'target "images/affine.nii"', affine, 'target "images/warp1.nii"', warp,
+    'target "images/warp2.nii"', warp), gw)
+
+  m=cbind(runif(20, 100, 300), runif(20, 50, 200), runif(20, 20, 80))
+  convertreg(gw, xfb, subject=1)
+  expect_equal(streamxform(m, xfb), streamxform(m, reg, affineonly=TRUE))
+  for(subject in 2:3) {
+    convertreg(gw, xfb, subject=subject)
+    expect_equal(streamxform(m, xfb), streamxform(m, reg))
+  }
+  expect_error(convertreg(gw, xfb, subject=0))
+  expect_error(convertreg(gw, xfb, subject=4))
+  expect_error(convertreg(reg, xfb, subject=1))
+
+  # a subject without a target path does not affect the other subjects
+  writeLines(c("! TYPEDSTREAM 1.1", "", "template {", "\tdims 10 7 4",
+    "\tsize 563.934217 326.387675 107", "\torigin 0 0 0", "}",
+    affine, 'target "images/warp1.nii"', warp), gw)
+  convertreg(gw, xfb, subject=1)
+  expect_equal(streamxform(m, xfb), streamxform(m, reg, affineonly=TRUE))
+  convertreg(gw, xfb, subject=2)
+  expect_equal(streamxform(m, xfb), streamxform(m, reg))
+  expect_error(convertreg(gw, xfb, subject=3))
+})
+
+test_that("NIfTI volumes are read from mappings and streams",{
+  dir=tempfile()
+  dir.create(dir)
+  on.exit(unlink(dir, recursive=TRUE))
+
+  v=array(-5:18, c(4, 3, 2))
+  writenifti=function(path, endian="little", float=FALSE, slope=1, inter=0) {
+    detached=grepl("\\.hdr$", path)
+    h=raw(348)
+    put=function(offset, x, size)
+      h[offset+seq_len(length(x)*size)] <<- writeBin(x, raw(), size=size, endian=endian)
+    put(0, 348L, 4)
+    put(40, c(3L, dim(v), 1L, 1L, 1L, 1L), 2)
+    put(70, if(float) c(16L, 32L) else c(4L, 16L), 2)
+    put(76, c(1, 2, 3, 4, 1, 1, 1, 1), 4)
+    put(108, c(if(detached) 0 else 352, slope, inter), 4)
+    put(254, 1L, 2)
+    put(280, c(2, 0, 0, 10, 0, 3, 0, 20, 0, 0, 4, 30), 4)
+    h[345:347]=charToRaw(if(detached) "ni1" else "n+1")
+    data=if(float) writeBin(as.numeric(v), raw(), size=4, endian=endian)
+      else writeBin(as.integer(v), raw(), size=2, endian=endian)
+    con=if(grepl("\\.gz$", path)) gzfile(path, "wb") else file(path, "wb")
+    if(detached) {
+      writeBin(h, con)
+      close(con)
+      writeBin(data, sub("\\.hdr$", ".img", path))
+    } else {
+      writeBin(c(h, raw(4), data), con)
+      close(con)
+    }
+    path
+  }
+
+  # uncompressed native data are mapped, all other images are read into memory
+  mapped=readniftivolume(writenifti(file.path(dir, "le.nii")))
+  expect_equal(dim(mapped), dim(v))
+  expect_equal(attr(mapped, "spacing"), c(2, 3, 4))
+  expect_equal(as.vector(mapped), as.vector(v))
+  for(path in c(writenifti(file.path(dir, "be.nii"), endian="big"),
+                writenifti(file.path(dir, "le.nii.gz")),
+                writenifti(file.path(dir, "be.hdr"), endian="big"),
+                writenifti(file.path(dir, "float.nii"), float=TRUE)))
+    expect_equal(as.vector(readniftivolume(path)), as.vector(v), info=path)
+
+  # scaling is applied to a copy, both for converted integers and for floats
+  for(float in c(FALSE, TRUE))
+    for(endian in c("little", "big"))
+      expect_equal(as.vector(readniftivolume(writenifti(
+        file.path(dir, "scaled.nii"), endian=endian, float=float, slope=2, inter=1))),
+        2*as.vector(v)+1)
+
+  # large compressed images are decompressed straight into the voxel array
+  v=array(rep_len(-1000:1000, 128*128*64), c(128, 128, 64))
+  expect_equal(as.vector(readniftivolume(writenifti(file.path(dir, "large.nii.gz")))),
+               as.vector(v))
+  expect_error(readniftivolume(file.path(dir, "nonexistent.nii")))
+})
+
+test_that("registrations can be read and applied on several threads at once",{
+  reg=system.file("extdata","cmtk","FCWB_JFRC2_01_warp_level-01.list", package='cmtkr')
+  nii=tempfile(fileext=".nii.gz")
+  xfb=tempfile(fileext=".xfb")
+  on.exit(unlink(c(nii, xfb)))
+  convertreg(reg, nii)
+  convertreg(reg, xfb)
+
+  # large enough batches to run on the thread pool from every thread
+  m=cbind(runif(3000, 20, 500), runif(3000, 20, 250), runif(3000, 5, 100))
+  for (r in list(reg, xfb, c("--inverse", reg), c("--inverse", nii))) {
+    expected=streamxform(m, r)
+    for (result in streamxformconcurrent(m, r, threads=8)) {
+      expect_identical(result, expected, info=paste(r, collapse=" "))
+    }
+  }
+})